@@ -0,0 +1,73 @@
+/*
+Static tracepoints for the hot paths of libayatana-appindicator.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of either or both of the following licenses:
+
+1) the GNU Lesser General Public License version 3, as published by the
+   Free Software Foundation; and/or
+2) the GNU Lesser General Public License version 2.1, as published by
+   the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the applicable version of the GNU Lesser General Public
+License for more details.
+
+You should have received a copy of both the GNU Lesser General Public
+License version 3 and version 2.1 along with this program.  If not, see
+<http://www.gnu.org/licenses/>
+*/
+
+#ifndef __APP_INDICATOR_TRACE_H__
+#define __APP_INDICATOR_TRACE_H__
+
+#include <glib.h>
+
+/* Built with ENABLE_TRACING the tracepoints become USDT probes of the
+   libayatana_appindicator provider, for perf, bpftrace or systemtap,
+   and marks in sysprof captures.  Otherwise they compile to nothing.
+   Every tracepoint takes a string saying what it is about, mostly
+   the name of the property, method or signal, or the indicator ID. */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define APP_INDICATOR_PROBE(name, arg)      STAP_PROBE1 (libayatana_appindicator, name, arg)
+#else
+#define APP_INDICATOR_PROBE(name, arg)      G_STMT_START { } G_STMT_END
+#endif
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#define APP_INDICATOR_MARK_BEGIN(name)      gint64 app_indicator_mark_##name = SYSPROF_CAPTURE_CURRENT_TIME
+#define APP_INDICATOR_MARK_END(name, arg)   sysprof_collector_mark (app_indicator_mark_##name, \
+                                                                    SYSPROF_CAPTURE_CURRENT_TIME - app_indicator_mark_##name, \
+                                                                    "libayatana-appindicator", #name, arg)
+#define APP_INDICATOR_MARK(name, arg)       sysprof_collector_mark (SYSPROF_CAPTURE_CURRENT_TIME, 0, \
+                                                                    "libayatana-appindicator", #name, arg)
+#else
+#define APP_INDICATOR_MARK_BEGIN(name)      G_STMT_START { } G_STMT_END
+#define APP_INDICATOR_MARK_END(name, arg)   G_STMT_START { } G_STMT_END
+#define APP_INDICATOR_MARK(name, arg)       G_STMT_START { } G_STMT_END
+#endif
+
+/* A single event */
+#define APP_INDICATOR_TRACE(name, arg) \
+    G_STMT_START { \
+        APP_INDICATOR_PROBE (name, arg); \
+        APP_INDICATOR_MARK (name, arg); \
+    } G_STMT_END
+
+/* A span, both ends have to be in the same block */
+#define APP_INDICATOR_TRACE_BEGIN(name, arg) \
+    APP_INDICATOR_MARK_BEGIN (name); \
+    APP_INDICATOR_PROBE (name##_begin, arg)
+
+#define APP_INDICATOR_TRACE_END(name, arg) \
+    G_STMT_START { \
+        APP_INDICATOR_PROBE (name##_end, arg); \
+        APP_INDICATOR_MARK_END (name, arg); \
+    } G_STMT_END
+
+#endif /* __APP_INDICATOR_TRACE_H__ */
@@ -35,6 +35,14 @@ License version 3 and version 2.1 along with this program.  If not, see
 
 #define _GNU_SOURCE
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <glib/gstdio.h>
+#include <gio/gunixfdlist.h>
 
 #include <libdbusmenu-glib/menuitem.h>
 #include <libdbusmenu-glib/server.h>
@@ -49,14 +57,101 @@ License version 3 and version 2.1 along with this program.  If not, see
 #include "app-indicator-enum-types.h"
 #include "application-service-marshal.h"
 
-#include "gen-notification-watcher.xml.h"
-#include "gen-notification-item.xml.h"
+#include "gen-notification-watcher.h"
+#include "gen-notification-item.h"
 
 #include "dbus-shared.h"
 #include "generate-id.h"
+#include "app-indicator-trace.h"
 
 #define PANEL_ICON_SUFFIX  "panel"
 
+/* Upper bounds of the method latency buckets in microseconds, the last
+   bucket collects everything slower than that */
+#define STATS_LATENCY_BUCKETS  5
+static const guint64 stats_latency_bounds[STATS_LATENCY_BUCKETS - 1] = { 100, 1000, 10000, 100000 };
+
+/* The counters are bumped in the owner context, the D-Bus context and
+   by setters in other threads, so they are only touched atomically */
+#define STATS_ADD(counter, n)  __atomic_fetch_add (&(counter), (n), __ATOMIC_RELAXED)
+#define STATS_GET(counter)     __atomic_load_n (&(counter), __ATOMIC_RELAXED)
+
+typedef struct {
+    guint64               setter_calls;
+    guint64               signals_emitted;
+    guint64               signals_coalesced;
+    guint64               signals_suppressed;
+    guint64               property_gets;
+    guint64               method_calls;
+    guint64               registrations;
+    guint64               fallbacks;
+    guint64               unfallbacks;
+    guint64               bytes_sent;
+    guint64               scroll_latency[STATS_LATENCY_BUCKETS];
+    guint64               secondary_activate_latency[STATS_LATENCY_BUCKETS];
+} AppIndicatorStats;
+
+/* Setters called outside of the context that owns the indicator leave
+   their values in a mailbox, which has one slot per property that only
+   keeps the newest value, until that context gets around to it */
+enum {
+    MAILBOX_STATUS,
+    MAILBOX_ICON,
+    MAILBOX_ATTENTION_ICON,
+    MAILBOX_ICON_ANIMATION,
+    MAILBOX_LABEL,
+    MAILBOX_TITLE,
+    MAILBOX_ICON_THEME_PATH,
+    MAILBOX_ORDERING_INDEX,
+    MAILBOX_N_SLOTS
+};
+
+typedef struct {
+    guint                 number;
+    gboolean              is_static;
+    gchar *               strings[2];
+    gchar **              frames;
+} MailboxUpdate;
+
+/* Lives as long as the indicator.  The setters only swap a slot and
+   wake the source up if nobody has yet, no lock is taken. */
+typedef struct {
+    GSource               source;
+    GWeakRef              self;
+    MailboxUpdate *       slots[MAILBOX_N_SLOTS];
+    gint                  pending;
+    gint                  closed;
+} MailboxSource;
+
+/* A function the application set to make some text when it is read.
+   It can be running in the D-Bus context while it is replaced, so
+   whoever calls it holds a reference and the last one frees the data. */
+typedef struct {
+    gint                  ref_count;
+    GCallback             func;
+    gpointer              data;
+    GDestroyNotify        destroy;
+} Provider;
+
+/* Makes the label or the title when somebody needs it, see
+   app_indicator_set_label_provider() */
+typedef struct {
+    Provider *            provider;
+    gint                  dirty;
+} TextProvider;
+
+/* A private connection to the host that asked for it, see
+   XAyatanaOpenPeerChannel.  The server takes one connection and is
+   then stopped. */
+typedef struct {
+    GWeakRef              self;
+    gchar *               sender;
+    GDBusServer *         server;
+    GSource *             timeout;
+    GDBusConnection *     connection;
+    guint                 registration;
+} PeerChannel;
+
 /**
  * AppIndicatorPrivate:
  * @id: The ID of the indicator.  Maps to AppIndicator:id.
@@ -74,25 +169,42 @@ typedef struct {
     /*< Private >*/
     /* Properties */
     gchar                *id;
-    gchar                *clean_id;
+    const gchar          *clean_id;
     AppIndicatorCategory  category;
     AppIndicatorStatus    status;
-    gchar                *icon_name;
-    gchar                *absolute_icon_name;
-    gchar                *attention_icon_name;
-    gchar                *absolute_attention_icon_name;
-    gchar                *icon_theme_path;
-    gchar                *absolute_icon_theme_path;
+    const gchar          *icon_name;
+    const gchar          *absolute_icon_name;
+    const gchar          *attention_icon_name;
+    const gchar          *absolute_attention_icon_name;
+    const gchar          *icon_theme_path;
+    const gchar          *absolute_icon_theme_path;
+    const gchar          *search_theme_path;
+    gboolean              icon_cache_enabled;
+    const gchar          *cached_icon_theme_path;
+    GCancellable         *icon_cache_cancellable;
     DbusmenuServer       *menuservice;
     GtkWidget            *menu;
     GtkWidget            *sec_activate_target;
     gboolean              sec_activate_enabled;
+    gboolean              item_is_menu;
     guint32               ordering_index;
-    gchar *               title;
+    const gchar *         title;
     gchar *               label;
-    gchar *               label_guide;
-    gchar *               accessible_desc;
-    gchar *               att_accessible_desc;
+    const gchar *         label_guide;
+    gchar *               label_template;
+    guint64               label_value;
+    gint                  label_value_pending;
+    GVariant *            tooltip;
+    guint                 tooltip_serial;
+    gboolean              tooltip_dirty;
+    Provider *            tooltip_provider;
+    TextProvider          label_provider;
+    TextProvider          title_provider;
+    gint                  scroll_delta[2];
+    gint64                scroll_start;
+    GSource *             scroll_source;
+    const gchar *         accessible_desc;
+    const gchar *         att_accessible_desc;
     guint                 label_change_idle;
 
     GtkStatusIcon *       status_icon;
@@ -101,14 +213,56 @@ typedef struct {
     /* Fun stuff */
     GDBusConnection      *connection;
     guint                 dbus_registration;
-    gchar *               path;
+    const gchar *         path;
+
+    /* Icon animation */
+    gchar **              icon_anim_frames;
+    gchar **              absolute_icon_anim_frames;
+    guint                 icon_anim_n_frames;
+    guint                 icon_anim_interval;
+    guint                 icon_anim_frame;
+    gint64                icon_anim_next;
+    GHashTable *          icon_anim_hosts;
 
     /* StatusNotifierWatcher */
     GDBusProxy           *watcher_proxy;
-    guint                 watcher_id;
+    gboolean              bus_signals_dropped;
+
+    /* Bus names the signals are sent to instead of everybody, with
+       the ID of the watch on the name, 0 for the ones the application
+       added */
+    gboolean              unicast_signals;
+    GHashTable *          signal_consumers;
+
+    /* Private connections to hosts, see PeerChannel */
+    gboolean              peer_channels_enabled;
+    GPtrArray *           peers;
+
+    /* Shared memory with the state for hosts, see XAyatanaGetStatePage */
+    gboolean              state_page_enabled;
+    gint                  state_page_fd;
+    NotificationItemStatePage * state_page;
+
+    /* Taken off the bus by app_indicator_dispose_many() */
+    gboolean              disposed_in_bulk;
 
     /* Might be used */
     IndicatorDesktopShortcuts * shorties;
+
+    /* Statistics */
+    gint                  stats_enabled;
+    AppIndicatorStats     stats;
+
+    /* Threads */
+    GThread *             owner;
+    GMainContext *        context;
+    MailboxSource *       mailbox;
+    GMainContext *        dbus_context;
+    gboolean              dbus_registering;
+    GMutex                item_lock;
+
+    /* app_indicator_new_async() */
+    GTask *               new_task;
 } AppIndicatorPrivate;
 
 /* Signals Stuff */
@@ -120,6 +274,8 @@ enum {
     CONNECTION_CHANGED,
     NEW_ICON_THEME_PATH,
     SCROLL_EVENT,
+    SMOOTH_SCROLL,
+    ACTIVATE,
     LAST_SIGNAL
 };
 
@@ -143,7 +299,9 @@ enum {
     PROP_ORDERING_INDEX,
     PROP_DBUS_MENU_SERVER,
     PROP_TITLE,
-    PROP_MENU
+    PROP_MENU,
+    PROP_DBUS_CONTEXT,
+    PROP_ITEM_IS_MENU
 };
 
 /* The strings so that they can be slowly looked up. */
@@ -162,18 +320,78 @@ enum {
 #define PROP_DBUS_MENU_SERVER_S      "dbus-menu-server"
 #define PROP_TITLE_S                 "title"
 #define PROP_MENU_S                 "menu"
+#define PROP_DBUS_CONTEXT_S          "dbus-context"
+#define PROP_ITEM_IS_MENU_S          "item-is-menu"
 
 /* Default Path */
 #define DEFAULT_ITEM_PATH   "/org/ayatana/NotificationItem"
 
 /* More constants */
 #define DEFAULT_FALLBACK_TIMER  100 /* in milliseconds */
+#define MIN_ANIMATION_INTERVAL   20 /* in milliseconds */
+#define MAX_UNUSED_INTERNED_STRINGS  64
+#define SNAP_PATH_CACHE_SIZE     16
+#define THEME_CHANGED_DELAY      100 /* in milliseconds */
+#define THEME_CHANGED_MAX_DELAY  1000 /* in milliseconds */
+#define SCROLL_FRAME_INTERVAL    16 /* in milliseconds */
+#define PEER_CHANNEL_TIMEOUT     10 /* in seconds */
+#define PEER_CHANNEL_MAX         64 /* of all indicators */
 
 /* Globals */
-static GDBusNodeInfo *            item_node_info = NULL;
-static GDBusInterfaceInfo *       item_interface_info = NULL;
-static GDBusNodeInfo *            watcher_node_info = NULL;
-static GDBusInterfaceInfo *       watcher_interface_info = NULL;
+
+/* The D-Bus interfaces, gdbus-codegen builds them from the XML files */
+#define item_interface_info       ((GDBusInterfaceInfo *) &_notification_item_interface)
+#define watcher_interface_info    ((GDBusInterfaceInfo *) &_notification_watcher_interface)
+
+/* Enum classes, looked up once */
+static GEnumClass *               category_enum_class = NULL;
+static GEnumClass *               status_enum_class = NULL;
+
+/* Icon names and descriptions are shared between all indicators,
+   see intern_string() */
+G_LOCK_DEFINE_STATIC (interned_strings);
+static GHashTable *               interned_strings = NULL;
+static GQueue                     unused_interned_strings = G_QUEUE_INIT;
+static guint64                    interned_strings_made = 0;
+
+/* Indicators whose icon animation is stepped by us, and the one
+   timer that steps all of them */
+static GList *                    animated_indicators = NULL;
+static guint                      animation_timer = 0;
+static guint                      animation_timer_interval = 0;
+
+/* Indicators that follow the icon theme, the theme changes are
+   collected and sent to all of them at once */
+static GList *                    theme_indicators = NULL;
+static gulong                     theme_changed_handler = 0;
+static guint                      theme_changed_timeout = 0;
+static gint64                     theme_changed_since = 0;
+
+/* All of the indicators share a single watch on the name of the
+   StatusNotifierWatcher and a single proxy for it */
+static GList *                    watcher_indicators = NULL;
+static guint                      watcher_watch = 0;
+static GDBusProxy *               watcher_proxy = NULL;
+static GCancellable *             watcher_cancellable = NULL;
+static gboolean                   watcher_vanished = FALSE;
+
+/* Whether the watcher has a StatusNotifierHost, nobody gets our
+   signals without one.  It is assumed to have one until it says
+   otherwise, as not every watcher can tell. */
+static GDBusConnection *          watcher_host_connection = NULL;
+static guint                      watcher_host_subscription = 0;
+static gint                       watcher_host_registered = TRUE;
+/* Changes with every subscription, so that a late answer to a query
+   of the last watcher is ignored */
+static guint                      watcher_host_generation = 0;
+
+/* The peer channels of all indicators, each one is a listening socket
+   or an open connection */
+static gint                       peer_channels = 0;
+
+/* Paths added to the search path of the default icon theme, with
+   the number of indicators using each one */
+static GHashTable *               theme_search_paths = NULL;
 
 /* Boiler plate */
 static void app_indicator_class_init (AppIndicatorClass *klass);
@@ -185,7 +403,28 @@ static void app_indicator_set_property (GObject * object, guint prop_id, const G
 static void app_indicator_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
 /* Other stuff */
 static void signal_label_change (AppIndicator * self);
+static GVariant * get_tooltip (AppIndicator * self);
+static void tooltip_provider_replace (AppIndicator * self, Provider * provider);
+static void label_template_format (AppIndicator * self);
+static void text_provider_set (AppIndicator * self, TextProvider * provider, AppIndicatorTextFunc func, gpointer data, GDestroyNotify destroy);
+static void label_provider_update (AppIndicator * self);
+static gboolean title_provider_update (AppIndicator * self);
+static void set_status (AppIndicator * self, AppIndicatorStatus status);
+static void signal_new_icon (AppIndicator * self);
+static const gchar * intern_string (const gchar * str, gboolean is_static);
+static void unref_interned_string (const gchar * str);
+static gboolean replace_interned_string (const gchar ** field, const gchar * str, gboolean is_static);
+static void set_icon (AppIndicator * self, const gchar * icon_name, const gchar * icon_desc, gboolean is_static);
+static void set_attention_icon (AppIndicator * self, const gchar * icon_name, const gchar * icon_desc, gboolean is_static);
+static const gchar * get_current_icon (AppIndicator * self, gboolean absolute);
+static void icon_animation_start (AppIndicator * self);
+static void icon_animation_stop (AppIndicator * self);
+static void icon_animation_free_frames (AppIndicator * self);
+static void icon_animation_clear (AppIndicator * self);
+static void icon_animation_set_host_driven (AppIndicator * self, const gchar * host, gboolean host_driven);
+static void icon_animation_hosts_changed (AppIndicator * self);
 static void check_connect (AppIndicator * self);
+static void new_task_complete (AppIndicator * self, GError * error);
 static void register_service_cb (GObject * obj, GAsyncResult * res, gpointer user_data);
 static void start_fallback_timer (AppIndicator * self, gboolean disable_timeout);
 static gboolean fallback_timer_expire (gpointer data);
@@ -198,11 +437,36 @@ static void status_icon_activate (GtkStatusIcon * icon, gpointer data);
 static void status_icon_menu_activate (GtkStatusIcon *status_icon, guint button, guint activate_time, gpointer user_data);
 static void unfallback (AppIndicator * self, GtkStatusIcon * status_icon);
 static gchar * append_panel_icon_suffix (const gchar * icon_name);
-static gchar * get_real_theme_path (AppIndicator * self);
+static const gchar * get_real_theme_path (AppIndicator * self);
 static gchar * append_snap_prefix (const gchar * path);
+static const gchar * snap_path_ref (const gchar * path);
 static void theme_changed_cb (GtkIconTheme * theme, gpointer user_data);
+static void theme_watch_add (AppIndicator * self);
+static void theme_watch_remove (AppIndicator * self);
+static void set_search_theme_path (AppIndicator * self, const gchar * theme_path);
+static const gchar * get_host_theme_path (AppIndicator * self);
+static void signal_new_icon_theme_path (AppIndicator * self);
+static void icon_cache_update (AppIndicator * self);
 static void sec_activate_target_parent_changed(GtkWidget *menuitem, GtkWidget *old_parent, gpointer   user_data);
+static void stats_setter_call (AppIndicator * self);
+static void stats_record_latency (guint64 * histogram, gint64 start);
+static GVariant * stats_to_variant (AppIndicator * self);
+static gboolean in_owner_context (AppIndicator * self);
+static MailboxUpdate * mailbox_update_new (guint number, const gchar * first, const gchar * second, gboolean is_static);
+static void mailbox_post (AppIndicator * self, guint slot, MailboxUpdate * update);
+static MailboxSource * mailbox_new (AppIndicator * self);
+static void mailbox_close (AppIndicator * self);
+static void mailbox_free (AppIndicator * self);
+static void emit_bus_signal (AppIndicator * self, const gchar * name, GVariant * params);
+static void state_page_update (AppIndicator * self, const gchar * signal, GVariant * params);
+static void state_page_close (AppIndicator * self);
+static gboolean signal_resync (gpointer user_data);
+static void consumer_learn (AppIndicator * self, const gchar * sender);
+static void peer_channel_open (AppIndicator * self, const gchar * sender, GDBusMethodInvocation * invocation);
+static PeerChannel * peer_channel_find (AppIndicator * self, const gchar * sender);
+static void state_page_get (AppIndicator * self, GDBusMethodInvocation * invocation);
 static GVariant * bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * property, GError ** error, gpointer user_data);
+static GVariant * get_prop (const gchar * property, GError ** error, gpointer user_data);
 static void bus_method_call (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * method, GVariant * params, GDBusMethodInvocation * invocation, gpointer user_data);
 static void bus_creation (GObject * obj, GAsyncResult * res, gpointer user_data);
 
@@ -215,28 +479,273 @@ static const GDBusInterfaceVTable item_interface_table = {
 /* GObject type */
 G_DEFINE_TYPE_WITH_PRIVATE (AppIndicator, app_indicator, G_TYPE_OBJECT);
 
+/* A string that is shared between all the indicators using the same
+   value, so that changes can be found by comparing pointers and
+   switching between a few icons doesn't allocate. */
+typedef struct {
+    GList          link;
+    guint          ref_count;
+    const gchar *  str;
+    gchar          data[];
+} InternedString;
+
+/* Returns the shared copy of @str with a reference held on it.  With
+   @is_static set @str isn't copied, so it has to live forever. */
+static const gchar *
+intern_string (const gchar * str, gboolean is_static)
+{
+    InternedString * interned;
+
+    if (str == NULL) {
+        return NULL;
+    }
+
+    G_LOCK (interned_strings);
+
+    if (interned_strings == NULL) {
+        interned_strings = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    interned = g_hash_table_lookup (interned_strings, str);
+
+    if (interned == NULL) {
+        if (is_static) {
+            interned = g_malloc0 (sizeof (InternedString));
+            interned->str = str;
+        } else {
+            gsize len = strlen (str);
+
+            interned = g_malloc0 (sizeof (InternedString) + len + 1);
+            memcpy (interned->data, str, len + 1);
+            interned->str = interned->data;
+        }
+
+        interned->link.data = interned;
+        g_hash_table_insert (interned_strings, (gpointer) interned->str, interned);
+        interned_strings_made++;
+    } else if (interned->ref_count == 0) {
+        g_queue_unlink (&unused_interned_strings, &interned->link);
+    }
+
+    interned->ref_count++;
+
+    G_UNLOCK (interned_strings);
+
+    return interned->str;
+}
+
+/* Drops a reference taken by intern_string().  The last few unused
+   strings are kept as indicators tend to switch back to them. */
+static void
+unref_interned_string (const gchar * str)
+{
+    InternedString * interned;
+
+    if (str == NULL) {
+        return;
+    }
+
+    G_LOCK (interned_strings);
+
+    interned = g_hash_table_lookup (interned_strings, str);
+
+    if (interned == NULL || interned->ref_count == 0) {
+        G_UNLOCK (interned_strings);
+        g_warning ("Unreferencing string '%s' that isn't interned", str);
+        return;
+    }
+
+    interned->ref_count--;
+
+    if (interned->ref_count == 0) {
+        g_queue_push_head_link (&unused_interned_strings, &interned->link);
+
+        if (unused_interned_strings.length > MAX_UNUSED_INTERNED_STRINGS) {
+            InternedString * oldest = g_queue_pop_tail_link (&unused_interned_strings)->data;
+
+            g_hash_table_remove (interned_strings, oldest->str);
+            g_free (oldest);
+        }
+    }
+
+    G_UNLOCK (interned_strings);
+
+    return;
+}
+
+/* A host appeared, the indicators that dropped signals while there
+   was none send their whole state once */
+static void
+watcher_host_set (gboolean registered)
+{
+    GList *indicators;
+    GList *l;
+
+    if (g_atomic_int_get (&watcher_host_registered) == registered) {
+        return;
+    }
+
+    g_atomic_int_set (&watcher_host_registered, registered);
+
+    if (!registered) {
+        return;
+    }
+
+    indicators = g_list_copy_deep (watcher_indicators, (GCopyFunc) g_object_ref, NULL);
+
+    for (l = indicators; l != NULL; l = l->next) {
+        AppIndicator *self = APP_INDICATOR (l->data);
+        AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+        g_main_context_invoke_full (priv->context, G_PRIORITY_DEFAULT, signal_resync,
+                                    g_object_ref (self), g_object_unref);
+    }
+
+    g_list_free_full (indicators, g_object_unref);
+}
+
+static void
+watcher_host_query_cb (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+    GError *error = NULL;
+    GVariant *reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+    GVariant *value = NULL;
+
+    /* The watcher went away or was replaced in the meantime */
+    if (watcher_host_subscription == 0 || GPOINTER_TO_UINT (user_data) != watcher_host_generation) {
+        g_clear_error (&error);
+        g_clear_pointer (&reply, g_variant_unref);
+        return;
+    }
+
+    /* A watcher without the property can't tell us either way */
+    if (error) {
+        g_debug ("Unable to get IsStatusNotifierHostRegistered: %s", error->message);
+        g_error_free (error);
+        watcher_host_set (TRUE);
+        return;
+    }
+
+    g_variant_get (reply, "(v)", &value);
+
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)) {
+        watcher_host_set (g_variant_get_boolean (value));
+    } else {
+        watcher_host_set (TRUE);
+    }
+
+    g_variant_unref (value);
+    g_variant_unref (reply);
+}
+
+static void
+watcher_host_query (void)
+{
+    g_dbus_connection_call (watcher_host_connection,
+                            NOTIFICATION_WATCHER_DBUS_ADDR,
+                            NOTIFICATION_WATCHER_DBUS_OBJ,
+                            "org.freedesktop.DBus.Properties",
+                            "Get",
+                            g_variant_new ("(ss)", NOTIFICATION_WATCHER_DBUS_IFACE, "IsStatusNotifierHostRegistered"),
+                            G_VARIANT_TYPE ("(v)"),
+                            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                            -1,
+                            NULL,
+                            watcher_host_query_cb,
+                            GUINT_TO_POINTER (watcher_host_generation));
+}
+
+static void
+watcher_host_signal (GDBusConnection *connection,
+                     const gchar     *sender,
+                     const gchar     *path,
+                     const gchar     *interface,
+                     const gchar     *signal,
+                     GVariant        *params,
+                     gpointer         user_data)
+{
+    if (g_strcmp0 (signal, "StatusNotifierHostRegistered") == 0) {
+        watcher_host_set (TRUE);
+    } else if (g_strcmp0 (signal, "StatusNotifierHostUnregistered") == 0) {
+        /* Not in the spec, but sent by some watchers.  There might be
+           other hosts left. */
+        watcher_host_query ();
+    }
+}
+
+/* Follows the hosts of the watcher, the signals are subscribed to
+   before asking so that no change is missed */
+static void
+watcher_host_watch (GDBusConnection *connection)
+{
+    if (watcher_host_subscription == 0) {
+        watcher_host_generation++;
+        watcher_host_connection = g_object_ref (connection);
+        watcher_host_subscription = g_dbus_connection_signal_subscribe (connection,
+                                                                        NOTIFICATION_WATCHER_DBUS_ADDR,
+                                                                        NOTIFICATION_WATCHER_DBUS_IFACE,
+                                                                        NULL,
+                                                                        NOTIFICATION_WATCHER_DBUS_OBJ,
+                                                                        NULL,
+                                                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                        watcher_host_signal,
+                                                                        NULL, NULL);
+    }
+
+    watcher_host_query ();
+}
+
+static void
+watcher_host_unwatch (void)
+{
+    if (watcher_host_subscription != 0) {
+        g_dbus_connection_signal_unsubscribe (watcher_host_connection, watcher_host_subscription);
+        watcher_host_subscription = 0;
+    }
+
+    g_clear_object (&watcher_host_connection);
+
+    /* Back to not knowing, without a resync as there is nobody */
+    g_atomic_int_set (&watcher_host_registered, TRUE);
+}
+
 static void
 watcher_ready_cb (GObject      *source_object,
                   GAsyncResult *res,
                   gpointer      user_data)
 {
-    AppIndicator *self = APP_INDICATOR(user_data);
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
-
     GError *error = NULL;
+    GDBusProxy *proxy = g_dbus_proxy_new_finish (res, &error);
+    GList *l;
+
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free (error);
+        return;
+    }
 
-    priv->watcher_proxy = g_dbus_proxy_new_finish (res, &error);
+    g_clear_object (&watcher_cancellable);
 
     if (error) {
-        start_fallback_timer (self, FALSE);
-        g_object_unref (self);
+        for (l = watcher_indicators; l != NULL; l = l->next) {
+            start_fallback_timer (APP_INDICATOR (l->data), FALSE);
+        }
 
         g_error_free (error);
         return;
     }
 
-    check_connect (self);
-    g_object_unref (self);
+    watcher_proxy = proxy;
+    watcher_host_watch (g_dbus_proxy_get_connection (proxy));
+
+    for (l = watcher_indicators; l != NULL; l = l->next) {
+        AppIndicator *self = APP_INDICATOR (l->data);
+        AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+        g_set_object (&priv->watcher_proxy, watcher_proxy);
+        check_connect (self);
+    }
 }
 
 static void
@@ -245,19 +754,25 @@ name_appeared_handler (GDBusConnection *connection,
                        const gchar     *name_owner,
                        gpointer         user_data)
 {
-    AppIndicator *self = APP_INDICATOR(user_data);
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    watcher_vanished = FALSE;
 
-    g_dbus_proxy_new (priv->connection,
+    if (watcher_cancellable != NULL) {
+        g_cancellable_cancel (watcher_cancellable);
+        g_object_unref (watcher_cancellable);
+    }
+
+    watcher_cancellable = g_cancellable_new ();
+
+    g_dbus_proxy_new (connection,
                       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
                       G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
                       watcher_interface_info,
                       NOTIFICATION_WATCHER_DBUS_ADDR,
                       NOTIFICATION_WATCHER_DBUS_OBJ,
                       NOTIFICATION_WATCHER_DBUS_IFACE,
-                      NULL,
+                      watcher_cancellable,
                       (GAsyncReadyCallback) watcher_ready_cb,
-                      (AppIndicator*)g_object_ref (self));
+                      NULL);
 }
 
 static void
@@ -265,15 +780,124 @@ name_vanished_handler (GDBusConnection *connection,
                        const gchar     *name,
                        gpointer         user_data)
 {
-    AppIndicator *self = APP_INDICATOR(user_data);
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    GList *indicators;
+    GList *l;
 
-    g_clear_object (&priv->watcher_proxy);
+    watcher_vanished = TRUE;
 
-    /* Emit the AppIndicator::connection-changed signal*/
-    g_signal_emit (self, signals[CONNECTION_CHANGED], 0, FALSE);
+    if (watcher_cancellable != NULL) {
+        g_cancellable_cancel (watcher_cancellable);
+        g_clear_object (&watcher_cancellable);
+    }
+
+    g_clear_object (&watcher_proxy);
+    watcher_host_unwatch ();
+
+    /* The signal handlers could drop indicators from the list */
+    indicators = g_list_copy_deep (watcher_indicators, (GCopyFunc) g_object_ref, NULL);
+
+    for (l = indicators; l != NULL; l = l->next) {
+        AppIndicator *self = APP_INDICATOR (l->data);
+        AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+        g_clear_object (&priv->watcher_proxy);
+
+        /* Without a watcher there is nobody animating our icon */
+        g_clear_pointer (&priv->icon_anim_hosts, g_hash_table_unref);
+        icon_animation_hosts_changed (self);
+
+        /* Emit the AppIndicator::connection-changed signal*/
+        g_signal_emit (self, signals[CONNECTION_CHANGED], 0, FALSE);
+
+        start_fallback_timer (self, FALSE);
+    }
+
+    g_list_free_full (indicators, g_object_unref);
+}
+
+/* Adds @self to the indicators that follow the watcher, it gets the
+   proxy right away when there is one */
+static void
+watcher_add (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    watcher_indicators = g_list_prepend (watcher_indicators, self);
+
+    if (watcher_watch == 0) {
+        watcher_watch = g_bus_watch_name (G_BUS_TYPE_SESSION,
+                                          NOTIFICATION_WATCHER_DBUS_ADDR,
+                                          G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                          (GBusNameAppearedCallback) name_appeared_handler,
+                                          (GBusNameVanishedCallback) name_vanished_handler,
+                                          NULL, NULL);
+    } else if (watcher_proxy != NULL) {
+        priv->watcher_proxy = g_object_ref (watcher_proxy);
+    } else if (watcher_vanished) {
+        start_fallback_timer (self, FALSE);
+    }
+
+    return;
+}
+
+/* Lets go of the watch and the proxy once the last indicator left */
+static void
+watcher_release (void)
+{
+    if (watcher_indicators != NULL) {
+        return;
+    }
+
+    if (watcher_watch != 0) {
+        g_bus_unwatch_name (watcher_watch);
+        watcher_watch = 0;
+    }
+
+    if (watcher_cancellable != NULL) {
+        g_cancellable_cancel (watcher_cancellable);
+        g_clear_object (&watcher_cancellable);
+    }
+
+    g_clear_object (&watcher_proxy);
+    watcher_host_unwatch ();
+    watcher_vanished = FALSE;
+
+    return;
+}
+
+static void
+watcher_remove (AppIndicator * self)
+{
+    watcher_indicators = g_list_remove (watcher_indicators, self);
+    watcher_release ();
+
+    return;
+}
+
+/* Takes many indicators out of the list in one pass */
+static void
+watcher_remove_many (AppIndicator ** indicators, guint n_indicators)
+{
+    GHashTable * gone = g_hash_table_new (NULL, NULL);
+    GList * l, * next;
+    guint i;
+
+    for (i = 0; i < n_indicators; i++) {
+        g_hash_table_add (gone, indicators[i]);
+    }
+
+    for (l = watcher_indicators; l != NULL; l = next) {
+        next = l->next;
+
+        if (g_hash_table_contains (gone, l->data)) {
+            watcher_indicators = g_list_delete_link (watcher_indicators, l);
+        }
+    }
 
-    start_fallback_timer (self, FALSE);
+    g_hash_table_unref (gone);
+    watcher_release ();
+
+    return;
 }
 
 static void
@@ -293,6 +917,9 @@ app_indicator_class_init (AppIndicatorClass *klass)
     klass->fallback = fallback;
     klass->unfallback = unfallback;
 
+    category_enum_class = g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY);
+    status_enum_class = g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_STATUS);
+
     /* Properties */
 
     /**
@@ -515,6 +1142,43 @@ app_indicator_class_init (AppIndicatorClass *klass)
                                                          NULL,
                                                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+    /**
+     * AppIndicator:dbus-context:
+     *
+     * The #GMainContext that the item's D-Bus object is served from.
+     * Property reads and the statistics are answered there directly,
+     * everything that ends up in GTK, like scrolling and secondary
+     * activation, is still run in the context the indicator was made
+     * in.  %NULL, the default, serves the object from that context too.
+     *
+     * Since: 0.5.95
+     */
+    g_object_class_install_property(object_class,
+                                    PROP_DBUS_CONTEXT,
+                                    g_param_spec_boxed (PROP_DBUS_CONTEXT_S,
+                                                        "The main context for D-Bus",
+                                                        "The main context that the D-Bus object of the indicator is served from.",
+                                                        G_TYPE_MAIN_CONTEXT,
+                                                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT_ONLY));
+
+    /**
+     * AppIndicator:item-is-menu:
+     *
+     * Whether the indicator only has a menu to show.  When this is
+     * %FALSE hosts call Activate on a primary click instead of showing
+     * the menu, which is signaled as #AppIndicator::activate, and the
+     * indicator is put on the bus without needing a menu.
+     *
+     * Since: 0.5.95
+     */
+    g_object_class_install_property(object_class,
+                                    PROP_ITEM_IS_MENU,
+                                    g_param_spec_boolean (PROP_ITEM_IS_MENU_S,
+                                                          "Whether the indicator is only a menu",
+                                                          "Whether a primary click shows the menu instead of activating the application indicator.",
+                                                          TRUE,
+                                                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
     /* Signals */
 
     /**
@@ -615,7 +1279,8 @@ app_indicator_class_init (AppIndicatorClass *klass)
      * @arg1: How many steps the scroll wheel has taken
      * @arg2: (type Gdk.ScrollDirection): Which direction the wheel went in
      *
-     * Signaled when the #AppIndicator receives a scroll event.
+     * Signaled when the #AppIndicator receives a scroll event.  The
+     * scroll events of a frame are merged, @arg1 is their sum.
      */
     signals[SCROLL_EVENT] = g_signal_new (APP_INDICATOR_SIGNAL_SCROLL_EVENT,
                                       G_TYPE_FROM_CLASS(klass),
@@ -625,42 +1290,44 @@ app_indicator_class_init (AppIndicatorClass *klass)
                                       _application_service_marshal_VOID__INT_UINT,
                                       G_TYPE_NONE, 2, G_TYPE_INT, GDK_TYPE_SCROLL_DIRECTION);
 
-    /* DBus interfaces */
-    if (item_node_info == NULL) {
-        GError * error = NULL;
-
-        item_node_info = g_dbus_node_info_new_for_xml(_notification_item, &error);
-        if (error != NULL) {
-            g_error("Unable to parse Notification Item DBus interface: %s", error->message);
-            g_error_free(error);
-        }
-    }
-
-    if (item_interface_info == NULL && item_node_info != NULL) {
-        item_interface_info = g_dbus_node_info_lookup_interface(item_node_info, NOTIFICATION_ITEM_DBUS_IFACE);
-
-        if (item_interface_info == NULL) {
-            g_error("Unable to find interface '" NOTIFICATION_ITEM_DBUS_IFACE "'");
-        }
-    }
-
-    if (watcher_node_info == NULL) {
-        GError * error = NULL;
-
-        watcher_node_info = g_dbus_node_info_new_for_xml(_notification_watcher, &error);
-        if (error != NULL) {
-            g_error("Unable to parse Notification Item DBus interface: %s", error->message);
-            g_error_free(error);
-        }
-    }
-
-    if (watcher_interface_info == NULL && watcher_node_info != NULL) {
-        watcher_interface_info = g_dbus_node_info_lookup_interface(watcher_node_info, NOTIFICATION_WATCHER_DBUS_IFACE);
+    /**
+     * AppIndicator::smooth-scroll:
+     * @arg0: The #AppIndicator object
+     * @arg1: The sum of the deltas the host sent, negative for up or left
+     * @arg2: (type Gtk.Orientation): Which way the scrolling went
+     *
+     * Signaled at most once per frame and orientation with all of the
+     * scrolling the host sent in that frame, right after
+     * #AppIndicator::scroll-event is signaled for it.
+     *
+     * Since: 0.5.95
+     */
+    signals[SMOOTH_SCROLL] = g_signal_new (APP_INDICATOR_SIGNAL_SMOOTH_SCROLL,
+                                      G_TYPE_FROM_CLASS(klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      0,
+                                      NULL, NULL,
+                                      _application_service_marshal_VOID__INT_UINT,
+                                      G_TYPE_NONE, 2, G_TYPE_INT, GTK_TYPE_ORIENTATION);
 
-        if (watcher_interface_info == NULL) {
-            g_error("Unable to find interface '" NOTIFICATION_WATCHER_DBUS_IFACE "'");
-        }
-    }
+    /**
+     * AppIndicator::activate:
+     * @arg0: The #AppIndicator object
+     * @arg1: The horizontal position of the click on the screen
+     * @arg2: The vertical position of the click on the screen
+     *
+     * Signaled when the indicator is clicked on in a host that doesn't
+     * show the menu for it, see #AppIndicator:item-is-menu.
+     *
+     * Since: 0.5.95
+     */
+    signals[ACTIVATE] = g_signal_new (APP_INDICATOR_SIGNAL_ACTIVATE,
+                                      G_TYPE_FROM_CLASS(klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      0,
+                                      NULL, NULL,
+                                      _application_service_marshal_VOID__INT_INT,
+                                      G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
 
     return;
 }
@@ -684,53 +1351,125 @@ app_indicator_init (AppIndicator *self)
     priv->title = NULL;
     priv->label = NULL;
     priv->label_guide = NULL;
+    priv->label_template = NULL;
+    priv->label_value = 0;
+    priv->label_value_pending = FALSE;
+    priv->tooltip = NULL;
+    priv->tooltip_serial = 0;
+    priv->tooltip_dirty = FALSE;
+    priv->tooltip_provider = NULL;
+    memset(&priv->label_provider, 0, sizeof(TextProvider));
+    memset(&priv->title_provider, 0, sizeof(TextProvider));
+    priv->scroll_delta[GTK_ORIENTATION_HORIZONTAL] = 0;
+    priv->scroll_delta[GTK_ORIENTATION_VERTICAL] = 0;
+    priv->scroll_start = 0;
+    priv->scroll_source = NULL;
     priv->label_change_idle = 0;
 
     priv->connection = NULL;
     priv->dbus_registration = 0;
     priv->path = NULL;
 
+    priv->icon_anim_frames = NULL;
+    priv->absolute_icon_anim_frames = NULL;
+    priv->icon_anim_n_frames = 0;
+    priv->icon_anim_interval = 0;
+    priv->icon_anim_frame = 0;
+    priv->icon_anim_next = 0;
+    priv->icon_anim_hosts = NULL;
+
     priv->status_icon = NULL;
     priv->fallback_timer = 0;
 
     priv->shorties = NULL;
 
+    priv->stats_enabled = g_getenv ("AYATANA_APPINDICATOR_STATS") != NULL;
+
+    priv->owner = g_thread_self();
+    priv->context = g_main_context_ref_thread_default();
+    priv->mailbox = mailbox_new(self);
+    priv->dbus_context = NULL;
+    priv->dbus_registering = FALSE;
+    g_mutex_init(&priv->item_lock);
+    priv->new_task = NULL;
+
     priv->sec_activate_target = NULL;
     priv->sec_activate_enabled = FALSE;
+    priv->item_is_menu = TRUE;
 
     priv->watcher_proxy = NULL;
-    priv->watcher_id = g_bus_watch_name (G_BUS_TYPE_SESSION,
-                                         NOTIFICATION_WATCHER_DBUS_ADDR,
-                                         G_BUS_NAME_WATCHER_FLAGS_NONE,
-                                         (GBusNameAppearedCallback) name_appeared_handler,
-                                         (GBusNameVanishedCallback) name_vanished_handler,
-                                         self, NULL);
+    priv->bus_signals_dropped = FALSE;
+    priv->unicast_signals = FALSE;
+    priv->signal_consumers = NULL;
+    priv->peer_channels_enabled = FALSE;
+    priv->peers = NULL;
+    priv->state_page_enabled = FALSE;
+    priv->state_page_fd = -1;
+    priv->state_page = NULL;
+    priv->disposed_in_bulk = FALSE;
+    watcher_add(self);
 
     /* Start getting the session bus */
     g_object_ref(self); /* ref for the bus creation callback */
     g_bus_get(G_BUS_TYPE_SESSION, NULL, bus_creation, self);
 
-    g_signal_connect(G_OBJECT(gtk_icon_theme_get_default()),
-        "changed", G_CALLBACK(theme_changed_cb), self);
+    theme_watch_add(self);
 
     return;
 }
 
-/* Free all objects, make sure that all the dbus
-   signals are sent out before we shut this down. */
-static void
-app_indicator_dispose (GObject *object)
+/* Holds the reference that app_indicator_dispose() took, dropping it
+   in the owner context is what disposes of the indicator there */
+static gboolean
+dispose_in_owner_context (gpointer user_data)
 {
-    AppIndicator *self = APP_INDICATOR (object);
+    return G_SOURCE_REMOVE;
+}
+
+/* Hands the reference to @self that the caller holds over to the owner
+   context, dropping it there after @func ran.  Always through a
+   source, g_main_context_invoke() would run @func and drop the
+   reference right here when nobody runs the owner context. */
+static void
+release_in_owner_context (AppIndicator * self, GSourceFunc func)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    GSource * source = g_idle_source_new ();
+
+    g_source_set_priority (source, G_PRIORITY_DEFAULT);
+    g_source_set_callback (source, func, self, g_object_unref);
+    g_source_attach (source, priv->context);
+    g_source_unref (source);
+
+    return;
+}
+
+/* Free all objects, make sure that all the dbus
+   signals are sent out before we shut this down. */
+static void
+app_indicator_dispose (GObject *object)
+{
+    AppIndicator *self = APP_INDICATOR (object);
     AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
 
+    /* The lists shared by all indicators and GTK belong to the owner
+       context, so the last reference dropped in another thread only
+       hands the indicator back to it.  Keeping a reference stops
+       GObject from finalizing it here. */
+    if (!in_owner_context (self)) {
+        release_in_owner_context (g_object_ref (self), dispose_in_owner_context);
+        return;
+    }
+
     if (priv->shorties != NULL) {
         g_object_unref(G_OBJECT(priv->shorties));
         priv->shorties = NULL;
     }
 
-    if (priv->status != APP_INDICATOR_STATUS_PASSIVE) {
-        app_indicator_set_status(self, APP_INDICATOR_STATUS_PASSIVE);
+    /* Hosts find out about the ones taken down in bulk all at once,
+       see app_indicator_dispose_many() */
+    if (priv->status != APP_INDICATOR_STATUS_PASSIVE && !priv->disposed_in_bulk) {
+        set_status(self, APP_INDICATOR_STATUS_PASSIVE);
     }
 
     if (priv->status_icon != NULL) {
@@ -751,6 +1490,20 @@ app_indicator_dispose (GObject *object)
         priv->label_change_idle = 0;
     }
 
+    icon_animation_clear(self);
+
+    g_mutex_lock(&priv->item_lock);
+    if (priv->scroll_source != NULL) {
+        g_source_destroy(priv->scroll_source);
+        g_clear_pointer(&priv->scroll_source, g_source_unref);
+    }
+    g_mutex_unlock(&priv->item_lock);
+
+    tooltip_provider_replace(self, NULL);
+
+    text_provider_set(self, &priv->label_provider, NULL, NULL, NULL);
+    text_provider_set(self, &priv->title_provider, NULL, NULL, NULL);
+
     if (priv->menu != NULL) {
         g_object_unref(G_OBJECT(priv->menu));
         priv->menu = NULL;
@@ -760,9 +1513,8 @@ app_indicator_dispose (GObject *object)
         g_object_unref (priv->menuservice);
     }
 
-    if (priv->watcher_id != 0) {
-        g_bus_unwatch_name (priv->watcher_id);
-        priv->watcher_id = 0;
+    if (!priv->disposed_in_bulk) {
+        watcher_remove(self);
     }
 
     if (priv->watcher_proxy != NULL) {
@@ -770,7 +1522,9 @@ app_indicator_dispose (GObject *object)
         priv->watcher_proxy = NULL;
 
         /* Emit the AppIndicator::connection-changed signal*/
-        g_signal_emit (self, signals[CONNECTION_CHANGED], 0, FALSE);
+        if (!priv->disposed_in_bulk) {
+            g_signal_emit (self, signals[CONNECTION_CHANGED], 0, FALSE);
+        }
     }
 
     if (priv->dbus_registration != 0) {
@@ -778,6 +1532,13 @@ app_indicator_dispose (GObject *object)
         priv->dbus_registration = 0;
     }
 
+    g_mutex_lock(&priv->item_lock);
+    g_clear_pointer(&priv->signal_consumers, g_hash_table_unref);
+    g_mutex_unlock(&priv->item_lock);
+
+    g_clear_pointer(&priv->peers, g_ptr_array_unref);
+    state_page_close(self);
+
     if (priv->connection != NULL) {
         g_object_unref(G_OBJECT(priv->connection));
         priv->connection = NULL;
@@ -789,7 +1550,14 @@ app_indicator_dispose (GObject *object)
         priv->sec_activate_target = NULL;
     }
 
-    g_signal_handlers_disconnect_by_func(gtk_icon_theme_get_default(), G_CALLBACK(theme_changed_cb), self);
+    theme_watch_remove(self);
+    set_search_theme_path(self, NULL);
+    mailbox_close(self);
+
+    if (priv->icon_cache_cancellable != NULL) {
+        g_cancellable_cancel(priv->icon_cache_cancellable);
+        g_clear_object(&priv->icon_cache_cancellable);
+    }
 
     G_OBJECT_CLASS (app_indicator_parent_class)->dispose (object);
     return;
@@ -807,48 +1575,51 @@ app_indicator_finalize (GObject *object)
         g_warning("Finalizing Application Status with the status set to: %d", priv->status);
     }
 
+    /* The clean ID and the path live in the same block as the ID */
     if (priv->id != NULL) {
         g_free(priv->id);
         priv->id = NULL;
-    }
-
-    if (priv->clean_id != NULL) {
-        g_free(priv->clean_id);
         priv->clean_id = NULL;
+        priv->path = NULL;
     }
 
     if (priv->icon_name != NULL) {
-        g_free(priv->icon_name);
+        unref_interned_string(priv->icon_name);
         priv->icon_name = NULL;
     }
 
     if (priv->absolute_icon_name != NULL) {
-        g_free(priv->absolute_icon_name);
+        unref_interned_string(priv->absolute_icon_name);
         priv->absolute_icon_name = NULL;
     }
 
     if (priv->attention_icon_name != NULL) {
-        g_free(priv->attention_icon_name);
+        unref_interned_string(priv->attention_icon_name);
         priv->attention_icon_name = NULL;
     }
 
     if (priv->absolute_attention_icon_name != NULL) {
-        g_free(priv->absolute_attention_icon_name);
+        unref_interned_string(priv->absolute_attention_icon_name);
         priv->absolute_attention_icon_name = NULL;
     }
 
     if (priv->icon_theme_path != NULL) {
-        g_free(priv->icon_theme_path);
+        unref_interned_string(priv->icon_theme_path);
         priv->icon_theme_path = NULL;
     }
 
     if (priv->absolute_icon_theme_path != NULL) {
-        g_free(priv->absolute_icon_theme_path);
+        unref_interned_string(priv->absolute_icon_theme_path);
         priv->absolute_icon_theme_path = NULL;
     }
 
+    if (priv->cached_icon_theme_path != NULL) {
+        unref_interned_string(priv->cached_icon_theme_path);
+        priv->cached_icon_theme_path = NULL;
+    }
+
     if (priv->title != NULL) {
-        g_free(priv->title);
+        unref_interned_string(priv->title);
         priv->title = NULL;
     }
 
@@ -858,31 +1629,80 @@ app_indicator_finalize (GObject *object)
     }
 
     if (priv->label_guide != NULL) {
-        g_free(priv->label_guide);
+        unref_interned_string(priv->label_guide);
         priv->label_guide = NULL;
     }
 
+    g_clear_pointer(&priv->label_template, g_free);
+    g_clear_pointer(&priv->tooltip, g_variant_unref);
+
     if (priv->accessible_desc != NULL) {
-        g_free(priv->accessible_desc);
+        unref_interned_string(priv->accessible_desc);
         priv->accessible_desc = NULL;
     }
 
     if (priv->att_accessible_desc != NULL) {
-        g_free(priv->att_accessible_desc);
+        unref_interned_string(priv->att_accessible_desc);
         priv->att_accessible_desc = NULL;
     }
 
-    if (priv->path != NULL) {
-        g_free(priv->path);
-        priv->path = NULL;
+    mailbox_free(self);
+
+    if (priv->context != NULL) {
+        g_main_context_unref(priv->context);
+        priv->context = NULL;
+    }
+
+    if (priv->dbus_context != NULL) {
+        g_main_context_unref(priv->dbus_context);
+        priv->dbus_context = NULL;
     }
 
+    g_mutex_clear(&priv->item_lock);
+
     G_OBJECT_CLASS (app_indicator_parent_class)->finalize (object);
     return;
 }
 
 #define WARN_BAD_TYPE(prop, value)  g_warning("Can not work with property '%s' with value of type '%s'.", prop, G_VALUE_TYPE_NAME(value))
 
+/* The ID, the clean ID and the object path are kept in a single
+   block as "id\0clean_id\0path\0", they never change afterwards */
+static void
+set_id (AppIndicator * self, const gchar * id)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    gsize id_len;
+    gchar * block;
+    gchar * clean_id;
+    gchar * path;
+    gsize i;
+
+    if (id == NULL) {
+        return;
+    }
+
+    id_len = strlen (id);
+    block = g_malloc (2 * (id_len + 1) + sizeof (DEFAULT_ITEM_PATH "/") + id_len);
+    clean_id = block + id_len + 1;
+    path = clean_id + id_len + 1;
+
+    memcpy (block, id, id_len + 1);
+
+    for (i = 0; i <= id_len; i++) {
+        clean_id[i] = (id[i] == '\0' || g_ascii_isalnum (id[i])) ? id[i] : '_';
+    }
+
+    memcpy (path, DEFAULT_ITEM_PATH "/", sizeof (DEFAULT_ITEM_PATH "/") - 1);
+    memcpy (path + sizeof (DEFAULT_ITEM_PATH "/") - 1, clean_id, id_len + 1);
+
+    priv->id = block;
+    priv->clean_id = clean_id;
+    priv->path = path;
+
+    return;
+}
+
 /* Set some properties */
 static void
 app_indicator_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
@@ -898,21 +1718,12 @@ app_indicator_set_property (GObject * object, guint prop_id, const GValue * valu
             break;
           }
 
-          priv->id = g_strdup (g_value_get_string (value));
-
-          priv->clean_id = g_strdup(priv->id);
-          gchar * cleaner;
-          for (cleaner = priv->clean_id; *cleaner != '\0'; cleaner++) {
-            if (!g_ascii_isalnum(*cleaner)) {
-              *cleaner = '_';
-            }
-          }
-
+          set_id (self, g_value_get_string (value));
           check_connect (self);
           break;
 
         case PROP_CATEGORY:
-          enum_val = g_enum_get_value_by_nick ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY),
+          enum_val = g_enum_get_value_by_nick (category_enum_class,
                                                g_value_get_string (value));
 
           if (priv->category != enum_val->value)
@@ -923,7 +1734,7 @@ app_indicator_set_property (GObject * object, guint prop_id, const GValue * valu
           break;
 
         case PROP_STATUS:
-          enum_val = g_enum_get_value_by_nick ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_STATUS),
+          enum_val = g_enum_get_value_by_nick (status_enum_class,
                                                g_value_get_string (value));
 
           app_indicator_set_status (APP_INDICATOR (object),
@@ -963,14 +1774,23 @@ app_indicator_set_property (GObject * object, guint prop_id, const GValue * valu
           break;
 
         case PROP_LABEL: {
-          gchar * oldlabel = priv->label;
-          priv->label = g_value_dup_string(value);
+          gchar * label = g_value_dup_string(value);
+          gchar * oldlabel;
 
-          if (priv->label != NULL && priv->label[0] == '\0') {
-            g_free(priv->label);
-            priv->label = NULL;
+          if (label != NULL && label[0] == '\0') {
+            g_free(label);
+            label = NULL;
           }
 
+          g_mutex_lock(&priv->item_lock);
+          oldlabel = priv->label;
+          priv->label = label;
+          g_mutex_unlock(&priv->item_lock);
+
+          /* A label of its own replaces the template and the provider */
+          g_clear_pointer(&priv->label_template, g_free);
+          text_provider_set(self, &priv->label_provider, NULL, NULL, NULL);
+
           if (g_strcmp0(oldlabel, priv->label) != 0) {
             signal_label_change(APP_INDICATOR(object));
           }
@@ -981,33 +1801,21 @@ app_indicator_set_property (GObject * object, guint prop_id, const GValue * valu
           break;
         }
         case PROP_TITLE: {
-          gchar * oldtitle = priv->title;
-          priv->title = g_value_dup_string(value);
+          const gchar * title = g_value_get_string(value);
+          gboolean changed;
 
-          if (priv->title != NULL && priv->title[0] == '\0') {
-            g_free(priv->title);
-            priv->title = NULL;
+          if (title != NULL && title[0] == '\0') {
+            title = NULL;
           }
 
-          if (g_strcmp0(oldtitle, priv->title) != 0 && priv->connection != NULL) {
-            GError * error = NULL;
+          text_provider_set(self, &priv->title_provider, NULL, NULL, NULL);
 
-            g_dbus_connection_emit_signal(priv->connection,
-                                          NULL,
-                                          priv->path,
-                                          NOTIFICATION_ITEM_DBUS_IFACE,
-                                          "NewTitle",
-                                          NULL,
-                                          &error);
+          g_mutex_lock(&priv->item_lock);
+          changed = replace_interned_string(&priv->title, title, FALSE);
+          g_mutex_unlock(&priv->item_lock);
 
-            if (error != NULL) {
-                g_warning("Unable to send signal for NewTitle: %s", error->message);
-                g_error_free(error);
-            }
-          }
-
-          if (oldtitle != NULL) {
-            g_free(oldtitle);
+          if (changed && priv->connection != NULL) {
+            emit_bus_signal (self, "NewTitle", NULL);
           }
 
           if (priv->status_icon != NULL) {
@@ -1018,35 +1826,33 @@ G_GNUC_END_IGNORE_DEPRECATIONS
           break;
         }
         case PROP_LABEL_GUIDE: {
-          gchar * oldguide = priv->label_guide;
-          priv->label_guide = g_value_dup_string(value);
-
-          if (priv->label_guide != NULL && priv->label_guide[0] == '\0') {
-            g_free(priv->label_guide);
-            priv->label_guide = NULL;
-          }
+          const gchar * guide = g_value_get_string(value);
+          gboolean changed;
 
-          if (g_strcmp0(oldguide, priv->label_guide) != 0) {
-            signal_label_change(APP_INDICATOR(object));
+          if (guide != NULL && guide[0] == '\0') {
+            guide = NULL;
           }
 
-          if (priv->label_guide != NULL && priv->label_guide[0] == '\0') {
-            g_free(priv->label_guide);
-            priv->label_guide = NULL;
-          }
+          g_mutex_lock(&priv->item_lock);
+          changed = replace_interned_string(&priv->label_guide, guide, FALSE);
+          g_mutex_unlock(&priv->item_lock);
 
-          if (oldguide != NULL) {
-            g_free(oldguide);
+          if (changed) {
+            signal_label_change(APP_INDICATOR(object));
           }
           break;
         }
         case PROP_ORDERING_INDEX:
+          g_mutex_lock(&priv->item_lock);
           priv->ordering_index = g_value_get_uint(value);
+          g_mutex_unlock(&priv->item_lock);
           break;
 
         case PROP_DBUS_MENU_SERVER:
+            g_mutex_lock(&priv->item_lock);
             g_clear_object (&priv->menuservice);
             priv->menuservice = DBUSMENU_SERVER (g_value_dup_object(value));
+            g_mutex_unlock(&priv->item_lock);
             break;
 
         case PROP_MENU:
@@ -1054,6 +1860,14 @@ G_GNUC_END_IGNORE_DEPRECATIONS
             priv->menu = GTK_WIDGET (g_value_dup_object(value));
             break;
 
+        case PROP_DBUS_CONTEXT:
+            priv->dbus_context = g_value_dup_boxed(value);
+            break;
+
+        case PROP_ITEM_IS_MENU:
+            app_indicator_set_item_is_menu(self, g_value_get_boolean(value));
+            break;
+
         default:
           G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
           break;
@@ -1076,12 +1890,12 @@ app_indicator_get_property (GObject * object, guint prop_id, GValue * value, GPa
           break;
 
         case PROP_CATEGORY:
-          enum_value = g_enum_get_value ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY), priv->category);
+          enum_value = g_enum_get_value (category_enum_class, priv->category);
           g_value_set_string (value, enum_value->value_nick);
           break;
 
         case PROP_STATUS:
-          enum_value = g_enum_get_value ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_STATUS), priv->status);
+          enum_value = g_enum_get_value (status_enum_class, priv->status);
           g_value_set_string (value, enum_value->value_nick);
           break;
 
@@ -1121,6 +1935,7 @@ app_indicator_get_property (GObject * object, guint prop_id, GValue * value, GPa
         }
 
         case PROP_LABEL:
+          label_provider_update (self);
           g_value_set_string (value, priv->label);
           break;
 
@@ -1137,6 +1952,7 @@ app_indicator_get_property (GObject * object, guint prop_id, GValue * value, GPa
             break;
 
         case PROP_TITLE:
+            title_provider_update(self);
             g_value_set_string(value, priv->title);
             break;
 
@@ -1144,6 +1960,14 @@ app_indicator_get_property (GObject * object, guint prop_id, GValue * value, GPa
             g_value_set_object(value, priv->menu);
             break;
 
+        case PROP_DBUS_CONTEXT:
+            g_value_set_boxed(value, priv->dbus_context);
+            break;
+
+        case PROP_ITEM_IS_MENU:
+            g_value_set_boolean(value, priv->item_is_menu);
+            break;
+
         default:
           G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
           break;
@@ -1163,6 +1987,11 @@ bus_creation (GObject * obj, GAsyncResult * res, gpointer user_data)
     if (error != NULL) {
         g_warning("Unable to get the session bus: %s", error->message);
         g_error_free(error);
+
+        /* Nothing will register the item, so the fallback is all there
+           is, and it finishes app_indicator_new_async() too */
+        start_fallback_timer(APP_INDICATOR(user_data), TRUE);
+
         g_object_unref(G_OBJECT(user_data));
         return;
     }
@@ -1180,39 +2009,63 @@ bus_creation (GObject * obj, GAsyncResult * res, gpointer user_data)
     return;
 }
 
+/* A method call that is run in the context of the indicator */
+typedef struct {
+    AppIndicator *          self;
+    gchar *                 sender;
+    gchar *                 method;
+    GVariant *              params;
+    GDBusMethodInvocation * invocation;
+    gint64                  start;
+} MethodCall;
+
 static void
-bus_method_call (GDBusConnection * connection, const gchar * sender,
-                 const gchar * path, const gchar * interface,
-                 const gchar * method, GVariant * params,
-                 GDBusMethodInvocation * invocation, gpointer user_data)
+method_call_free (gpointer data)
 {
-    g_return_if_fail(APP_IS_INDICATOR(user_data));
+    MethodCall * call = data;
 
-    AppIndicator * app = APP_INDICATOR(user_data);
+    g_object_unref(call->self);
+    g_free(call->sender);
+    g_free(call->method);
+    g_variant_unref(call->params);
+    g_free(call);
+
+    return;
+}
+
+/* Runs the methods that end up in GTK or in the application */
+static gboolean
+method_call_run (gpointer data)
+{
+    MethodCall * call = data;
+    AppIndicator * app = call->self;
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
-    GVariant * retval = NULL;
+    guint64 * latency = NULL;
 
-    if (g_strcmp0(method, "Scroll") == 0) {
-        GdkScrollDirection direction;
-        gint delta;
-        const gchar *orientation;
+    if (g_strcmp0(call->method, "Activate") == 0) {
+        gint x, y;
 
-        g_variant_get(params, "(i&s)", &delta, &orientation);
+        g_variant_get(call->params, "(ii)", &x, &y);
+        g_signal_emit(app, signals[ACTIVATE], 0, x, y);
 
-        if (g_strcmp0(orientation, "horizontal") == 0) {
-            direction = (delta >= 0) ? GDK_SCROLL_RIGHT : GDK_SCROLL_LEFT;
-        } else if (g_strcmp0(orientation, "vertical") == 0) {
-            direction = (delta >= 0) ? GDK_SCROLL_DOWN : GDK_SCROLL_UP;
-        } else {
-            g_dbus_method_invocation_return_value(invocation, retval);
-            return;
-        }
+    } else if (g_strcmp0(call->method, "XAyatanaOpenPeerChannel") == 0) {
+        /* Answers on its own */
+        peer_channel_open(app, call->sender, call->invocation);
+        return G_SOURCE_REMOVE;
+
+    } else if (g_strcmp0(call->method, "XAyatanaGetStatePage") == 0) {
+        /* Answers on its own */
+        state_page_get(app, call->invocation);
+        return G_SOURCE_REMOVE;
 
-        delta = ABS(delta);
-        g_signal_emit(app, signals[SCROLL_EVENT], 0, delta, direction);
+    } else if (g_strcmp0(call->method, "XAyatanaAnimateIcon") == 0) {
+        gboolean host_driven;
 
-    } else if (g_strcmp0(method, "SecondaryActivate") == 0 ||
-               g_strcmp0(method, "XAyatanaSecondaryActivate") == 0) {
+        g_variant_get(call->params, "(b)", &host_driven);
+        icon_animation_set_host_driven(app, call->sender, host_driven);
+
+    } else if (g_strcmp0(call->method, "SecondaryActivate") == 0 ||
+               g_strcmp0(call->method, "XAyatanaSecondaryActivate") == 0) {
         GtkWidget *menuitem = priv->sec_activate_target;
 
         if (priv->sec_activate_enabled && menuitem &&
@@ -1221,17 +2074,247 @@ bus_method_call (GDBusConnection * connection, const gchar * sender,
         {
             gtk_widget_activate (menuitem);
         }
+
+        latency = priv->stats.secondary_activate_latency;
+    } else {
+        g_warning("Calling method '%s' on the app-indicator and it's unknown", call->method);
+    }
+
+    if (latency != NULL) {
+        g_mutex_lock(&priv->item_lock);
+        stats_record_latency(latency, call->start);
+        g_mutex_unlock(&priv->item_lock);
+    }
+
+    g_dbus_method_invocation_return_value(call->invocation, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Sends the scrolling of the last frame to the application */
+static gboolean
+scroll_flush (gpointer user_data)
+{
+    AppIndicator * self = g_object_ref(APP_INDICATOR(user_data));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    gint horizontal, vertical;
+    gint64 start;
+
+    g_mutex_lock(&priv->item_lock);
+    horizontal = priv->scroll_delta[GTK_ORIENTATION_HORIZONTAL];
+    vertical = priv->scroll_delta[GTK_ORIENTATION_VERTICAL];
+    priv->scroll_delta[GTK_ORIENTATION_HORIZONTAL] = 0;
+    priv->scroll_delta[GTK_ORIENTATION_VERTICAL] = 0;
+    start = priv->scroll_start;
+    g_clear_pointer(&priv->scroll_source, g_source_unref);
+    g_mutex_unlock(&priv->item_lock);
+
+    if (horizontal != 0) {
+        g_signal_emit(self, signals[SCROLL_EVENT], 0, ABS(horizontal),
+                      horizontal > 0 ? GDK_SCROLL_RIGHT : GDK_SCROLL_LEFT);
+        g_signal_emit(self, signals[SMOOTH_SCROLL], 0, horizontal, GTK_ORIENTATION_HORIZONTAL);
+    }
+
+    if (vertical != 0) {
+        g_signal_emit(self, signals[SCROLL_EVENT], 0, ABS(vertical),
+                      vertical > 0 ? GDK_SCROLL_DOWN : GDK_SCROLL_UP);
+        g_signal_emit(self, signals[SMOOTH_SCROLL], 0, vertical, GTK_ORIENTATION_VERTICAL);
+    }
+
+    g_mutex_lock(&priv->item_lock);
+    stats_record_latency(priv->stats.scroll_latency, start);
+    g_mutex_unlock(&priv->item_lock);
+
+    g_object_unref(self);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Adds a Scroll call to the current frame, which starts with the
+   first call after the last flush */
+static void
+scroll_queue (AppIndicator * self, GVariant * params)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GtkOrientation orientation;
+    const gchar * name;
+    gint delta;
+
+    g_variant_get(params, "(i&s)", &delta, &name);
+
+    if (g_strcmp0(name, "horizontal") == 0) {
+        orientation = GTK_ORIENTATION_HORIZONTAL;
+    } else if (g_strcmp0(name, "vertical") == 0) {
+        orientation = GTK_ORIENTATION_VERTICAL;
+    } else {
+        return;
+    }
+
+    g_mutex_lock(&priv->item_lock);
+
+    priv->scroll_delta[orientation] += delta;
+
+    if (priv->scroll_source == NULL) {
+        priv->scroll_start = g_get_monotonic_time();
+        priv->scroll_source = g_timeout_source_new(SCROLL_FRAME_INTERVAL);
+        g_source_set_name(priv->scroll_source, "AppIndicator scroll");
+        g_source_set_callback(priv->scroll_source, scroll_flush, self, NULL);
+        g_source_attach(priv->scroll_source, priv->context);
+    }
+
+    g_mutex_unlock(&priv->item_lock);
+
+    return;
+}
+
+/* The object is registered with a weak reference, the handlers can
+   run in the D-Bus context while the indicator goes away */
+static void
+bus_weak_ref_free (gpointer data)
+{
+    g_weak_ref_clear(data);
+    g_free(data);
+
+    return;
+}
+
+static gboolean
+bus_release_cb (gpointer user_data)
+{
+    return G_SOURCE_REMOVE;
+}
+
+/* Drops the reference a handler took, the last one has to go in the
+   context of the indicator so that it is disposed of there */
+static void
+bus_release (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (in_owner_context(self)) {
+        g_object_unref(self);
+    } else {
+        release_in_owner_context(self, bus_release_cb);
+    }
+
+    return;
+}
+
+static void
+bus_method_call (GDBusConnection * connection, const gchar * sender,
+                 const gchar * path, const gchar * interface,
+                 const gchar * method, GVariant * params,
+                 GDBusMethodInvocation * invocation, gpointer user_data)
+{
+    AppIndicator * app = g_weak_ref_get(user_data);
+
+    if (app == NULL) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                              "The indicator is gone");
+        return;
+    }
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
+    MethodCall * call;
+
+    APP_INDICATOR_TRACE_BEGIN (method_call, method);
+
+    g_mutex_lock(&priv->item_lock);
+    STATS_ADD(priv->stats.method_calls, 1);
+    g_mutex_unlock(&priv->item_lock);
+
+    /* The host doesn't wait for the handlers of the scrolling */
+    if (g_strcmp0(method, "Scroll") == 0) {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        scroll_queue(app, params);
+
+        APP_INDICATOR_TRACE_END (method_call, method);
+        bus_release(app);
+        return;
+    }
+
+    if (g_strcmp0(method, "XAyatanaGetStats") == 0) {
+        if (!g_atomic_int_get(&priv->stats_enabled)) {
+            g_dbus_method_invocation_return_dbus_error(invocation,
+                                                       "org.freedesktop.DBus.Error.AccessDenied",
+                                                       "Statistics are not enabled for this indicator");
+        } else {
+            g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{sv})", stats_to_variant(app)));
+        }
+
+        APP_INDICATOR_TRACE_END (method_call, method);
+        bus_release(app);
+        return;
+    }
+
+    call = g_new0(MethodCall, 1);
+    call->self = app;
+    call->sender = g_strdup(sender);
+    call->method = g_strdup(method);
+    call->params = g_variant_ref(params);
+    call->invocation = invocation;
+    call->start = g_get_monotonic_time();
+
+    /* The rest may touch GTK, that only happens in the context
+       the indicator was made in */
+    if (in_owner_context(app)) {
+        method_call_run(call);
+        method_call_free(call);
     } else {
-        g_warning("Calling method '%s' on the app-indicator and it's unknown", method);
+        g_main_context_invoke_full(priv->context, G_PRIORITY_DEFAULT, method_call_run, call, method_call_free);
     }
 
-    g_dbus_method_invocation_return_value(invocation, retval);
+    APP_INDICATOR_TRACE_END (method_call, method);
 }
 
 /* DBus is asking for a property so we should figure out what it
    wants and try and deliver. */
 static GVariant *
 bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar * path, const gchar * interface, const gchar * property, GError ** error, gpointer user_data)
+{
+    AppIndicator * app = g_weak_ref_get(user_data);
+    GVariant * value;
+
+    if (app == NULL) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT, "The indicator is gone");
+        return NULL;
+    }
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
+
+    g_mutex_lock(&priv->item_lock);
+    STATS_ADD(priv->stats.property_gets, 1);
+    g_mutex_unlock(&priv->item_lock);
+
+    consumer_learn(app, sender);
+
+    APP_INDICATOR_TRACE_BEGIN (get_prop, property);
+
+    /* The providers are application code, they run without the lock */
+    if (g_strcmp0(property, "Title") == 0) {
+        title_provider_update(app);
+    } else if (g_strcmp0(property, "XAyatanaLabel") == 0) {
+        label_provider_update(app);
+    }
+
+    if (g_strcmp0(property, "ToolTip") == 0) {
+        value = get_tooltip(app);
+    } else {
+        /* The setters change the exported fields under the same lock */
+        g_mutex_lock(&priv->item_lock);
+        value = get_prop (property, error, app);
+        g_mutex_unlock(&priv->item_lock);
+    }
+
+    APP_INDICATOR_TRACE_END (get_prop, property);
+
+    bus_release(app);
+
+    return value;
+}
+
+static GVariant *
+get_prop (const gchar * property, GError ** error, gpointer user_data)
 {
     g_return_val_if_fail(APP_IS_INDICATOR(user_data), NULL);
     AppIndicator * app = APP_INDICATOR(user_data);
@@ -1241,17 +2324,15 @@ bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar *
         return g_variant_new_string(priv->id ? priv->id : "");
     } else if (g_strcmp0(property, "Category") == 0) {
         GEnumValue *enum_value;
-        enum_value = g_enum_get_value ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY), priv->category);
+        enum_value = g_enum_get_value (category_enum_class, priv->category);
         return g_variant_new_string(enum_value->value_nick ? enum_value->value_nick : "");
     } else if (g_strcmp0(property, "Status") == 0) {
         GEnumValue *enum_value;
-        enum_value = g_enum_get_value ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_STATUS), priv->status);
+        enum_value = g_enum_get_value (status_enum_class, priv->status);
         return g_variant_new_string(enum_value->value_nick ? enum_value->value_nick : "");
     } else if (g_strcmp0(property, "IconName") == 0) {
-        if (priv->absolute_icon_name) {
-            return g_variant_new_string(priv->absolute_icon_name);
-        }
-        return g_variant_new_string(priv->icon_name ? priv->icon_name : "");
+        const gchar * icon_name = get_current_icon(app, TRUE);
+        return g_variant_new_string(icon_name ? icon_name : "");
     } else if (g_strcmp0(property, "AttentionIconName") == 0) {
         if (priv->absolute_attention_icon_name) {
             return g_variant_new_string(priv->absolute_attention_icon_name);
@@ -1271,10 +2352,8 @@ bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar *
         }
         return g_variant_new_string(output);
     } else if (g_strcmp0(property, "IconThemePath") == 0) {
-        if (priv->absolute_icon_theme_path) {
-            return g_variant_new_string(priv->absolute_icon_theme_path);
-        }
-        return g_variant_new_string(priv->icon_theme_path ? priv->icon_theme_path : "");
+        const gchar * theme_path = get_host_theme_path(app);
+        return g_variant_new_string(theme_path ? theme_path : "");
     } else if (g_strcmp0(property, "Menu") == 0) {
         if (priv->menuservice != NULL) {
             GValue strval = { 0 };
@@ -1286,12 +2365,28 @@ bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar *
         } else {
             return g_variant_new("o", "/");
         }
+    } else if (g_strcmp0(property, "ItemIsMenu") == 0) {
+        return g_variant_new_boolean(priv->item_is_menu);
     } else if (g_strcmp0(property, "XAyatanaLabel") == 0) {
         return g_variant_new_string(priv->label ? priv->label : "");
     } else if (g_strcmp0(property, "XAyatanaLabelGuide") == 0) {
         return g_variant_new_string(priv->label_guide ? priv->label_guide : "");
     } else if (g_strcmp0(property, "XAyatanaOrderingIndex") == 0) {
         return g_variant_new_uint32(priv->ordering_index);
+    } else if (g_strcmp0(property, "XAyatanaIconAnimationFrames") == 0) {
+        GVariantBuilder builder;
+        guint i;
+
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_STRING_ARRAY);
+        for (i = 0; i < priv->icon_anim_n_frames; i++) {
+            const gchar * frame = priv->absolute_icon_anim_frames[i] ?
+                                    priv->absolute_icon_anim_frames[i] :
+                                    priv->icon_anim_frames[i];
+            g_variant_builder_add(&builder, "s", frame);
+        }
+        return g_variant_builder_end(&builder);
+    } else if (g_strcmp0(property, "XAyatanaIconAnimationInterval") == 0) {
+        return g_variant_new_uint32(priv->icon_anim_interval);
     } else if (g_strcmp0(property, "IconAccessibleDesc") == 0) {
         return g_variant_new_string(priv->accessible_desc ? priv->accessible_desc : "");
     } else if (g_strcmp0(property, "AttentionAccessibleDesc") == 0) {
@@ -1302,1091 +2397,4676 @@ bus_get_prop (GDBusConnection * connection, const gchar * sender, const gchar *
     return NULL;
 }
 
-/* Sends the label changed signal and resets the source ID */
-static gboolean
-signal_label_change_idle (gpointer user_data)
+static GVariant *
+tooltip_new (const gchar * icon_name, const gchar * title, const gchar * description)
 {
-    AppIndicator * self = (AppIndicator *)user_data;
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
-
-    gchar * label = priv->label != NULL ? priv->label : "";
-    gchar * guide = priv->label_guide != NULL ? priv->label_guide : "";
-
-    g_signal_emit(G_OBJECT(self), signals[NEW_LABEL], 0,
-                  label, guide);
-    if (priv->dbus_registration != 0 && priv->connection != NULL) {
-        GError * error = NULL;
+    return g_variant_ref_sink(g_variant_new("(s@a(iiay)ss)",
+                                            icon_name ? icon_name : "",
+                                            g_variant_new_array(G_VARIANT_TYPE("(iiay)"), NULL, 0),
+                                            title ? title : "",
+                                            description ? description : ""));
+}
 
-        g_dbus_connection_emit_signal(priv->connection,
-                                      NULL,
-                                      priv->path,
-                                      NOTIFICATION_ITEM_DBUS_IFACE,
-                                      "XAyatanaNewLabel",
-                                      g_variant_new("(ss)", label, guide),
-                                      &error);
+/* Takes over @data, which is freed right away without @func */
+static Provider *
+provider_new (GCallback func, gpointer data, GDestroyNotify destroy)
+{
+    Provider * provider;
 
-        if (error != NULL) {
-            g_warning("Unable to send signal for NewIcon: %s", error->message);
-            g_error_free(error);
+    if (func == NULL) {
+        if (destroy != NULL) {
+            destroy(data);
         }
+
+        return NULL;
     }
 
-    priv->label_change_idle = 0;
+    provider = g_new0(Provider, 1);
+    provider->ref_count = 1;
+    provider->func = func;
+    provider->data = data;
+    provider->destroy = destroy;
 
-    return FALSE;
+    return provider;
 }
 
-/* Sets up an idle function to send the label changed signal
-   so that we don't send it too many times. */
-static void
-signal_label_change (AppIndicator * self)
+static Provider *
+provider_ref (Provider * provider)
 {
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    g_atomic_int_inc(&provider->ref_count);
+    return provider;
+}
 
-    /* don't set it twice */
-    if (priv->label_change_idle != 0) {
+static void
+provider_unref (Provider * provider)
+{
+    if (!g_atomic_int_dec_and_test(&provider->ref_count)) {
         return;
     }
 
-    priv->label_change_idle = g_idle_add(signal_label_change_idle, self);
+    if (provider->destroy != NULL) {
+        provider->destroy(provider->data);
+    }
+
+    g_free(provider);
     return;
 }
 
-/* This function is used to see if we have enough information to
-   connect to things.  If we do, and we're not connected, it
-   connects for us. */
-static void
-check_connect (AppIndicator *self)
+/* Asks @provider for the tooltip in the owner context and keeps it,
+   unless it was invalidated again in the meantime */
+static GVariant *
+tooltip_make (AppIndicator * self, Provider * provider, guint serial)
 {
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GVariant * tooltip;
+    GVariant * old = NULL;
+    gchar * icon_name = NULL;
+    gchar * title = NULL;
+    gchar * description = NULL;
 
-    /* Do we have a connection? */
-    if (priv->connection == NULL) return;
+    ((AppIndicatorTooltipFunc) provider->func)(self, &icon_name, &title, &description, provider->data);
 
-    /* If we already have a proxy, let's see if it has someone
-       implementing it.  If not, we can't do much more than to
-       do nothing. */
-    if (priv->watcher_proxy != NULL) {
-        gchar * name = g_dbus_proxy_get_name_owner(priv->watcher_proxy);
-        if (name == NULL) {
-            return;
-        }
-        g_free(name);
+    tooltip = tooltip_new(icon_name, title, description);
+
+    g_free(icon_name);
+    g_free(title);
+    g_free(description);
+
+    g_mutex_lock(&priv->item_lock);
+    if (priv->tooltip_serial == serial) {
+        old = priv->tooltip;
+        priv->tooltip = g_variant_ref(tooltip);
+        priv->tooltip_dirty = FALSE;
     }
+    g_mutex_unlock(&priv->item_lock);
 
-    /* Do we have enough information? */
-    if (priv->menu == NULL) return;
-    if (priv->icon_name == NULL) return;
-    if (priv->id == NULL) return;
+    if (old != NULL) {
+        g_variant_unref(old);
+    }
 
-    if (priv->path == NULL) {
-        priv->path = g_strdup_printf(DEFAULT_ITEM_PATH "/%s", priv->clean_id);
+    return tooltip;
+}
+
+/* Makes the tooltip in the owner context, for a host that read the
+   old one in the D-Bus context */
+static gboolean
+tooltip_refresh (gpointer user_data)
+{
+    AppIndicator * self = APP_INDICATOR(user_data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    Provider * provider = NULL;
+    guint serial;
+
+    g_mutex_lock(&priv->item_lock);
+    if (priv->tooltip_dirty && priv->tooltip_provider != NULL) {
+        provider = provider_ref(priv->tooltip_provider);
     }
+    serial = priv->tooltip_serial;
+    g_mutex_unlock(&priv->item_lock);
 
-    if (priv->dbus_registration == 0) {
-        GError * error = NULL;
-        priv->dbus_registration = g_dbus_connection_register_object(priv->connection,
-                                                                    priv->path,
-                                                                    item_interface_info,
-                                                                    &item_interface_table,
-                                                                    self,
-                                                                    NULL,
-                                                                    &error);
-        if (error != NULL) {
-            g_warning("Unable to register object on path '%s': %s", priv->path, error->message);
-            g_error_free(error);
-            return;
-        }
+    /* Made for another host already */
+    if (provider == NULL) {
+        return G_SOURCE_REMOVE;
     }
 
-    /* NOTE: It's really important the order here.  We make sure to *publish*
-       the object on the bus and *then* get the proxy.  The reason is that we
-       want to ensure all the filters are setup before talking to the watcher
-       and that's where the order is important. */
+    g_variant_unref(tooltip_make(self, provider, serial));
+    provider_unref(provider);
 
-    if (priv->watcher_proxy == NULL)
-        return;
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal(self, "NewToolTip", NULL);
+    }
 
-    g_dbus_proxy_call (priv->watcher_proxy,
-                       "RegisterStatusNotifierItem",
-                       g_variant_new ("(s)", priv->path),
-                       G_DBUS_CALL_FLAGS_NONE,
-                       -1, NULL,
-                       (GAsyncReadyCallback) register_service_cb,
-                       (AppIndicator*)g_object_ref (self));
+    return G_SOURCE_REMOVE;
 }
 
-/* Responce from the DBus command to register a service
-   with a NotificationWatcher. */
-static void
-register_service_cb (GObject * obj, GAsyncResult * res, gpointer user_data)
+/* The ToolTip property.  A provider is only asked for it when a host
+   reads it after it was invalidated, the answer is kept until the next
+   invalidation.  The provider only runs in the owner context, a host
+   reading it elsewhere gets the last tooltip and is told again once
+   the new one is made. */
+static GVariant *
+get_tooltip (AppIndicator * self)
 {
-    GError * error = NULL;
-    GVariant * returns = g_dbus_proxy_call_finish(G_DBUS_PROXY(obj), res, &error);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    Provider * provider = NULL;
+    GVariant * tooltip = NULL;
+    guint serial;
 
-    /* We don't care about any return values */
-    if (returns != NULL) {
-        g_variant_unref(returns);
+    g_mutex_lock(&priv->item_lock);
+    if (priv->tooltip != NULL) {
+        tooltip = g_variant_ref(priv->tooltip);
+    }
+    if (priv->tooltip_dirty && priv->tooltip_provider != NULL) {
+        provider = provider_ref(priv->tooltip_provider);
+    }
+    serial = priv->tooltip_serial;
+    g_mutex_unlock(&priv->item_lock);
+
+    if (provider != NULL && in_owner_context(self)) {
+        g_clear_pointer(&tooltip, g_variant_unref);
+        tooltip = tooltip_make(self, provider, serial);
+    } else if (provider != NULL) {
+        g_main_context_invoke_full(priv->context, G_PRIORITY_DEFAULT, tooltip_refresh,
+                                   g_object_ref(self), g_object_unref);
     }
 
-    if (error != NULL) {
-        /* They didn't respond, ewww.  Not sure what they could
-           be doing */
-        g_warning("Unable to connect to the Notification Watcher: %s", error->message);
-        start_fallback_timer(APP_INDICATOR(user_data), TRUE);
-        g_object_unref(G_OBJECT(user_data));
-        return;
+    if (provider != NULL) {
+        provider_unref(provider);
     }
 
-    g_return_if_fail(APP_IS_INDICATOR(user_data));
-    AppIndicator * app = APP_INDICATOR(user_data);
-    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
+    if (tooltip == NULL) {
+        tooltip = tooltip_new(NULL, NULL, NULL);
+    }
 
-    /* Emit the AppIndicator::connection-changed signal*/
-    g_signal_emit (app, signals[CONNECTION_CHANGED], 0, TRUE);
+    return tooltip;
+}
 
-    if (priv->status_icon) {
-        AppIndicatorClass * class = APP_INDICATOR_GET_CLASS(app);
-        if (class->unfallback != NULL) {
-            class->unfallback(app, priv->status_icon);
-            priv->status_icon = NULL;
-        }
+/* Stops following a consumer, the value of the table */
+static void
+consumer_unwatch (gpointer data)
+{
+    guint watch = GPOINTER_TO_UINT(data);
+
+    if (watch != 0) {
+        g_bus_unwatch_name(watch);
     }
 
-    g_object_unref(G_OBJECT(user_data));
     return;
 }
 
-/* A helper function to get the nick out of a given
-   category enum value. */
-static const gchar *
-category_from_enum (AppIndicatorCategory category)
+static void
+consumer_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data)
 {
-  GEnumValue *value;
+    AppIndicator * self = APP_INDICATOR(user_data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-  value = g_enum_get_value ((GEnumClass *)g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY), category);
-  return value->value_nick;
+    g_mutex_lock(&priv->item_lock);
+    if (priv->signal_consumers != NULL) {
+        g_hash_table_remove(priv->signal_consumers, name);
+    }
+    g_mutex_unlock(&priv->item_lock);
+
+    icon_animation_hosts_changed(self);
+
+    return;
 }
 
-/* A function that will start the fallback timer if it's not
-   already started.  It sets up the DBus watcher to see if
-   there is a change.  Also, provides an override mode for cases
-   where it's unlikely that a timer will help anything. */
+/* Adds @name to the consumers, in the owner context.  The ones that
+   were learned are dropped again when they leave the bus. */
 static void
-start_fallback_timer (AppIndicator * self, gboolean disable_timeout)
+consumer_add (AppIndicator * self, const gchar * name, gboolean learned)
 {
-    g_return_if_fail(APP_IS_INDICATOR(self));
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint watch = 0;
 
-    if (priv->fallback_timer != 0) {
-        /* The timer is set, let's just be happy with the one
-           we've already got running */
+    if (priv->signal_consumers != NULL && g_hash_table_contains(priv->signal_consumers, name)) {
         return;
     }
 
-    if (priv->status_icon != NULL) {
-        /* We're already fallen back.  Let's not do it again. */
-        return;
+    if (learned) {
+        if (priv->connection == NULL) {
+            return;
+        }
+
+        watch = g_bus_watch_name_on_connection(priv->connection, name,
+                                               G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                               NULL, consumer_vanished,
+                                               self, NULL);
     }
 
-    if (disable_timeout) {
-        fallback_timer_expire(self);
-    } else {
-        priv->fallback_timer = g_timeout_add(DEFAULT_FALLBACK_TIMER, fallback_timer_expire, self);
+    g_mutex_lock(&priv->item_lock);
+    if (priv->signal_consumers == NULL) {
+        priv->signal_consumers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, consumer_unwatch);
     }
+    g_hash_table_insert(priv->signal_consumers, g_strdup(name), GUINT_TO_POINTER(watch));
+    g_mutex_unlock(&priv->item_lock);
+
+    icon_animation_hosts_changed(self);
 
     return;
 }
 
-/* A function that gets executed when we want to change the
-   state of the fallback. */
-static gboolean
-fallback_timer_expire (gpointer data)
+typedef struct {
+    AppIndicator * self;
+    gchar * name;
+} ConsumerLearn;
+
+static void
+consumer_learn_free (gpointer data)
 {
-    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
+    ConsumerLearn * learn = data;
 
-        AppIndicator * app = APP_INDICATOR(data);
-    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
-    AppIndicatorClass * class = APP_INDICATOR_GET_CLASS(data);
+    g_object_unref(learn->self);
+    g_free(learn->name);
+    g_free(learn);
 
-    if (priv->status_icon == NULL) {
-        if (class->fallback != NULL) {
-            priv->status_icon = class->fallback(APP_INDICATOR(data));
-        }
-    } else {
-        if (class->unfallback != NULL) {
-            class->unfallback(APP_INDICATOR(data), priv->status_icon);
-            priv->status_icon = NULL;
-        } else {
-            g_warning("No 'unfallback' function but the 'fallback' function returned a non-NULL result.");
-        }
+    return;
+}
+
+static gboolean
+consumer_learn_cb (gpointer data)
+{
+    ConsumerLearn * learn = data;
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(learn->self);
+
+    if (priv->unicast_signals) {
+        consumer_add(learn->self, learn->name, TRUE);
     }
 
-    priv->fallback_timer = 0;
-    return FALSE;
+    return G_SOURCE_REMOVE;
 }
 
-/* emit a NEW_ICON signal in response for the theme change */
+/* Whoever reads our properties shows the indicator somewhere and
+   wants its signals, can be called from the D-Bus context */
 static void
-theme_changed_cb (GtkIconTheme * theme, gpointer user_data)
+consumer_learn (AppIndicator * self, const gchar * sender)
 {
-    g_signal_emit (user_data, signals[NEW_ICON], 0);
-
-    AppIndicator * self = (AppIndicator *)user_data;
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    ConsumerLearn * learn;
+    gboolean known;
 
-    if (priv->dbus_registration != 0 && priv->connection != NULL) {
-        GError * error = NULL;
+    /* Peer-to-peer connections have no names */
+    if (sender == NULL) {
+        return;
+    }
 
-        g_dbus_connection_emit_signal(priv->connection,
-                                      NULL,
-                                      priv->path,
-                                      NOTIFICATION_ITEM_DBUS_IFACE,
-                                      "NewIcon",
-                                      NULL,
-                                      &error);
+    g_mutex_lock(&priv->item_lock);
+    known = !priv->unicast_signals ||
+            (priv->signal_consumers != NULL && g_hash_table_contains(priv->signal_consumers, sender));
+    g_mutex_unlock(&priv->item_lock);
 
-        if (error != NULL) {
-            g_warning("Unable to send signal for NewIcon: %s", error->message);
-            g_error_free(error);
-        }
+    if (known) {
+        return;
     }
 
+    learn = g_new0(ConsumerLearn, 1);
+    learn->self = g_object_ref(self);
+    learn->name = g_strdup(sender);
+
+    g_main_context_invoke_full(priv->context, G_PRIORITY_DEFAULT, consumer_learn_cb, learn, consumer_learn_free);
+
     return;
 }
 
-/* Creates a StatusIcon that can be used when the application
-   indicator area isn't available. */
-static GtkStatusIcon *
-fallback (AppIndicator * self)
+/* Sends one signal to @destination, or to everybody on @connection if
+   it is %NULL */
+static void
+emit_bus_signal_to (AppIndicator * self, GDBusConnection * connection, const gchar * destination,
+                    const gchar * name, GVariant * params)
 {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-    GtkStatusIcon * icon = gtk_status_icon_new();
-    gtk_status_icon_set_name(icon, app_indicator_get_id(self));
-G_GNUC_END_IGNORE_DEPRECATIONS
-    const gchar * title = app_indicator_get_title(self);
-    if (title != NULL) {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-        gtk_status_icon_set_title(icon, title);
-G_GNUC_END_IGNORE_DEPRECATIONS
-    }
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GError * error = NULL;
 
-    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_STATUS,
-        G_CALLBACK(status_icon_status_wrapper), icon);
-    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_ICON,
-        G_CALLBACK(status_icon_changes), icon);
-    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_ATTENTION_ICON,
-        G_CALLBACK(status_icon_changes), icon);
+    STATS_ADD(priv->stats.signals_emitted, 1);
+    STATS_ADD(priv->stats.bytes_sent, strlen(name) + (params != NULL ? g_variant_get_size(params) : 0));
 
-    status_icon_changes(self, icon);
+    g_dbus_connection_emit_signal(connection,
+                                  destination,
+                                  priv->path,
+                                  NOTIFICATION_ITEM_DBUS_IFACE,
+                                  name,
+                                  params,
+                                  &error);
 
-    g_signal_connect(G_OBJECT(icon), "activate", G_CALLBACK(status_icon_activate), self);
-    g_signal_connect(G_OBJECT(icon), "popup-menu", G_CALLBACK(status_icon_menu_activate), self);
-    g_signal_connect(G_OBJECT(icon), "scroll-event", G_CALLBACK(scroll_event_wrapper), self);
-    g_signal_connect(G_OBJECT(icon), "button-release-event", G_CALLBACK(middle_click_wrapper), self);
+    if (error != NULL) {
+        g_warning("Unable to send signal for %s: %s", name, error->message);
+        g_error_free(error);
+    }
 
-    return icon;
+    return;
 }
 
-/* A wrapper as the status update prototype is a little
-   bit different, but we want to handle it the same. */
+/* Sends @name on the item's object path, @params is consumed if it
+   is floating */
 static void
-status_icon_status_wrapper (AppIndicator * self, const gchar * status, gpointer data)
+emit_bus_signal (AppIndicator * self, const gchar * name, GVariant * params)
 {
-    return status_icon_changes(self, data);
-}
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    gboolean peers_open = FALSE;
 
-/* A wrapper for redirecting the scroll events to the app-indicator from status
-   icon widget. */
-static gboolean
-scroll_event_wrapper (GtkWidget *status_icon, GdkEventScroll *event, gpointer data)
-{
-    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
-    AppIndicator * app = APP_INDICATOR(data);
-    g_signal_emit(app, signals[SCROLL_EVENT], 0, 1, event->direction);
+    APP_INDICATOR_TRACE (emit_signal, name);
 
-    return TRUE;
-}
+    if (params != NULL) {
+        g_variant_ref_sink(params);
+    }
 
-static gboolean
-middle_click_wrapper (GtkWidget *status_icon, GdkEventButton *event, gpointer data)
-{
-    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
-    AppIndicator * app = APP_INDICATOR(data);
-    AppIndicatorPrivate *priv = app_indicator_get_instance_private(app);
+    /* Hosts reading the page have it changed before they are woken up */
+    state_page_update(self, name, params);
 
-    if (event->button == 2 && event->type == GDK_BUTTON_RELEASE) {
-        GtkAllocation alloc;
-        gint px = event->x;
-        gint py = event->y;
-        gtk_widget_get_allocation (status_icon, &alloc);
-        GtkWidget *menuitem = priv->sec_activate_target;
+    /* The hosts with a connection of their own don't wait for the bus */
+    if (priv->peers != NULL) {
+        guint i;
 
-        if (px >= 0 && px < alloc.width && py >= 0 && py < alloc.height &&
-            priv->sec_activate_enabled && menuitem &&
-            gtk_widget_get_visible (menuitem) &&
-            gtk_widget_get_sensitive (menuitem))
-        {
-            gtk_widget_activate (menuitem);
-            return TRUE;
+        for (i = 0; i < priv->peers->len; i++) {
+            PeerChannel * peer = g_ptr_array_index(priv->peers, i);
+
+            if (peer->connection != NULL) {
+                emit_bus_signal_to(self, peer->connection, NULL, name, params);
+                peers_open = TRUE;
+            }
         }
     }
 
-    return FALSE;
+    /* Nobody would get it, signal_resync() catches up once a host
+       appears */
+    if (!g_atomic_int_get(&watcher_host_registered)) {
+        priv->bus_signals_dropped = TRUE;
+        STATS_ADD(priv->stats.signals_suppressed, 1);
+
+        if (params != NULL) {
+            g_variant_unref(params);
+        }
+        return;
+    }
+
+    /* Only the consumers get it once there are some, the bus doesn't
+       have to match it against the rules of every other client.  A
+       host with a peer channel is one, so a broadcast would reach it
+       twice; peer channels are only opened with unicast signals. */
+    if (priv->unicast_signals && (peers_open || (priv->signal_consumers != NULL &&
+                                                 g_hash_table_size(priv->signal_consumers) > 0))) {
+        GHashTableIter iter;
+        gpointer destination;
+
+        if (priv->signal_consumers != NULL) {
+            g_hash_table_iter_init(&iter, priv->signal_consumers);
+            while (g_hash_table_iter_next(&iter, &destination, NULL)) {
+                if (peer_channel_find(self, destination) == NULL) {
+                    emit_bus_signal_to(self, priv->connection, destination, name, params);
+                }
+            }
+        }
+    } else {
+        emit_bus_signal_to(self, priv->connection, NULL, name, params);
+    }
+
+    if (params != NULL) {
+        g_variant_unref(params);
+    }
+
+    return;
 }
 
-/* This tracks changes to either the status or the icons
-   that are associated with the app indicator */
-static void
-status_icon_changes (AppIndicator * self, gpointer data)
+/* Sends the signals for everything a host shows, for when signals
+   were dropped while there was no host */
+static gboolean
+signal_resync (gpointer user_data)
 {
-    GtkStatusIcon * icon = GTK_STATUS_ICON(data);
+    AppIndicator * self = APP_INDICATOR(user_data);
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GError * error = NULL;
+    GVariant * status;
+    GVariant * theme_path;
+    GVariant * label;
+    GVariant * animation = NULL;
 
-    /* add the icon_theme_path once if needed */
-    GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-    const gchar *theme_path = priv->absolute_icon_theme_path ?
-                                priv->absolute_icon_theme_path :
-                                priv->icon_theme_path;
+    if (!priv->bus_signals_dropped || priv->dbus_registration == 0 || priv->connection == NULL) {
+        return G_SOURCE_REMOVE;
+    }
 
-    if (theme_path != NULL) {
-        gchar **path;
-        gint n_elements, i;
-        gboolean found=FALSE;
-        gtk_icon_theme_get_search_path(icon_theme, &path, &n_elements);
-        if (path != NULL) {
-            for (i=0; i< n_elements; i++) {
-                if(g_strcmp0(path[i], theme_path) == 0) {
-                    found=TRUE;
-                    break;
-                }
-            }
-            g_strfreev (path);
-        }
-        if(!found) {
-            gtk_icon_theme_append_search_path(icon_theme, theme_path);
-        }
+    priv->bus_signals_dropped = FALSE;
+    label_provider_update(self);
+    title_provider_update(self);
+
+    /* Setters in other threads change the exported fields under the
+       lock, the signals go out without it */
+    g_mutex_lock(&priv->item_lock);
+    status = g_variant_ref_sink(g_variant_new("(@s)", get_prop("Status", &error, self)));
+    theme_path = g_variant_ref_sink(g_variant_new("(@s)", get_prop("IconThemePath", &error, self)));
+    label = g_variant_ref_sink(g_variant_new("(@s@s)",
+                                             get_prop("XAyatanaLabel", &error, self),
+                                             get_prop("XAyatanaLabelGuide", &error, self)));
+
+    if (priv->icon_anim_n_frames > 0) {
+        animation = g_variant_ref_sink(g_variant_new("(@asu)",
+                                                     get_prop("XAyatanaIconAnimationFrames", &error, self),
+                                                     priv->icon_anim_interval));
+    }
+    g_mutex_unlock(&priv->item_lock);
+
+    emit_bus_signal(self, "NewStatus", status);
+    emit_bus_signal(self, "NewIcon", NULL);
+    emit_bus_signal(self, "NewAttentionIcon", NULL);
+    emit_bus_signal(self, "NewIconThemePath", theme_path);
+    emit_bus_signal(self, "XAyatanaNewLabel", label);
+    emit_bus_signal(self, "NewTitle", NULL);
+    emit_bus_signal(self, "NewToolTip", NULL);
+
+    if (animation != NULL) {
+        emit_bus_signal(self, "XAyatanaNewIconAnimation", animation);
+        g_variant_unref(animation);
     }
 
-    const gchar * icon_name = NULL;
-    switch (app_indicator_get_status(self)) {
-    case APP_INDICATOR_STATUS_PASSIVE:
-        /* hide first to avoid that the change is visible to the user */
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-        gtk_status_icon_set_visible(icon, FALSE);
-G_GNUC_END_IGNORE_DEPRECATIONS
-        icon_name = app_indicator_get_icon(self);
-        break;
-    case APP_INDICATOR_STATUS_ACTIVE:
-        icon_name = app_indicator_get_icon(self);
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-        gtk_status_icon_set_visible(icon, TRUE);
-G_GNUC_END_IGNORE_DEPRECATIONS
-        break;
-    case APP_INDICATOR_STATUS_ATTENTION:
-        /* get the _attention_ icon here */
-        icon_name = app_indicator_get_attention_icon(self);
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-        gtk_status_icon_set_visible(icon, TRUE);
-G_GNUC_END_IGNORE_DEPRECATIONS
-        break;
-    };
+    g_variant_unref(status);
+    g_variant_unref(theme_path);
+    g_variant_unref(label);
 
-    if (icon_name != NULL) {
-        gchar *snapped_icon = append_snap_prefix(icon_name);
+    return G_SOURCE_REMOVE;
+}
 
-        if (g_file_test(icon_name, G_FILE_TEST_EXISTS)) {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-            gtk_status_icon_set_from_file(icon, icon_name);
-G_GNUC_END_IGNORE_DEPRECATIONS
-        } else if (snapped_icon && g_file_test(snapped_icon, G_FILE_TEST_EXISTS)) {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-            gtk_status_icon_set_from_file(icon, snapped_icon);
-G_GNUC_END_IGNORE_DEPRECATIONS
-        } else {
-            gchar *longname = append_panel_icon_suffix(icon_name);
+/* Sends the label changed signal and resets the source ID */
+static gboolean
+signal_label_change_idle (gpointer user_data)
+{
+    AppIndicator * self = (AppIndicator *)user_data;
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
 
-            if (longname != NULL && gtk_icon_theme_has_icon (icon_theme, longname)) {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-                gtk_status_icon_set_from_icon_name(icon, longname);
-G_GNUC_END_IGNORE_DEPRECATIONS
-            } else {
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-                gtk_status_icon_set_from_icon_name(icon, icon_name);
-G_GNUC_END_IGNORE_DEPRECATIONS
-            }
+    /* The label of a template or a provider is only made here,
+       however many times it changed since the last time */
+    if (priv->label_template != NULL &&
+        g_atomic_int_compare_and_exchange(&priv->label_value_pending, TRUE, FALSE)) {
+        label_template_format(self);
+    }
 
-            g_free(longname);
-        }
+    label_provider_update(self);
+
+    const gchar * label = priv->label != NULL ? priv->label : "";
+    const gchar * guide = priv->label_guide != NULL ? priv->label_guide : "";
+
+    g_signal_emit(G_OBJECT(self), signals[NEW_LABEL], 0,
+                  label, guide);
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal (self, "XAyatanaNewLabel", g_variant_new("(ss)", label, guide));
+    }
+
+    priv->label_change_idle = 0;
+
+    return FALSE;
+}
+
+/* Replaces the label with the template filled in with the last value */
+static void
+label_template_format (AppIndicator * self)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    guint64 bits = __atomic_load_n(&priv->label_value, __ATOMIC_ACQUIRE);
+    gdouble value;
+    gchar * label;
+    gchar * oldlabel;
+
+    memcpy(&value, &bits, sizeof(value));
+    label = g_strdup_printf(priv->label_template, value);
+
+    g_mutex_lock(&priv->item_lock);
+    oldlabel = priv->label;
+    priv->label = label;
+    g_mutex_unlock(&priv->item_lock);
+
+    g_free(oldlabel);
+
+    return;
+}
 
-        g_free(snapped_icon);
+/* Replaces the function of @provider, the new one is asked right
+   away the next time the text is needed */
+static void
+text_provider_set (AppIndicator * self, TextProvider * provider, AppIndicatorTextFunc func, gpointer data, GDestroyNotify destroy)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    Provider * new_provider = provider_new(G_CALLBACK(func), data, destroy);
+    Provider * old;
+
+    g_mutex_lock(&priv->item_lock);
+    old = provider->provider;
+    provider->provider = new_provider;
+    g_mutex_unlock(&priv->item_lock);
+
+    g_atomic_int_set(&provider->dirty, new_provider != NULL);
+
+    if (old != NULL) {
+        provider_unref(old);
     }
 
     return;
 }
 
-/* Handles the activate action by the status icon by showing
-   the menu in a popup. */
+/* Asks @provider for the text when it changed since the last time,
+   returns FALSE when there is nothing new */
+static gboolean
+text_provider_run (AppIndicator * self, TextProvider * provider, gchar ** text)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    Provider * current = NULL;
+
+    g_mutex_lock(&priv->item_lock);
+    if (provider->provider != NULL) {
+        current = provider_ref(provider->provider);
+    }
+    g_mutex_unlock(&priv->item_lock);
+
+    if (current == NULL) {
+        return FALSE;
+    }
+
+    if (!g_atomic_int_compare_and_exchange(&provider->dirty, TRUE, FALSE)) {
+        provider_unref(current);
+        return FALSE;
+    }
+
+    *text = ((AppIndicatorTextFunc) current->func)(self, current->data);
+    provider_unref(current);
+
+    if (*text != NULL && (*text)[0] == '\0') {
+        g_free(*text);
+        *text = NULL;
+    }
+
+    return TRUE;
+}
+
+/* The label and the title are only written in the owner context, where
+   they are read without the lock.  Elsewhere the label is left to the
+   label change that is on its way, see app_indicator_invalidate_label(). */
 static void
-status_icon_activate (GtkStatusIcon * icon, gpointer data)
+label_provider_update (AppIndicator * self)
 {
-    GtkMenu * menu = app_indicator_get_menu(APP_INDICATOR(data));
-    if (menu == NULL)
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    gchar * label = NULL;
+    gchar * oldlabel;
+
+    if (!in_owner_context(self) || !text_provider_run(self, &priv->label_provider, &label)) {
         return;
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-    gtk_menu_popup(menu,
-                   NULL, /* Parent Menu */
-                   NULL, /* Parent item */
-                   gtk_status_icon_position_menu,
-                   icon,
-                   1, /* Button */
-                   gtk_get_current_event_time());
-G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+
+    g_mutex_lock(&priv->item_lock);
+    oldlabel = priv->label;
+    priv->label = label;
+    g_mutex_unlock(&priv->item_lock);
+
+    g_free(oldlabel);
+
     return;
 }
 
-/* Handles the right-click action by the status icon by showing
-   the menu in a popup. */
+/* Makes the title in the owner context, for a host that read the old
+   one in the D-Bus context */
+static gboolean
+title_provider_refresh (gpointer user_data)
+{
+    AppIndicator * self = APP_INDICATOR(user_data);
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    if (title_provider_update(self) && priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal(self, "NewTitle", NULL);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Returns whether there is a new title */
+static gboolean
+title_provider_update (AppIndicator * self)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    gchar * title = NULL;
+
+    if (!in_owner_context(self)) {
+        if (g_atomic_int_get(&priv->title_provider.dirty)) {
+            g_main_context_invoke_full(priv->context, G_PRIORITY_DEFAULT, title_provider_refresh,
+                                       g_object_ref(self), g_object_unref);
+        }
+
+        return FALSE;
+    }
+
+    if (!text_provider_run(self, &priv->title_provider, &title)) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&priv->item_lock);
+    replace_interned_string(&priv->title, title, FALSE);
+    g_mutex_unlock(&priv->item_lock);
+
+    g_free(title);
+
+    return TRUE;
+}
+
+/* Sets up an idle function to send the label changed signal
+   so that we don't send it too many times. */
 static void
-status_icon_menu_activate (GtkStatusIcon *status_icon, guint button, guint activate_time, gpointer user_data)
+signal_label_change (AppIndicator * self)
 {
-    status_icon_activate(status_icon, user_data);
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    /* don't set it twice */
+    if (priv->label_change_idle != 0) {
+        STATS_ADD(priv->stats.signals_coalesced, 1);
+        return;
+    }
+
+    priv->label_change_idle = g_idle_add(signal_label_change_idle, self);
+    return;
 }
 
-/* Removes the status icon as the application indicator area
-   is now up and running again. */
+/* GDBus calls the handlers in the thread default context of whoever
+   registers the object, @context is pushed when it isn't NULL */
+static guint
+register_object (AppIndicator * self, GDBusConnection * connection, GMainContext * context, GError ** error)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GWeakRef * ref = g_new0(GWeakRef, 1);
+    guint id;
+
+    g_weak_ref_init(ref, self);
+
+    if (context != NULL) {
+        g_main_context_push_thread_default(context);
+    }
+
+    id = g_dbus_connection_register_object(connection,
+                                           priv->path,
+                                           item_interface_info,
+                                           &item_interface_table,
+                                           ref,
+                                           bus_weak_ref_free,
+                                           error);
+
+    if (context != NULL) {
+        g_main_context_pop_thread_default(context);
+    }
+
+    return id;
+}
+
+/* Puts the item's object on @connection, served from the D-Bus
+   context, when that can be done from here: there is no D-Bus context
+   or nobody else runs it.  Returns FALSE otherwise, without waiting for
+   the thread that runs it, see item_register_async(). */
+static gboolean
+item_register (AppIndicator * self, GDBusConnection * connection, guint * id, GError ** error)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    if (priv->dbus_context == NULL) {
+        *id = register_object(self, connection, NULL, error);
+        return TRUE;
+    }
+
+    if (g_main_context_acquire(priv->dbus_context)) {
+        *id = register_object(self, connection, priv->dbus_context, error);
+        g_main_context_release(priv->dbus_context);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* A registration done by the thread that runs the D-Bus context, on
+   behalf of the owner context */
+typedef struct {
+    GWeakRef              self;
+    GDBusConnection *     connection;
+    GMainContext *        dbus_context;
+    GMainContext *        owner;
+    guint                 id;
+    GError *              error;
+} Registration;
+
 static void
-unfallback (AppIndicator * self, GtkStatusIcon * status_icon)
+registration_free (Registration * reg)
 {
-    g_signal_handlers_disconnect_by_func(G_OBJECT(self), status_icon_status_wrapper, status_icon);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(self), status_icon_changes, status_icon);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(self), scroll_event_wrapper, status_icon);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(self), middle_click_wrapper, status_icon);
-G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-    gtk_status_icon_set_visible(status_icon, FALSE);
-G_GNUC_END_IGNORE_DEPRECATIONS
-    g_object_unref(G_OBJECT(status_icon));
+    g_weak_ref_clear(&reg->self);
+    g_object_unref(reg->connection);
+    g_main_context_unref(reg->dbus_context);
+    g_main_context_unref(reg->owner);
+    g_clear_error(&reg->error);
+    g_free(reg);
     return;
 }
 
-/* A helper function that appends PANEL_ICON_SUFFIX to the given icon name
-   if it's missing. */
-static gchar *
-append_panel_icon_suffix (const gchar *icon_name)
+/* Back in the owner context, where check_connect() carries on */
+static gboolean
+item_register_done (gpointer data)
 {
-    gchar * long_name = NULL;
+    Registration * reg = data;
+    AppIndicator * self = g_weak_ref_get(&reg->self);
+    AppIndicatorPrivate * priv;
 
-    if (!g_str_has_suffix (icon_name, PANEL_ICON_SUFFIX)) {
-        long_name =
-            g_strdup_printf("%s-%s", icon_name, PANEL_ICON_SUFFIX);
-        } else {
-            long_name = g_strdup (icon_name);
+    if (self == NULL) {
+        if (reg->id != 0) {
+            g_dbus_connection_unregister_object(reg->connection, reg->id);
         }
 
-    return long_name;
+        registration_free(reg);
+        return G_SOURCE_REMOVE;
+    }
+
+    priv = app_indicator_get_instance_private(self);
+    priv->dbus_registering = FALSE;
+
+    /* Disposed of while this was on its way */
+    if (priv->connection != reg->connection || priv->disposed_in_bulk) {
+        if (reg->id != 0) {
+            g_dbus_connection_unregister_object(reg->connection, reg->id);
+        }
+    } else if (reg->error != NULL) {
+        g_warning("Unable to register object on path '%s': %s", priv->path, reg->error->message);
+    } else {
+        priv->dbus_registration = reg->id;
+        check_connect(self);
+    }
+
+    g_object_unref(self);
+    registration_free(reg);
+
+    return G_SOURCE_REMOVE;
 }
 
 static gboolean
-widget_is_menu_child(AppIndicator * self, GtkWidget *child)
+item_register_in_dbus_context (gpointer data)
+{
+    Registration * reg = data;
+    AppIndicator * self = g_weak_ref_get(&reg->self);
+
+    if (self != NULL) {
+        reg->id = register_object(self, reg->connection, reg->dbus_context, &reg->error);
+        g_object_unref(self);
+    }
+
+    g_main_context_invoke(reg->owner, item_register_done, reg);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Has the thread that runs the D-Bus context register the object, and
+   calls check_connect() again once it has */
+static void
+item_register_async (AppIndicator * self, GDBusConnection * connection)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+    Registration * reg = g_new0(Registration, 1);
+
+    g_weak_ref_init(&reg->self, self);
+    reg->connection = g_object_ref(connection);
+    reg->dbus_context = g_main_context_ref(priv->dbus_context);
+    reg->owner = g_main_context_ref(priv->context);
+
+    priv->dbus_registering = TRUE;
+    g_main_context_invoke(priv->dbus_context, item_register_in_dbus_context, reg);
+
+    return;
+}
+
+static void
+peer_channel_free (gpointer data)
+{
+    PeerChannel * peer = data;
+
+    if (peer->timeout != NULL) {
+        g_source_destroy(peer->timeout);
+        g_source_unref(peer->timeout);
+    }
+
+    if (peer->server != NULL) {
+        g_signal_handlers_disconnect_by_data(peer->server, peer);
+        g_dbus_server_stop(peer->server);
+        g_object_unref(peer->server);
+    }
+
+    if (peer->connection != NULL) {
+        g_signal_handlers_disconnect_by_data(peer->connection, peer);
+
+        if (peer->registration != 0) {
+            g_dbus_connection_unregister_object(peer->connection, peer->registration);
+        }
+
+        g_dbus_connection_close(peer->connection, NULL, NULL, NULL);
+        g_object_unref(peer->connection);
+    }
+
+    g_weak_ref_clear(&peer->self);
+    g_free(peer->sender);
+    g_free(peer);
+
+    g_atomic_int_add(&peer_channels, -1);
+
+    return;
+}
+
+/* The channel of @sender that it didn't connect to yet, if any */
+static PeerChannel *
+peer_channel_find_pending (AppIndicator * self, const gchar * sender)
 {
-    g_return_val_if_fail(APP_IS_INDICATOR(self), FALSE);
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint i;
 
-    if (!priv->menu) return FALSE;
-    if (!child) return FALSE;
+    if (priv->peers == NULL) {
+        return NULL;
+    }
 
-    GtkWidget *parent;
+    for (i = 0; i < priv->peers->len; i++) {
+        PeerChannel * peer = g_ptr_array_index(priv->peers, i);
 
-    while ((parent = gtk_widget_get_parent(child))) {
-        if (parent == priv->menu)
-            return TRUE;
+        if (peer->connection == NULL && g_strcmp0(peer->sender, sender) == 0) {
+            return peer;
+        }
+    }
 
-        if (GTK_IS_MENU(parent))
-            child = gtk_menu_get_attach_widget(GTK_MENU(parent));
-        else
-            child = parent;
+    return NULL;
+}
+
+/* The open channel of @sender, if it has one */
+static PeerChannel *
+peer_channel_find (AppIndicator * self, const gchar * sender)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint i;
+
+    if (priv->peers == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < priv->peers->len; i++) {
+        PeerChannel * peer = g_ptr_array_index(priv->peers, i);
+
+        if (peer->connection != NULL && g_strcmp0(peer->sender, sender) == 0) {
+            return peer;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+peer_channel_closed (GDBusConnection * connection, gboolean remote_peer_vanished, GError * error, gpointer user_data)
+{
+    PeerChannel * peer = user_data;
+    AppIndicator * self = g_weak_ref_get(&peer->self);
+
+    if (self == NULL) {
+        return;
+    }
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_ptr_array_remove_fast(priv->peers, peer);
+    g_object_unref(self);
+
+    return;
+}
+
+/* The host never came */
+static gboolean
+peer_channel_expired (gpointer user_data)
+{
+    PeerChannel * peer = user_data;
+    AppIndicator * self = g_weak_ref_get(&peer->self);
+
+    g_clear_pointer(&peer->timeout, g_source_unref);
+
+    if (self == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_ptr_array_remove_fast(priv->peers, peer);
+    g_object_unref(self);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Only the user's own processes, like on the session bus */
+static gboolean
+peer_channel_authorize (GDBusAuthObserver * observer, GIOStream * stream, GCredentials * credentials, gpointer user_data)
+{
+    return credentials != NULL && g_credentials_get_unix_user(credentials, NULL) == getuid();
+}
+
+/* GDBusServer holds the messages back until this returns, so the
+   object is there before the host's first call */
+static gboolean
+peer_channel_new_connection (GDBusServer * server, GDBusConnection * connection, gpointer user_data)
+{
+    PeerChannel * peer = user_data;
+    AppIndicator * self;
+    GError * error = NULL;
+
+    if (peer->connection != NULL) {
+        return FALSE;
+    }
+
+    self = g_weak_ref_get(&peer->self);
+
+    if (self == NULL) {
+        return FALSE;
+    }
+
+    /* The first call of the host can't wait for the thread that runs
+       the D-Bus context, so the channel is served from here then */
+    if (!item_register(self, connection, &peer->registration, &error)) {
+        peer->registration = register_object(self, connection, NULL, &error);
+    }
+
+    g_object_unref(self);
+
+    if (error != NULL) {
+        g_warning("Unable to register object on the peer channel of '%s': %s", peer->sender, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    peer->connection = g_object_ref(connection);
+    g_signal_connect(connection, "closed", G_CALLBACK(peer_channel_closed), peer);
+
+    /* Nobody else gets to connect */
+    g_dbus_server_stop(server);
+
+    if (peer->timeout != NULL) {
+        g_source_destroy(peer->timeout);
+        g_clear_pointer(&peer->timeout, g_source_unref);
+    }
+
+    return TRUE;
+}
+
+/* XAyatanaOpenPeerChannel, in the owner context.  Starts a server
+   for the host to connect to and answers with its address. */
+static void
+peer_channel_open (AppIndicator * self, const gchar * sender, GDBusMethodInvocation * invocation)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GDBusAuthObserver * observer;
+    PeerChannel * peer;
+    GError * error = NULL;
+    gchar * address;
+    gchar * guid;
+
+    if (!priv->peer_channels_enabled || sender == NULL) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.freedesktop.DBus.Error.AccessDenied",
+                                                   "Peer channels are not enabled for this indicator");
+        return;
+    }
+
+    /* The host would get every signal from the bus as well */
+    if (!priv->unicast_signals) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.freedesktop.DBus.Error.AccessDenied",
+                                                   "Peer channels need unicast signals for this indicator");
+        return;
+    }
+
+    /* Asking again before connecting gets the same server, with more
+       time to connect to it */
+    peer = peer_channel_find_pending(self, sender);
+
+    if (peer != NULL) {
+        g_source_set_ready_time(peer->timeout, g_get_monotonic_time() + PEER_CHANNEL_TIMEOUT * G_USEC_PER_SEC);
+        g_dbus_method_invocation_return_value(invocation,
+                                              g_variant_new("(s)", g_dbus_server_get_client_address(peer->server)));
+        return;
+    }
+
+    if (g_atomic_int_add(&peer_channels, 1) >= PEER_CHANNEL_MAX) {
+        g_atomic_int_add(&peer_channels, -1);
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                              "There are too many peer channels");
+        return;
+    }
+
+    /* Counted from here, peer_channel_free() takes it off */
+    peer = g_new0(PeerChannel, 1);
+    g_weak_ref_init(&peer->self, self);
+    peer->sender = g_strdup(sender);
+
+    guid = g_dbus_generate_guid();
+    address = g_strdup_printf("unix:tmpdir=%s", g_get_user_runtime_dir());
+    observer = g_dbus_auth_observer_new();
+    g_signal_connect(observer, "authorize-authenticated-peer", G_CALLBACK(peer_channel_authorize), NULL);
+
+    peer->server = g_dbus_server_new_sync(address, G_DBUS_SERVER_FLAGS_NONE, guid, observer, NULL, &error);
+
+    g_object_unref(observer);
+    g_free(address);
+    g_free(guid);
+
+    if (peer->server == NULL) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        peer_channel_free(peer);
+        return;
+    }
+
+    g_signal_connect(peer->server, "new-connection", G_CALLBACK(peer_channel_new_connection), peer);
+    g_dbus_server_start(peer->server);
+
+    peer->timeout = g_timeout_source_new_seconds(PEER_CHANNEL_TIMEOUT);
+    g_source_set_callback(peer->timeout, peer_channel_expired, peer, NULL);
+    g_source_attach(peer->timeout, priv->context);
+
+    if (priv->peers == NULL) {
+        priv->peers = g_ptr_array_new_with_free_func(peer_channel_free);
+    }
+    g_ptr_array_add(priv->peers, peer);
+
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(s)", g_dbus_server_get_client_address(peer->server)));
+
+    return;
+}
+
+/* The generations on the state page and the signals they count */
+static const struct {
+    const gchar * signal;
+    glong offset;
+} state_page_generations[] = {
+    { "NewIcon",                  G_STRUCT_OFFSET(NotificationItemStatePage, icon_generation) },
+    { "NewAttentionIcon",         G_STRUCT_OFFSET(NotificationItemStatePage, attention_icon_generation) },
+    { "NewIconThemePath",         G_STRUCT_OFFSET(NotificationItemStatePage, icon_theme_path_generation) },
+    { "XAyatanaNewIconAnimation", G_STRUCT_OFFSET(NotificationItemStatePage, icon_animation_generation) },
+    { "NewTitle",                 G_STRUCT_OFFSET(NotificationItemStatePage, title_generation) },
+    { "NewToolTip",               G_STRUCT_OFFSET(NotificationItemStatePage, tooltip_generation) },
+    { "XAyatanaNewLabel",         G_STRUCT_OFFSET(NotificationItemStatePage, label_generation) }
+};
+
+/* Readers retry from here until state_page_write_end(), there is only
+   ever one writer as the item lock is held */
+static void
+state_page_write_begin (NotificationItemStatePage * page)
+{
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return;
+}
+
+static void
+state_page_write_end (NotificationItemStatePage * page)
+{
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELEASE);
+
+    return;
+}
+
+/* Cuts @label short on a character boundary if it doesn't fit */
+static void
+state_page_set_label (NotificationItemStatePage * page, const gchar * label)
+{
+    gsize length = label != NULL ? strlen(label) : 0;
+
+    if (length >= NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE) {
+        length = NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE - 1;
+
+        while (length > 0 && (label[length] & 0xc0) == 0x80) {
+            length--;
+        }
+    }
+
+    if (length > 0) {
+        memcpy(page->label, label, length);
+    }
+    memset(page->label + length, 0, NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE - length);
+
+    return;
+}
+
+/* Brings the page up to date with the fields and counts @signal, which
+   is sent on the bus right after.  Never called with the item lock
+   held. */
+static void
+state_page_update (AppIndicator * self, const gchar * signal, GVariant * params)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    NotificationItemStatePage * page = priv->state_page;
+    const gchar * label = NULL;
+    guint i;
+
+    if (page == NULL) {
+        return;
+    }
+
+    if (g_strcmp0(signal, "XAyatanaNewLabel") == 0 && params != NULL) {
+        g_variant_get_child(params, 0, "&s", &label);
+    }
+
+    g_mutex_lock(&priv->item_lock);
+    state_page_write_begin(page);
+
+    page->status = priv->status;
+    page->ordering_index = priv->ordering_index;
+
+    for (i = 0; signal != NULL && i < G_N_ELEMENTS(state_page_generations); i++) {
+        if (g_strcmp0(signal, state_page_generations[i].signal) == 0) {
+            G_STRUCT_MEMBER(guint32, page, state_page_generations[i].offset)++;
+            break;
+        }
+    }
+
+    if (label != NULL) {
+        state_page_set_label(page, label);
+    }
+
+    state_page_write_end(page);
+    g_mutex_unlock(&priv->item_lock);
+
+    return;
+}
+
+/* Makes the memfd with the page and seals it, so that hosts can map
+   it safely and, with newer kernels, only for reading */
+static gboolean
+state_page_create (AppIndicator * self, GError ** error)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    NotificationItemStatePage * page;
+    gboolean write_sealed = FALSE;
+    gint fd;
+
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("ayatana-appindicator-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    fd = -1;
+    errno = ENOSYS;
+#endif
+
+    if (fd < 0 || ftruncate(fd, NOTIFICATION_ITEM_STATE_PAGE_SIZE) < 0) {
+        gint saved_errno = errno;
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Unable to make the state page: %s", g_strerror(saved_errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return FALSE;
+    }
+
+    page = mmap(NULL, NOTIFICATION_ITEM_STATE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (page == MAP_FAILED) {
+        gint saved_errno = errno;
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Unable to map the state page: %s", g_strerror(saved_errno));
+        close(fd);
+        return FALSE;
+    }
+
+#ifdef F_ADD_SEALS
+    {
+        gint seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+#ifdef F_SEAL_FUTURE_WRITE
+        /* Older kernels don't know this one */
+        if (fcntl(fd, F_ADD_SEALS, seals | F_SEAL_FUTURE_WRITE) == 0) {
+            write_sealed = TRUE;
+            seals = 0;
+        }
+#endif
+        if (seals != 0) {
+            fcntl(fd, F_ADD_SEALS, seals);
+        }
+    }
+#endif
+
+    /* Without the seal the hosts get a descriptor that can only read,
+       our mapping is all that writes to the page */
+    if (!write_sealed) {
+        gchar * proc_path = g_strdup_printf("/proc/self/fd/%d", fd);
+        gint readonly_fd = open(proc_path, O_RDONLY | O_CLOEXEC);
+        gint saved_errno = errno;
+
+        g_free(proc_path);
+        close(fd);
+
+        if (readonly_fd < 0) {
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                        "Unable to make the state page read-only: %s", g_strerror(saved_errno));
+            munmap(page, NOTIFICATION_ITEM_STATE_PAGE_SIZE);
+            return FALSE;
+        }
+
+        fd = readonly_fd;
+    }
+
+    /* Nobody has it yet, no need for the sequence */
+    page->magic = NOTIFICATION_ITEM_STATE_PAGE_MAGIC;
+    page->version = NOTIFICATION_ITEM_STATE_PAGE_VERSION;
+    page->size = sizeof(NotificationItemStatePage);
+
+    g_mutex_lock(&priv->item_lock);
+    page->status = priv->status;
+    page->ordering_index = priv->ordering_index;
+    state_page_set_label(page, priv->label);
+    g_mutex_unlock(&priv->item_lock);
+
+    priv->state_page_fd = fd;
+    priv->state_page = page;
+
+    return TRUE;
+}
+
+/* Tells the readers that the page isn't written anymore and lets go
+   of it, their mappings stay */
+static void
+state_page_close (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    NotificationItemStatePage * page = priv->state_page;
+
+    if (page == NULL) {
+        return;
+    }
+
+    g_mutex_lock(&priv->item_lock);
+    state_page_write_begin(page);
+    page->flags |= NOTIFICATION_ITEM_STATE_PAGE_CLOSED;
+    state_page_write_end(page);
+    priv->state_page = NULL;
+    g_mutex_unlock(&priv->item_lock);
+
+    munmap(page, NOTIFICATION_ITEM_STATE_PAGE_SIZE);
+    close(priv->state_page_fd);
+    priv->state_page_fd = -1;
+
+    return;
+}
+
+/* XAyatanaGetStatePage, in the owner context.  The page is made for
+   the first host that asks and shared with the ones after it. */
+static void
+state_page_get (AppIndicator * self, GDBusMethodInvocation * invocation)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GDBusConnection * connection = g_dbus_method_invocation_get_connection(invocation);
+    GUnixFDList * fds;
+    GError * error = NULL;
+    gint index;
+
+    if (!priv->state_page_enabled) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.freedesktop.DBus.Error.AccessDenied",
+                                                   "The state page is not enabled for this indicator");
+        return;
+    }
+
+    if (!(g_dbus_connection_get_capabilities(connection) & G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.freedesktop.DBus.Error.NotSupported",
+                                                   "The connection can't pass file descriptors");
+        return;
+    }
+
+    if (priv->state_page == NULL && !state_page_create(self, &error)) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+        return;
+    }
+
+    fds = g_unix_fd_list_new();
+    index = g_unix_fd_list_append(fds, priv->state_page_fd, &error);
+
+    if (index < 0) {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        g_error_free(error);
+    } else {
+        g_dbus_method_invocation_return_value_with_unix_fd_list(invocation, g_variant_new("(h)", index), fds);
+    }
+
+    g_object_unref(fds);
+
+    return;
+}
+
+/* This function is used to see if we have enough information to
+   connect to things.  If we do, and we're not connected, it
+   connects for us. */
+static void
+check_connect (AppIndicator *self)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    APP_INDICATOR_TRACE (check_connect, priv->id);
+
+    /* Do we have a connection? */
+    if (priv->connection == NULL) return;
+
+    /* If we already have a proxy, let's see if it has someone
+       implementing it.  If not, we can't do much more than to
+       do nothing. */
+    if (priv->watcher_proxy != NULL) {
+        gchar * name = g_dbus_proxy_get_name_owner(priv->watcher_proxy);
+        if (name == NULL) {
+            return;
+        }
+        g_free(name);
+    }
+
+    /* Do we have enough information? */
+    if (priv->menu == NULL && priv->item_is_menu) return;
+    if (priv->icon_name == NULL && priv->icon_anim_frames == NULL) return;
+    if (priv->id == NULL) return;
+
+    if (priv->dbus_registration == 0) {
+        GError * error = NULL;
+
+        /* check_connect() runs again once that is done */
+        if (priv->dbus_registering) {
+            return;
+        }
+
+        if (!item_register(self, priv->connection, &priv->dbus_registration, &error)) {
+            item_register_async(self, priv->connection);
+            return;
+        }
+
+        if (error != NULL) {
+            g_warning("Unable to register object on path '%s': %s", priv->path, error->message);
+            g_error_free(error);
+            return;
+        }
+    }
+
+    /* NOTE: It's really important the order here.  We make sure to *publish*
+       the object on the bus and *then* get the proxy.  The reason is that we
+       want to ensure all the filters are setup before talking to the watcher
+       and that's where the order is important. */
+
+    if (priv->watcher_proxy == NULL)
+        return;
+
+    g_dbus_proxy_call (priv->watcher_proxy,
+                       "RegisterStatusNotifierItem",
+                       g_variant_new ("(s)", priv->path),
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1, NULL,
+                       (GAsyncReadyCallback) register_service_cb,
+                       (AppIndicator*)g_object_ref (self));
+}
+
+/* Responce from the DBus command to register a service
+   with a NotificationWatcher. */
+static void
+register_service_cb (GObject * obj, GAsyncResult * res, gpointer user_data)
+{
+    GError * error = NULL;
+    GVariant * returns = g_dbus_proxy_call_finish(G_DBUS_PROXY(obj), res, &error);
+
+    /* We don't care about any return values */
+    if (returns != NULL) {
+        g_variant_unref(returns);
+    }
+
+    if (error != NULL) {
+        /* They didn't respond, ewww.  Not sure what they could
+           be doing */
+        g_warning("Unable to connect to the Notification Watcher: %s", error->message);
+        APP_INDICATOR_TRACE (register_service_failed, error->message);
+        start_fallback_timer(APP_INDICATOR(user_data), TRUE);
+        g_object_unref(G_OBJECT(user_data));
+        return;
+    }
+
+    g_return_if_fail(APP_IS_INDICATOR(user_data));
+    AppIndicator * app = APP_INDICATOR(user_data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
+
+    APP_INDICATOR_TRACE (register_service, priv->id);
+    STATS_ADD(priv->stats.registrations, 1);
+
+    /* Emit the AppIndicator::connection-changed signal*/
+    g_signal_emit (app, signals[CONNECTION_CHANGED], 0, TRUE);
+
+    if (priv->status_icon) {
+        AppIndicatorClass * class = APP_INDICATOR_GET_CLASS(app);
+        if (class->unfallback != NULL) {
+            APP_INDICATOR_TRACE (unfallback, priv->id);
+            STATS_ADD(priv->stats.unfallbacks, 1);
+            class->unfallback(app, priv->status_icon);
+            priv->status_icon = NULL;
+        }
+    }
+
+    new_task_complete(app, NULL);
+
+    g_object_unref(G_OBJECT(user_data));
+    return;
+}
+
+/* A helper function to get the nick out of a given
+   category enum value. */
+static const gchar *
+category_from_enum (AppIndicatorCategory category)
+{
+  GEnumValue *value;
+
+  value = g_enum_get_value ((GEnumClass *)g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_CATEGORY), category);
+  return value->value_nick;
+}
+
+/* A function that will start the fallback timer if it's not
+   already started.  It sets up the DBus watcher to see if
+   there is a change.  Also, provides an override mode for cases
+   where it's unlikely that a timer will help anything. */
+static void
+start_fallback_timer (AppIndicator * self, gboolean disable_timeout)
+{
+    g_return_if_fail(APP_IS_INDICATOR(self));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (priv->fallback_timer != 0) {
+        /* The timer is set, let's just be happy with the one
+           we've already got running */
+        return;
+    }
+
+    if (priv->status_icon != NULL) {
+        /* We're already fallen back.  Let's not do it again. */
+        return;
+    }
+
+    if (disable_timeout) {
+        fallback_timer_expire(self);
+    } else {
+        priv->fallback_timer = g_timeout_add(DEFAULT_FALLBACK_TIMER, fallback_timer_expire, self);
+    }
+
+    return;
+}
+
+/* A function that gets executed when we want to change the
+   state of the fallback. */
+static gboolean
+fallback_timer_expire (gpointer data)
+{
+    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
+
+        AppIndicator * app = APP_INDICATOR(data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(app);
+    AppIndicatorClass * class = APP_INDICATOR_GET_CLASS(data);
+
+    if (priv->status_icon == NULL) {
+        if (class->fallback != NULL) {
+            APP_INDICATOR_TRACE (fallback, priv->id);
+            STATS_ADD(priv->stats.fallbacks, 1);
+            priv->status_icon = class->fallback(APP_INDICATOR(data));
+        }
+
+        if (priv->status_icon != NULL) {
+            new_task_complete(app, NULL);
+        } else {
+            new_task_complete(app, g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+                                                       "There is no StatusNotifierWatcher and no fallback"));
+        }
+    } else {
+        if (class->unfallback != NULL) {
+            APP_INDICATOR_TRACE (unfallback, priv->id);
+            STATS_ADD(priv->stats.unfallbacks, 1);
+            class->unfallback(APP_INDICATOR(data), priv->status_icon);
+            priv->status_icon = NULL;
+        } else {
+            g_warning("No 'unfallback' function but the 'fallback' function returned a non-NULL result.");
+        }
+    }
+
+    priv->fallback_timer = 0;
+    return FALSE;
+}
+
+/* Emits the NEW_ICON signal and tells the bus about it */
+static void
+signal_new_icon (AppIndicator * self)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    g_signal_emit (self, signals[NEW_ICON], 0);
+
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal (self, "NewIcon", NULL);
+    }
+
+    return;
+}
+
+/* Sends a single NEW_ICON to every indicator once the theme has
+   settled down */
+static gboolean
+theme_changed_timeout_cb (gpointer user_data)
+{
+    GList * l;
+
+    theme_changed_timeout = 0;
+
+    for (l = theme_indicators; l != NULL; l = l->next) {
+        signal_new_icon(APP_INDICATOR(l->data));
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* GTK sends a burst of these while a theme is switched or its
+   caches are rebuilt, so wait for them to stop.  But not for longer
+   than THEME_CHANGED_MAX_DELAY, a theme that keeps changing still
+   gets its icons refreshed. */
+static void
+theme_changed_cb (GtkIconTheme * theme, gpointer user_data)
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 left;
+
+    if (theme_changed_timeout == 0) {
+        theme_changed_since = now;
+    } else {
+        GList * l;
+
+        /* Every indicator was going to get a NEW_ICON already */
+        for (l = theme_indicators; l != NULL; l = l->next) {
+            AppIndicatorPrivate * priv = app_indicator_get_instance_private(APP_INDICATOR(l->data));
+            STATS_ADD(priv->stats.signals_coalesced, 1);
+        }
+
+        g_source_remove(theme_changed_timeout);
+    }
+
+    left = (theme_changed_since + THEME_CHANGED_MAX_DELAY * 1000 - now) / 1000;
+    theme_changed_timeout = g_timeout_add(CLAMP(left, 0, THEME_CHANGED_DELAY), theme_changed_timeout_cb, NULL);
+    return;
+}
+
+typedef struct {
+    guint      ref_count;
+    gchar      path[];
+} ThemeSearchPath;
+
+/* Adds @theme_path to the search path of the default icon theme,
+   unless it is there already */
+static void
+theme_search_path_ref (const gchar * theme_path)
+{
+    ThemeSearchPath * search_path;
+
+    if (theme_search_paths == NULL) {
+        theme_search_paths = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+
+    search_path = g_hash_table_lookup (theme_search_paths, theme_path);
+
+    if (search_path == NULL) {
+        GtkIconTheme * icon_theme = gtk_icon_theme_get_default ();
+        gchar ** path = NULL;
+        gint n_elements = 0;
+        gint i;
+        gboolean found = FALSE;
+        gsize len = strlen (theme_path);
+
+        search_path = g_malloc0 (sizeof (ThemeSearchPath) + len + 1);
+        memcpy (search_path->path, theme_path, len + 1);
+
+        /* Paths that were there before, ours or not, are left alone */
+        gtk_icon_theme_get_search_path (icon_theme, &path, &n_elements);
+
+        for (i = 0; path != NULL && i < n_elements; i++) {
+            if (g_strcmp0 (path[i], theme_path) == 0) {
+                found = TRUE;
+                break;
+            }
+        }
+
+        g_strfreev (path);
+
+        if (!found) {
+            gtk_icon_theme_append_search_path (icon_theme, theme_path);
+        }
+
+        g_hash_table_insert (theme_search_paths, search_path->path, search_path);
+    }
+
+    search_path->ref_count++;
+
+    return;
+}
+
+/* Forgets @theme_path once no indicator is using it.  It stays in the
+   search path, taking it out would change the theme and have every
+   indicator in the process send a new icon for nothing. */
+static void
+theme_search_path_unref (const gchar * theme_path)
+{
+    ThemeSearchPath * search_path = NULL;
+
+    if (theme_search_paths != NULL) {
+        search_path = g_hash_table_lookup (theme_search_paths, theme_path);
+    }
+
+    g_return_if_fail (search_path != NULL);
+
+    if (--search_path->ref_count > 0) {
+        return;
+    }
+
+    g_hash_table_remove (theme_search_paths, search_path->path);
+    g_free (search_path);
+
+    return;
+}
+
+/* Sets the theme path that the fallback icon looks up icons in */
+static void
+set_search_theme_path (AppIndicator * self, const gchar * theme_path)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (g_strcmp0 (priv->search_theme_path, theme_path) == 0) {
+        return;
+    }
+
+    if (theme_path != NULL) {
+        theme_search_path_ref (theme_path);
+    }
+
+    if (priv->search_theme_path != NULL) {
+        theme_search_path_unref (priv->search_theme_path);
+        unref_interned_string (priv->search_theme_path);
+    }
+
+    priv->search_theme_path = intern_string (theme_path, FALSE);
+
+    return;
+}
+
+/* Every indicator shares the handler on the default icon theme */
+static void
+theme_watch_add (AppIndicator * self)
+{
+    theme_indicators = g_list_prepend(theme_indicators, self);
+
+    if (theme_changed_handler == 0) {
+        theme_changed_handler = g_signal_connect(G_OBJECT(gtk_icon_theme_get_default()),
+            "changed", G_CALLBACK(theme_changed_cb), NULL);
+    }
+
+    return;
+}
+
+static void
+theme_watch_remove (AppIndicator * self)
+{
+    theme_indicators = g_list_remove(theme_indicators, self);
+
+    if (theme_indicators != NULL) {
+        return;
+    }
+
+    if (theme_changed_handler != 0) {
+        g_signal_handler_disconnect(gtk_icon_theme_get_default(), theme_changed_handler);
+        theme_changed_handler = 0;
+    }
+
+    if (theme_changed_timeout != 0) {
+        g_source_remove(theme_changed_timeout);
+        theme_changed_timeout = 0;
+    }
+
+    return;
+}
+
+/* The icon that should be shown right now, which is the current
+   frame if the icon is animated.  With @absolute the snap prefixed
+   path is returned for icons that are files. */
+static const gchar *
+get_current_icon (AppIndicator * self, gboolean absolute)
+{
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(self);
+
+    if (priv->icon_anim_frames != NULL) {
+        if (absolute && priv->absolute_icon_anim_frames[priv->icon_anim_frame] != NULL) {
+            return priv->absolute_icon_anim_frames[priv->icon_anim_frame];
+        }
+        return priv->icon_anim_frames[priv->icon_anim_frame];
+    }
+
+    if (absolute && priv->absolute_icon_name != NULL) {
+        return priv->absolute_icon_name;
+    }
+
+    return priv->icon_name;
+}
+
+/* Steps every animation that is due.  Animations only advance while the
+   indicator is active, nobody would see them otherwise. */
+static gboolean
+animation_timer_tick (gpointer user_data)
+{
+    gint64 now = g_get_monotonic_time();
+    GList * l = animated_indicators;
+
+    while (l != NULL) {
+        AppIndicator * self = APP_INDICATOR(l->data);
+        AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+        /* Handlers of the signal below may stop this animation */
+        l = l->next;
+
+        if (priv->status != APP_INDICATOR_STATUS_ACTIVE || now < priv->icon_anim_next) {
+            continue;
+        }
+
+        g_mutex_lock(&priv->item_lock);
+        priv->icon_anim_frame = (priv->icon_anim_frame + 1) % priv->icon_anim_n_frames;
+        g_mutex_unlock(&priv->item_lock);
+        priv->icon_anim_next += (gint64)priv->icon_anim_interval * 1000;
+
+        /* Don't try to catch up after the main loop was blocked */
+        if (priv->icon_anim_next <= now) {
+            priv->icon_anim_next = now + (gint64)priv->icon_anim_interval * 1000;
+        }
+
+        signal_new_icon(self);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Makes the shared timer tick as often as the fastest animation
+   that we step, or removes it if there are none left. */
+static void
+animation_timer_update (void)
+{
+    GList * l;
+    guint interval = 0;
+
+    for (l = animated_indicators; l != NULL; l = l->next) {
+        AppIndicatorPrivate * priv = app_indicator_get_instance_private(APP_INDICATOR(l->data));
+
+        if (interval == 0 || priv->icon_anim_interval < interval) {
+            interval = priv->icon_anim_interval;
+        }
+    }
+
+    if (interval == animation_timer_interval) {
+        return;
+    }
+
+    if (animation_timer != 0) {
+        g_source_remove(animation_timer);
+        animation_timer = 0;
+    }
+
+    animation_timer_interval = interval;
+
+    if (interval != 0) {
+        animation_timer = g_timeout_add(interval, animation_timer_tick, NULL);
+    }
+
+    return;
+}
+
+/* Whether a host animates the frames on its own.  There is usually
+   a single host, so one that says so is enough to stop stepping. */
+static gboolean
+icon_animation_host_driven (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    return priv->icon_anim_hosts != NULL && g_hash_table_size(priv->icon_anim_hosts) > 0;
+}
+
+/* Starts stepping through the frames ourselves, unless a host has
+   told us that it animates them. */
+static void
+icon_animation_start (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (priv->icon_anim_frames == NULL || icon_animation_host_driven(self)) {
+        return;
+    }
+
+    if (g_list_find(animated_indicators, self) != NULL) {
+        return;
+    }
+
+    priv->icon_anim_next = g_get_monotonic_time() + (gint64)priv->icon_anim_interval * 1000;
+    animated_indicators = g_list_prepend(animated_indicators, self);
+    animation_timer_update();
+
+    return;
+}
+
+/* Stops stepping through the frames, the frames are kept */
+static void
+icon_animation_stop (AppIndicator * self)
+{
+    animated_indicators = g_list_remove(animated_indicators, self);
+    animation_timer_update();
+
+    return;
+}
+
+/* Frees the frames of the animation */
+static void
+icon_animation_free_frames (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint i;
+
+    g_mutex_lock(&priv->item_lock);
+
+    if (priv->absolute_icon_anim_frames != NULL) {
+        for (i = 0; i < priv->icon_anim_n_frames; i++) {
+            g_free(priv->absolute_icon_anim_frames[i]);
+        }
+        g_free(priv->absolute_icon_anim_frames);
+        priv->absolute_icon_anim_frames = NULL;
+    }
+
+    g_strfreev(priv->icon_anim_frames);
+    priv->icon_anim_frames = NULL;
+    priv->icon_anim_n_frames = 0;
+    priv->icon_anim_interval = 0;
+    priv->icon_anim_frame = 0;
+
+    g_mutex_unlock(&priv->item_lock);
+
+    return;
+}
+
+/* Drops the animation completely */
+static void
+icon_animation_clear (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    icon_animation_stop(self);
+    g_clear_pointer(&priv->icon_anim_hosts, g_hash_table_unref);
+    icon_animation_free_frames(self);
+
+    return;
+}
+
+/* Steps the frames or not after the hosts changed */
+static void
+icon_animation_hosts_changed (AppIndicator * self)
+{
+    if (icon_animation_host_driven(self)) {
+        icon_animation_stop(self);
+    } else {
+        icon_animation_start(self);
+    }
+
+    return;
+}
+
+/* A host that animated our icon has gone away */
+static void
+icon_animation_host_vanished (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+    icon_animation_set_host_driven(APP_INDICATOR(user_data), name, FALSE);
+    return;
+}
+
+/* A host tells us whether it animates the frames on its own.  We stop
+   stepping them while one of the hosts does, each one is remembered
+   until it drops off the bus. */
+static void
+icon_animation_set_host_driven (AppIndicator * self, const gchar * host, gboolean host_driven)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    /* Peer-to-peer connections have no names */
+    if (host == NULL) {
+        return;
+    }
+
+    if (host_driven) {
+        guint watch = 0;
+
+        if (priv->icon_anim_hosts != NULL && g_hash_table_contains(priv->icon_anim_hosts, host)) {
+            return;
+        }
+
+        if (priv->connection != NULL) {
+            watch = g_bus_watch_name_on_connection(priv->connection,
+                                                   host,
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   NULL,
+                                                   icon_animation_host_vanished,
+                                                   self, NULL);
+        }
+
+        if (priv->icon_anim_hosts == NULL) {
+            priv->icon_anim_hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, consumer_unwatch);
+        }
+        g_hash_table_insert(priv->icon_anim_hosts, g_strdup(host), GUINT_TO_POINTER(watch));
+    } else if (priv->icon_anim_hosts != NULL) {
+        g_hash_table_remove(priv->icon_anim_hosts, host);
+    }
+
+    icon_animation_hosts_changed(self);
+
+    return;
+}
+
+/* Creates a StatusIcon that can be used when the application
+   indicator area isn't available. */
+static GtkStatusIcon *
+fallback (AppIndicator * self)
+{
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GtkStatusIcon * icon = gtk_status_icon_new();
+    gtk_status_icon_set_name(icon, app_indicator_get_id(self));
+G_GNUC_END_IGNORE_DEPRECATIONS
+    const gchar * title = app_indicator_get_title(self);
+    if (title != NULL) {
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        gtk_status_icon_set_title(icon, title);
+G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+
+    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_STATUS,
+        G_CALLBACK(status_icon_status_wrapper), icon);
+    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_ICON,
+        G_CALLBACK(status_icon_changes), icon);
+    g_signal_connect(G_OBJECT(self), APP_INDICATOR_SIGNAL_NEW_ATTENTION_ICON,
+        G_CALLBACK(status_icon_changes), icon);
+
+    status_icon_changes(self, icon);
+
+    g_signal_connect(G_OBJECT(icon), "activate", G_CALLBACK(status_icon_activate), self);
+    g_signal_connect(G_OBJECT(icon), "popup-menu", G_CALLBACK(status_icon_menu_activate), self);
+    g_signal_connect(G_OBJECT(icon), "scroll-event", G_CALLBACK(scroll_event_wrapper), self);
+    g_signal_connect(G_OBJECT(icon), "button-release-event", G_CALLBACK(middle_click_wrapper), self);
+
+    return icon;
+}
+
+/* A wrapper as the status update prototype is a little
+   bit different, but we want to handle it the same. */
+static void
+status_icon_status_wrapper (AppIndicator * self, const gchar * status, gpointer data)
+{
+    return status_icon_changes(self, data);
+}
+
+/* A wrapper for redirecting the scroll events to the app-indicator from status
+   icon widget. */
+static gboolean
+scroll_event_wrapper (GtkWidget *status_icon, GdkEventScroll *event, gpointer data)
+{
+    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
+    AppIndicator * app = APP_INDICATOR(data);
+    g_signal_emit(app, signals[SCROLL_EVENT], 0, 1, event->direction);
+
+    return TRUE;
+}
+
+static gboolean
+middle_click_wrapper (GtkWidget *status_icon, GdkEventButton *event, gpointer data)
+{
+    g_return_val_if_fail(APP_IS_INDICATOR(data), FALSE);
+    AppIndicator * app = APP_INDICATOR(data);
+    AppIndicatorPrivate *priv = app_indicator_get_instance_private(app);
+
+    if (event->button == 2 && event->type == GDK_BUTTON_RELEASE) {
+        GtkAllocation alloc;
+        gint px = event->x;
+        gint py = event->y;
+        gtk_widget_get_allocation (status_icon, &alloc);
+        GtkWidget *menuitem = priv->sec_activate_target;
+
+        if (px >= 0 && px < alloc.width && py >= 0 && py < alloc.height &&
+            priv->sec_activate_enabled && menuitem &&
+            gtk_widget_get_visible (menuitem) &&
+            gtk_widget_get_sensitive (menuitem))
+        {
+            gtk_widget_activate (menuitem);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* This tracks changes to either the status or the icons
+   that are associated with the app indicator */
+static void
+status_icon_changes (AppIndicator * self, gpointer data)
+{
+    GtkStatusIcon * icon = GTK_STATUS_ICON(data);
+
+    /* add the icon_theme_path once if needed */
+    GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+    set_search_theme_path(self, get_host_theme_path(self));
+
+    const gchar * icon_name = NULL;
+    switch (app_indicator_get_status(self)) {
+    case APP_INDICATOR_STATUS_PASSIVE:
+        /* hide first to avoid that the change is visible to the user */
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        gtk_status_icon_set_visible(icon, FALSE);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        icon_name = get_current_icon(self, FALSE);
+        break;
+    case APP_INDICATOR_STATUS_ACTIVE:
+        icon_name = get_current_icon(self, FALSE);
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        gtk_status_icon_set_visible(icon, TRUE);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        break;
+    case APP_INDICATOR_STATUS_ATTENTION:
+        /* get the _attention_ icon here */
+        icon_name = app_indicator_get_attention_icon(self);
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        gtk_status_icon_set_visible(icon, TRUE);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        break;
+    };
+
+    if (icon_name != NULL) {
+        const gchar *snapped_icon = snap_path_ref(icon_name);
+
+        if (g_file_test(icon_name, G_FILE_TEST_EXISTS)) {
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+            gtk_status_icon_set_from_file(icon, icon_name);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        } else if (snapped_icon && g_file_test(snapped_icon, G_FILE_TEST_EXISTS)) {
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+            gtk_status_icon_set_from_file(icon, snapped_icon);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        } else {
+            gchar *longname = append_panel_icon_suffix(icon_name);
+
+            if (longname != NULL && gtk_icon_theme_has_icon (icon_theme, longname)) {
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+                gtk_status_icon_set_from_icon_name(icon, longname);
+G_GNUC_END_IGNORE_DEPRECATIONS
+            } else {
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+                gtk_status_icon_set_from_icon_name(icon, icon_name);
+G_GNUC_END_IGNORE_DEPRECATIONS
+            }
+
+            g_free(longname);
+        }
+
+        unref_interned_string(snapped_icon);
+    }
+
+    return;
+}
+
+/* Handles the activate action by the status icon by showing
+   the menu in a popup, or activating the indicator when it
+   isn't only a menu. */
+static void
+status_icon_activate (GtkStatusIcon * icon, gpointer data)
+{
+    AppIndicator * self = APP_INDICATOR(data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (!priv->item_is_menu) {
+        GdkRectangle area = { 0 };
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        gtk_status_icon_get_geometry(icon, NULL, &area, NULL);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        g_signal_emit(self, signals[ACTIVATE], 0, area.x + area.width / 2, area.y + area.height / 2);
+        return;
+    }
+
+    GtkMenu * menu = app_indicator_get_menu(self);
+    if (menu == NULL)
+        return;
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    gtk_menu_popup(menu,
+                   NULL, /* Parent Menu */
+                   NULL, /* Parent item */
+                   gtk_status_icon_position_menu,
+                   icon,
+                   1, /* Button */
+                   gtk_get_current_event_time());
+G_GNUC_END_IGNORE_DEPRECATIONS
+    return;
+}
+
+/* Handles the right-click action by the status icon by showing
+   the menu in a popup. */
+static void
+status_icon_menu_activate (GtkStatusIcon *status_icon, guint button, guint activate_time, gpointer user_data)
+{
+    status_icon_activate(status_icon, user_data);
+}
+
+/* Removes the status icon as the application indicator area
+   is now up and running again. */
+static void
+unfallback (AppIndicator * self, GtkStatusIcon * status_icon)
+{
+    g_signal_handlers_disconnect_by_func(G_OBJECT(self), status_icon_status_wrapper, status_icon);
+    g_signal_handlers_disconnect_by_func(G_OBJECT(self), status_icon_changes, status_icon);
+    g_signal_handlers_disconnect_by_func(G_OBJECT(self), scroll_event_wrapper, status_icon);
+    g_signal_handlers_disconnect_by_func(G_OBJECT(self), middle_click_wrapper, status_icon);
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    gtk_status_icon_set_visible(status_icon, FALSE);
+G_GNUC_END_IGNORE_DEPRECATIONS
+    g_object_unref(G_OBJECT(status_icon));
+    return;
+}
+
+/* A helper function that appends PANEL_ICON_SUFFIX to the given icon name
+   if it's missing. */
+static gchar *
+append_panel_icon_suffix (const gchar *icon_name)
+{
+    gchar * long_name = NULL;
+
+    if (!g_str_has_suffix (icon_name, PANEL_ICON_SUFFIX)) {
+        long_name =
+            g_strdup_printf("%s-%s", icon_name, PANEL_ICON_SUFFIX);
+        } else {
+            long_name = g_strdup (icon_name);
+        }
+
+    return long_name;
+}
+
+static gboolean
+widget_is_menu_child(AppIndicator * self, GtkWidget *child)
+{
+    g_return_val_if_fail(APP_IS_INDICATOR(self), FALSE);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (!priv->menu) return FALSE;
+    if (!child) return FALSE;
+
+    GtkWidget *parent;
+
+    while ((parent = gtk_widget_get_parent(child))) {
+        if (parent == priv->menu)
+            return TRUE;
+
+        if (GTK_IS_MENU(parent))
+            child = gtk_menu_get_attach_widget(GTK_MENU(parent));
+        else
+            child = parent;
+    }
+
+    return FALSE;
+}
+
+static void
+sec_activate_target_parent_changed(GtkWidget *menuitem, GtkWidget *old_parent,
+                                   gpointer data)
+{
+    g_return_if_fail(APP_IS_INDICATOR(data));
+    AppIndicator *self = APP_INDICATOR(data);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    priv->sec_activate_enabled = widget_is_menu_child(self, menuitem);
+}
+
+
+/* ************************* */
+/*    Public Functions       */
+/* ************************* */
+
+/**
+ * app_indicator_new:
+ * @id: The unique id of the indicator to create.
+ * @icon_name: The icon name for this indicator
+ * @category: The category of indicator.
+ *
+ * Creates a new #AppIndicator setting the properties:
+ * #AppIndicator:id with @id, #AppIndicator:category with @category
+ * and #AppIndicator:icon-name with @icon_name.
+ *
+ * Return value: A pointer to a new #AppIndicator object.
+ */
+AppIndicator *
+app_indicator_new (const gchar          *id,
+                   const gchar          *icon_name,
+                   AppIndicatorCategory  category)
+{
+  g_warning ("libayatana-appindicator is deprecated. Please use libayatana-appindicator-glib in newly written code.");
+
+  AppIndicator *indicator = g_object_new (APP_INDICATOR_TYPE,
+                                          PROP_ID_S, id,
+                                          PROP_CATEGORY_S, category_from_enum (category),
+                                          PROP_ICON_NAME_S, icon_name,
+                                          NULL);
+
+  return indicator;
+}
+
+/**
+ * app_indicator_new_with_path:
+ * @id: The unique id of the indicator to create.
+ * @icon_name: The icon name for this indicator
+ * @category: The category of indicator.
+ * @icon_theme_path: A custom path for finding icons.
+
+ * Creates a new #AppIndicator setting the properties:
+ * #AppIndicator:id with @id, #AppIndicator:category with @category,
+ * #AppIndicator:icon-name with @icon_name and #AppIndicator:icon-theme-path
+ * with @icon_theme_path.
+ *
+ * Return value: A pointer to a new #AppIndicator object.
+ */
+AppIndicator *
+app_indicator_new_with_path (const gchar          *id,
+                             const gchar          *icon_name,
+                             AppIndicatorCategory  category,
+                             const gchar          *icon_theme_path)
+{
+    g_warning ("libayatana-appindicator is deprecated. Please use libayatana-appindicator-glib in newly written code.");
+
+    AppIndicator *indicator = g_object_new (APP_INDICATOR_TYPE,
+                                            PROP_ID_S, id,
+                                            PROP_CATEGORY_S, category_from_enum (category),
+                                            PROP_ICON_NAME_S, icon_name,
+                                            PROP_ICON_THEME_PATH_S, icon_theme_path,
+                                            NULL);
+
+    return indicator;
+}
+
+/**
+ * app_indicator_new_with_context:
+ * @id: The unique id of the indicator to create.
+ * @icon_name: The icon name for this indicator
+ * @category: The category of indicator.
+ * @context: (allow-none): The #GMainContext to serve the D-Bus object from.
+ *
+ * Creates a new #AppIndicator like app_indicator_new() whose D-Bus
+ * object is served from @context, see #AppIndicator:dbus-context.
+ * Running @context in a thread of its own keeps the panel's requests
+ * from waiting on a busy GTK main loop.
+ *
+ * Return value: A pointer to a new #AppIndicator object.
+ *
+ * Since: 0.5.95
+ */
+AppIndicator *
+app_indicator_new_with_context (const gchar          *id,
+                                const gchar          *icon_name,
+                                AppIndicatorCategory  category,
+                                GMainContext         *context)
+{
+    g_warning ("libayatana-appindicator is deprecated. Please use libayatana-appindicator-glib in newly written code.");
+
+    AppIndicator *indicator = g_object_new (APP_INDICATOR_TYPE,
+                                            PROP_ID_S, id,
+                                            PROP_CATEGORY_S, category_from_enum (category),
+                                            PROP_ICON_NAME_S, icon_name,
+                                            PROP_DBUS_CONTEXT_S, context,
+                                            NULL);
+
+    return indicator;
+}
+
+/* The state of app_indicator_new_async() */
+typedef struct {
+    AppIndicator *        self;
+    gint64                start;
+    gint64                elapsed;
+    GSource *             cancel_source;
+} NewTaskData;
+
+static void
+new_task_data_free (gpointer data)
+{
+    NewTaskData * new_data = data;
+
+    if (new_data->cancel_source != NULL) {
+        g_source_destroy(new_data->cancel_source);
+        g_source_unref(new_data->cancel_source);
+    }
+
+    g_clear_object(&new_data->self);
+    g_free(new_data);
+
+    return;
+}
+
+/* Finishes the pending app_indicator_new_async(), if there is one.
+   @error is consumed. */
+static void
+new_task_complete (AppIndicator * self, GError * error)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GTask * task = priv->new_task;
+    NewTaskData * data;
+
+    if (task == NULL) {
+        if (error != NULL) {
+            g_error_free(error);
+        }
+        return;
+    }
+
+    priv->new_task = NULL;
+
+    data = g_task_get_task_data(task);
+    data->elapsed = g_get_monotonic_time() - data->start;
+
+    if (error != NULL) {
+        g_task_return_error(task, error);
+    } else {
+        g_task_return_pointer(task, g_object_ref(self), g_object_unref);
+    }
+
+    g_object_unref(task);
+    return;
+}
+
+static gboolean
+new_task_cancelled (GCancellable * cancellable, gpointer user_data)
+{
+    new_task_complete(APP_INDICATOR(user_data),
+                      g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Creating the indicator was cancelled"));
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * app_indicator_new_async:
+ * @id: The unique id of the indicator to create.
+ * @icon_name: The icon name for this indicator
+ * @category: The category of indicator.
+ * @menu: The menu for the indicator, it is needed to register it.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Called when the indicator is ready.
+ * @user_data: Data for @callback.
+ *
+ * Creates a new #AppIndicator like app_indicator_new() and sets @menu
+ * on it.  @callback is called once the indicator is registered with
+ * the StatusNotifierWatcher, or once it has fallen back to a status
+ * icon when there is no watcher.  Call app_indicator_new_finish() in
+ * @callback to get the indicator.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_new_async (const gchar          *id,
+                         const gchar          *icon_name,
+                         AppIndicatorCategory  category,
+                         GtkMenu              *menu,
+                         GCancellable         *cancellable,
+                         GAsyncReadyCallback   callback,
+                         gpointer              user_data)
+{
+    g_return_if_fail (GTK_IS_MENU (menu));
+    g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+    NewTaskData * data = g_new0 (NewTaskData, 1);
+    GTask * task = g_task_new (NULL, cancellable, callback, user_data);
+
+    g_task_set_source_tag (task, app_indicator_new_async);
+    g_task_set_task_data (task, data, new_task_data_free);
+
+    data->start = g_get_monotonic_time ();
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    data->self = app_indicator_new (id, icon_name, category);
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(data->self);
+
+    /* The indicator belongs to the task until it is done */
+    priv->new_task = task;
+
+    if (cancellable != NULL) {
+        data->cancel_source = g_cancellable_source_new (cancellable);
+        g_source_set_callback (data->cancel_source, (GSourceFunc) new_task_cancelled, data->self, NULL);
+        g_source_attach (data->cancel_source, priv->context);
+    }
+
+    app_indicator_set_menu (data->self, menu);
+
+    return;
+}
+
+/**
+ * app_indicator_new_finish:
+ * @result: The #GAsyncResult passed to the callback of app_indicator_new_async()
+ * @elapsed_us: (out) (allow-none): Where to store the time it took, in microseconds
+ * @error: Return location for a #GError or %NULL
+ *
+ * Finishes app_indicator_new_async().  @elapsed_us is set whether
+ * or not that worked, it is the time from the call to
+ * app_indicator_new_async() until the indicator was registered,
+ * fell back, or the operation failed.
+ *
+ * Return value: (transfer full): The new #AppIndicator, or %NULL
+ *     with @error set.
+ *
+ * Since: 0.5.95
+ */
+AppIndicator *
+app_indicator_new_finish (GAsyncResult  *result,
+                          gint64        *elapsed_us,
+                          GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+    g_return_val_if_fail (g_async_result_is_tagged (result, app_indicator_new_async), NULL);
+
+    if (elapsed_us != NULL) {
+        NewTaskData * data = g_task_get_task_data (G_TASK (result));
+        *elapsed_us = data->elapsed;
+    }
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * app_indicator_dispose_many:
+ * @indicators: (array length=n_indicators): The indicators to take down
+ * @n_indicators: The number of @indicators
+ *
+ * Takes many indicators down at once, for applications that exit or
+ * drop a whole set of them.  Disposed one by one, each indicator goes
+ * through the whole status change and leaves the watcher on its own.
+ * Here every indicator that isn't passive only sends NewStatus once,
+ * all of them back to back, so that the hosts hide them whether or not
+ * the application keeps running.  The objects are then taken off the
+ * bus in one go, without #AppIndicator::connection-changed.
+ *
+ * The indicators are disposed, but the references of the caller are
+ * not released and they are only good for g_object_unref() after
+ * this.  Call it in the context the indicators were made in.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_dispose_many (AppIndicator **indicators, guint n_indicators)
+{
+    GEnumValue * passive;
+    guint i;
+
+    g_return_if_fail (indicators != NULL || n_indicators == 0);
+
+    for (i = 0; i < n_indicators; i++) {
+        g_return_if_fail (APP_IS_INDICATOR (indicators[i]));
+        g_return_if_fail (in_owner_context (indicators[i]));
+    }
+
+    /* The hosts hide them all before any of the objects goes */
+    passive = g_enum_get_value (status_enum_class, APP_INDICATOR_STATUS_PASSIVE);
+
+    for (i = 0; i < n_indicators; i++) {
+        AppIndicatorPrivate * priv = app_indicator_get_instance_private(indicators[i]);
+        AppIndicatorStatus status;
+
+        if (priv->disposed_in_bulk) {
+            continue;
+        }
+
+        /* Dispose leaves the status to us */
+        g_mutex_lock(&priv->item_lock);
+        status = priv->status;
+        priv->status = APP_INDICATOR_STATUS_PASSIVE;
+        g_mutex_unlock(&priv->item_lock);
+
+        if (status != APP_INDICATOR_STATUS_PASSIVE &&
+            priv->dbus_registration != 0 && priv->connection != NULL) {
+            emit_bus_signal (indicators[i], "NewStatus", g_variant_new ("(s)", passive->value_nick));
+        }
+    }
+
+    /* Nothing is sent on the bus for them from here on */
+    for (i = 0; i < n_indicators; i++) {
+        AppIndicatorPrivate * priv = app_indicator_get_instance_private(indicators[i]);
+
+        if (priv->disposed_in_bulk) {
+            continue;
+        }
+
+        if (priv->dbus_registration != 0) {
+            g_dbus_connection_unregister_object(priv->connection, priv->dbus_registration);
+            priv->dbus_registration = 0;
+        }
+
+        g_clear_pointer(&priv->peers, g_ptr_array_unref);
+        state_page_close(indicators[i]);
+
+        priv->disposed_in_bulk = TRUE;
+    }
+
+    watcher_remove_many (indicators, n_indicators);
+
+    for (i = 0; i < n_indicators; i++) {
+        g_object_run_dispose (G_OBJECT (indicators[i]));
+    }
+
+    return;
+}
+
+/**
+ * app_indicator_get_type:
+ *
+ * Generates or returns the unique #GType for #AppIndicator.
+ *
+ * Return value: A unique #GType for #AppIndicator objects.
+ */
+
+/* Whether the setters can change the indicator right away, that is in
+   the thread that made it or in whichever one runs its context */
+static gboolean
+in_owner_context (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    return priv->owner == g_thread_self () || g_main_context_is_owner (priv->context);
+}
+
+static MailboxUpdate *
+mailbox_update_new (guint number, const gchar * first, const gchar * second, gboolean is_static)
+{
+    MailboxUpdate * update = g_new0 (MailboxUpdate, 1);
+
+    update->number = number;
+    update->is_static = is_static;
+
+    if (is_static) {
+        update->strings[0] = (gchar *) first;
+        update->strings[1] = (gchar *) second;
+    } else {
+        update->strings[0] = g_strdup (first);
+        update->strings[1] = g_strdup (second);
+    }
+
+    return update;
+}
+
+static void
+mailbox_update_free (MailboxUpdate * update)
+{
+    if (!update->is_static) {
+        g_free (update->strings[0]);
+        g_free (update->strings[1]);
+    }
+
+    g_strfreev (update->frames);
+    g_free (update);
+
+    return;
+}
+
+/* Puts @update into @slot and returns what was there before, whoever
+   swaps a value out of a slot owns it */
+static MailboxUpdate *
+mailbox_swap (MailboxSource * mailbox, guint slot, MailboxUpdate * update)
+{
+    MailboxUpdate * old;
+
+    do {
+        old = g_atomic_pointer_get (&mailbox->slots[slot]);
+    } while (!g_atomic_pointer_compare_and_exchange (&mailbox->slots[slot], old, update));
+
+    return old;
+}
+
+/* Goes through the setters again, now in the owner context */
+static void
+mailbox_apply (AppIndicator * self, guint slot, MailboxUpdate * update)
+{
+    const gchar * first = update->strings[0];
+    const gchar * second = update->strings[1];
+
+    switch (slot) {
+    case MAILBOX_STATUS:
+        app_indicator_set_status (self, update->number);
+        break;
+    case MAILBOX_ICON:
+        if (update->is_static) {
+            app_indicator_set_icon_full_static (self, first, second);
+        } else {
+            app_indicator_set_icon_full (self, first, second);
+        }
+        break;
+    case MAILBOX_ATTENTION_ICON:
+        if (update->is_static) {
+            app_indicator_set_attention_icon_full_static (self, first, second);
+        } else {
+            app_indicator_set_attention_icon_full (self, first, second);
+        }
+        break;
+    case MAILBOX_ICON_ANIMATION:
+        app_indicator_set_icon_animation (self, (const gchar * const *) update->frames, update->number);
+        break;
+    case MAILBOX_LABEL:
+        app_indicator_set_label (self, first, second);
+        break;
+    case MAILBOX_TITLE:
+        app_indicator_set_title (self, first);
+        break;
+    case MAILBOX_ICON_THEME_PATH:
+        app_indicator_set_icon_theme_path (self, first);
+        break;
+    case MAILBOX_ORDERING_INDEX:
+        app_indicator_set_ordering_index (self, update->number);
+        break;
+    default:
+        g_assert_not_reached ();
+    }
+
+    return;
+}
+
+static gboolean
+mailbox_dispatch (GSource * source, GSourceFunc callback, gpointer user_data)
+{
+    MailboxSource * mailbox = (MailboxSource *) source;
+    AppIndicator * self = g_weak_ref_get (&mailbox->self);
+    AppIndicatorPrivate * priv;
+    guint slot;
+
+    if (self == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    priv = app_indicator_get_instance_private(self);
+
+    /* Anything posted from here on wakes us up again */
+    g_source_set_ready_time (source, -1);
+    g_atomic_int_set (&mailbox->pending, FALSE);
+
+    for (slot = 0; slot < MAILBOX_N_SLOTS && !g_source_is_destroyed (source); slot++) {
+        MailboxUpdate * update = mailbox_swap (mailbox, slot, NULL);
+
+        if (update != NULL) {
+            mailbox_apply (self, slot, update);
+            mailbox_update_free (update);
+        }
+    }
+
+    /* A new label value only needs the label to be sent */
+    if (!g_source_is_destroyed (source) && priv->label_template != NULL &&
+        g_atomic_int_get (&priv->label_value_pending)) {
+        signal_label_change (self);
+    }
+
+    g_object_unref (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+mailbox_finalize (GSource * source)
+{
+    MailboxSource * mailbox = (MailboxSource *) source;
+
+    g_weak_ref_clear (&mailbox->self);
+    return;
+}
+
+static GSourceFuncs mailbox_source_funcs = {
+    NULL,
+    NULL,
+    mailbox_dispatch,
+    mailbox_finalize
+};
+
+/* Made with the indicator in its context, it is only woken up when
+   there is something to pick up */
+static MailboxSource *
+mailbox_new (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    MailboxSource * mailbox = (MailboxSource *) g_source_new (&mailbox_source_funcs, sizeof (MailboxSource));
+
+    g_weak_ref_init (&mailbox->self, self);
+    g_source_set_name (&mailbox->source, "AppIndicator mailbox");
+    g_source_set_ready_time (&mailbox->source, -1);
+    g_source_attach (&mailbox->source, priv->context);
+
+    return mailbox;
+}
+
+/* Has the owner context look at the mailbox of @self, only the first
+   caller since it last did touches the source.  Nothing is woken up
+   once the indicator is being disposed of, as there is nobody left to
+   pick anything up. */
+static void
+mailbox_wake (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    MailboxSource * mailbox = priv->mailbox;
+
+    if (g_atomic_int_get (&mailbox->closed)) {
+        return;
+    }
+
+    if (g_atomic_int_compare_and_exchange (&mailbox->pending, FALSE, TRUE)) {
+        g_source_set_ready_time (&mailbox->source, 0);
+    }
+
+    return;
+}
+
+/* Leaves @update for the owner context, replacing any value of the
+   same property that it hasn't picked up yet.  The caller holds a
+   reference, so the mailbox is there until it returns, and whatever is
+   left in it is freed with the indicator. */
+static void
+mailbox_post (AppIndicator * self, guint slot, MailboxUpdate * update)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    MailboxUpdate * old;
+
+    old = mailbox_swap (priv->mailbox, slot, update);
+
+    if (old != NULL) {
+        mailbox_update_free (old);
+    }
+
+    mailbox_wake (self);
+
+    return;
+}
+
+/* Stops picking up updates, in dispose */
+static void
+mailbox_close (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_atomic_int_set (&priv->mailbox->closed, TRUE);
+    g_source_destroy (&priv->mailbox->source);
+
+    return;
+}
+
+/* Drops whatever didn't make it to the owner context, in finalize
+   where no other thread can post anymore */
+static void
+mailbox_free (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    MailboxSource * mailbox = g_steal_pointer (&priv->mailbox);
+    guint slot;
+
+    if (mailbox == NULL) {
+        return;
+    }
+
+    g_source_destroy (&mailbox->source);
+
+    for (slot = 0; slot < MAILBOX_N_SLOTS; slot++) {
+        MailboxUpdate * update = mailbox_swap (mailbox, slot, NULL);
+
+        if (update != NULL) {
+            mailbox_update_free (update);
+        }
+    }
+
+    g_source_unref (&mailbox->source);
+
+    return;
+}
+
+/**
+ * app_indicator_set_status:
+ * @self: The #AppIndicator object to use
+ * @status: The status to set for this indicator
+ *
+ * Wrapper function for property #AppIndicator:status.
+ */
+void
+app_indicator_set_status (AppIndicator *self, AppIndicatorStatus status)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_STATUS, mailbox_update_new (status, NULL, NULL, FALSE));
+        return;
+    }
+
+    stats_setter_call (self);
+    set_status (self, status);
+
+    return;
+}
+
+/* Dispose uses this directly, which app_indicator_dispose() makes
+   sure happens in the owner context */
+static void
+set_status (AppIndicator * self, AppIndicatorStatus status)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (priv->status != status) {
+        GEnumValue *value = g_enum_get_value (status_enum_class, status);
+
+        g_mutex_lock(&priv->item_lock);
+        priv->status = status;
+        g_mutex_unlock(&priv->item_lock);
+        g_signal_emit (self, signals[NEW_STATUS], 0, value->value_nick);
+
+        if (priv->dbus_registration != 0 && priv->connection != NULL) {
+            emit_bus_signal (self, "NewStatus", g_variant_new("(s)", value->value_nick));
+        }
+    }
+
+    return;
+}
+
+/**
+ * app_indicator_set_attention_icon:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The name of the attention icon to set for this indicator
+ *
+ * Wrapper for app_indicator_set_attention_icon_full() with a NULL
+ * description.
+ *
+ * Deprecated: Use app_indicator_set_attention_icon_full() instead.
+ */
+void
+app_indicator_set_attention_icon (AppIndicator *self, const gchar *icon_name)
+{
+    return app_indicator_set_attention_icon_full(self, icon_name, NULL);
+}
+
+/**
+ * app_indicator_set_attention_icon_full:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The name of the attention icon to set for this indicator
+ * @icon_desc: (nullable): A textual description of the icon
+ *
+ * Wrapper function for property #AppIndicator:attention-icon-name.
+ */
+void
+app_indicator_set_attention_icon_full (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (icon_name != NULL);
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ATTENTION_ICON, mailbox_update_new (0, icon_name, icon_desc, FALSE));
+        return;
+    }
+
+    set_attention_icon (self, icon_name, icon_desc, FALSE);
+
+    return;
+}
+
+/**
+ * app_indicator_set_attention_icon_full_static:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The name of the attention icon to set for this indicator
+ * @icon_desc: (nullable): A textual description of the icon
+ *
+ * Like app_indicator_set_attention_icon_full(), but @icon_name and
+ * @icon_desc are not copied.  They have to stay valid for the lifetime
+ * of the process, which is the case for string literals.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_attention_icon_full_static (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (icon_name != NULL);
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ATTENTION_ICON, mailbox_update_new (0, icon_name, icon_desc, TRUE));
+        return;
+    }
+
+    set_attention_icon (self, icon_name, icon_desc, TRUE);
+
+    return;
+}
+
+/* Replaces the interned string in @field with @str, returns whether
+   it changed */
+static gboolean
+replace_interned_string (const gchar ** field, const gchar * str, gboolean is_static)
+{
+    const gchar * interned;
+
+    if (*field == str) {
+        return FALSE;
+    }
+
+    /* Equal strings are the same interned string */
+    interned = intern_string (str, is_static);
+
+    if (interned == *field) {
+        unref_interned_string (interned);
+        return FALSE;
+    }
+
+    unref_interned_string (*field);
+    *field = interned;
+
+    return TRUE;
+}
+
+/* The snap version of an absolute icon path, if any */
+static const gchar *
+intern_absolute_icon_name (const gchar * icon_name)
+{
+    const gchar * interned = NULL;
+
+    if (icon_name != NULL && icon_name[0] == '/') {
+        interned = snap_path_ref (icon_name);
+    }
+
+    return interned;
+}
+
+static void
+set_attention_icon (AppIndicator * self, const gchar * icon_name, const gchar * icon_desc, gboolean is_static)
+{
+    const gchar * absolute;
+    gboolean changed = FALSE;
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    STATS_ADD(priv->stats.setter_calls, 1);
+
+    /* Resolving the path can hit the disk, the property getters
+       shouldn't wait for that */
+    absolute = intern_absolute_icon_name (icon_name);
+
+    g_mutex_lock (&priv->item_lock);
+
+    if (replace_interned_string (&priv->attention_icon_name, icon_name, is_static)) {
+        const gchar * old = priv->absolute_attention_icon_name;
+
+        priv->absolute_attention_icon_name = absolute;
+        absolute = old;
+
+        changed = TRUE;
+    }
+
+    if (replace_interned_string (&priv->att_accessible_desc, icon_desc, is_static)) {
+        changed = TRUE;
+    }
+
+    g_mutex_unlock (&priv->item_lock);
+
+    /* The old one, or the new one if it wasn't needed */
+    unref_interned_string (absolute);
+
+    if (changed) {
+        g_signal_emit (self, signals[NEW_ATTENTION_ICON], 0);
+
+        if (priv->dbus_registration != 0 && priv->connection != NULL) {
+            emit_bus_signal (self, "NewAttentionIcon", NULL);
+        }
+    }
+
+    return;
+}
+
+/**
+ * app_indicator_set_icon:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The icon name to set.
+ *
+ * Wrapper function for app_indicator_set_icon_full() with a NULL
+ * description.
+ *
+ * Deprecated: Use app_indicator_set_icon_full()
+ */
+void
+app_indicator_set_icon (AppIndicator *self, const gchar *icon_name)
+{
+    return app_indicator_set_icon_full(self, icon_name, NULL);
+}
+
+/**
+ * app_indicator_set_icon_full:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The icon name to set.
+ * @icon_desc: (nullable): A textual description of the icon for accessibility
+ *
+ * Sets the default icon to use when the status is active but
+ * not set to attention.  In most cases, this should be the
+ * application icon for the program.
+ *
+ * Wrapper function for property #AppIndicator:icon-name and
+ * #AppIndicator:icon-desc.
+ */
+void
+app_indicator_set_icon_full (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (icon_name != NULL);
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ICON, mailbox_update_new (0, icon_name, icon_desc, FALSE));
+        return;
+    }
+
+    set_icon (self, icon_name, icon_desc, FALSE);
+
+    return;
+}
+
+/**
+ * app_indicator_set_icon_full_static:
+ * @self: The #AppIndicator object to use
+ * @icon_name: The icon name to set.
+ * @icon_desc: (nullable): A textual description of the icon for accessibility
+ *
+ * Like app_indicator_set_icon_full(), but @icon_name and @icon_desc
+ * are not copied.  They have to stay valid for the lifetime of the
+ * process, which is the case for string literals.  Indicators that
+ * switch between a fixed set of icons often should use this.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_icon_full_static (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (icon_name != NULL);
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ICON, mailbox_update_new (0, icon_name, icon_desc, TRUE));
+        return;
+    }
+
+    set_icon (self, icon_name, icon_desc, TRUE);
+
+    return;
+}
+
+static void
+set_icon (AppIndicator * self, const gchar * icon_name, const gchar * icon_desc, gboolean is_static)
+{
+    const gchar * absolute;
+    gboolean changed = FALSE;
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    STATS_ADD(priv->stats.setter_calls, 1);
+
+    /* Any icon replaces the animation, even the one it started from */
+    if (priv->icon_anim_frames != NULL) {
+        icon_animation_clear (self);
+        changed = TRUE;
+    }
+
+    /* Resolving the path can hit the disk, the property getters
+       shouldn't wait for that */
+    absolute = intern_absolute_icon_name (icon_name);
+
+    g_mutex_lock (&priv->item_lock);
+
+    if (replace_interned_string (&priv->icon_name, icon_name, is_static)) {
+        const gchar * old = priv->absolute_icon_name;
+
+        priv->absolute_icon_name = absolute;
+        absolute = old;
+
+        changed = TRUE;
+    }
+
+    if (replace_interned_string (&priv->accessible_desc, icon_desc, is_static)) {
+        changed = TRUE;
+    }
+
+    g_mutex_unlock (&priv->item_lock);
+
+    /* The old one, or the new one if it wasn't needed */
+    unref_interned_string (absolute);
+
+    if (changed) {
+        signal_new_icon (self);
+    }
+
+    return;
+}
+
+/**
+ * app_indicator_set_icon_animation:
+ * @self: The #AppIndicator object to use
+ * @frames: (array zero-terminated=1) (allow-none): The icon names of the frames
+ * @interval_ms: How long each frame is shown, in milliseconds
+ *
+ * Animates the icon by cycling through @frames while the status is
+ * %APP_INDICATOR_STATUS_ACTIVE.  The frames are handed to the host once,
+ * a host that can animate them on its own says so and the application
+ * stays idle.  Until one does, the frames are stepped by a single
+ * timer that is shared by every indicator in the process, which is a
+ * lot cheaper than calling app_indicator_set_icon_full() from a timer.
+ *
+ * Setting @frames to %NULL, or setting a new icon with
+ * app_indicator_set_icon_full(), stops the animation.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_icon_animation (AppIndicator *self, const gchar * const *frames, guint interval_ms)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+
+    if (!in_owner_context (self)) {
+        MailboxUpdate * update = mailbox_update_new (interval_ms, NULL, NULL, FALSE);
+
+        update->frames = g_strdupv ((gchar **) frames);
+        mailbox_post (self, MAILBOX_ICON_ANIMATION, update);
+        return;
+    }
+
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint i;
+
+    if (frames != NULL && frames[0] == NULL) {
+        frames = NULL;
+    }
+
+    if (frames == NULL && priv->icon_anim_frames == NULL) {
+        return;
+    }
+
+    icon_animation_stop (self);
+    icon_animation_free_frames (self);
+
+    if (frames != NULL) {
+        g_mutex_lock (&priv->item_lock);
+
+        priv->icon_anim_frames = g_strdupv ((gchar **) frames);
+        priv->icon_anim_n_frames = g_strv_length (priv->icon_anim_frames);
+        priv->icon_anim_interval = MAX (interval_ms, MIN_ANIMATION_INTERVAL);
+        priv->absolute_icon_anim_frames = g_new0 (gchar *, priv->icon_anim_n_frames);
+
+        for (i = 0; i < priv->icon_anim_n_frames; i++) {
+            if (frames[i][0] == '/') {
+                priv->absolute_icon_anim_frames[i] = append_snap_prefix (frames[i]);
+            }
+        }
+
+        g_mutex_unlock (&priv->item_lock);
+
+        icon_animation_start (self);
+    }
+
+    signal_new_icon (self);
+
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        GVariantBuilder builder;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+        for (i = 0; i < priv->icon_anim_n_frames; i++) {
+            const gchar * frame = priv->absolute_icon_anim_frames[i] ?
+                                    priv->absolute_icon_anim_frames[i] :
+                                    priv->icon_anim_frames[i];
+            g_variant_builder_add (&builder, "s", frame);
+        }
+
+        emit_bus_signal (self, "XAyatanaNewIconAnimation", g_variant_new("(asu)", &builder, priv->icon_anim_interval));
+    }
+
+    check_connect (self);
+
+    return;
+}
+
+/**
+ * app_indicator_set_label:
+ * @self: The #AppIndicator object to use
+ * @label: The label to show next to the icon.
+ * @guide: A guide to size the label correctly.
+ *
+ * This is a wrapper function for the #AppIndicator:label and
+ * #AppIndicator:label-guide properties.  This function can take #NULL
+ * as either @label or @guide and will clear the entries.
+*/
+void
+app_indicator_set_label (AppIndicator *self, const gchar * label, const gchar * guide)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_LABEL, mailbox_update_new (0, label, guide, FALSE));
+        return;
+    }
+
+    stats_setter_call (self);
+    /* Note: The label can be NULL, it's okay */
+    /* Note: The guide can be NULL, it's okay */
+
+    g_object_set(G_OBJECT(self),
+                 PROP_LABEL_S,       label == NULL ? "" : label,
+                 PROP_LABEL_GUIDE_S, guide == NULL ? "" : guide,
+                 NULL);
+
+    return;
+}
+
+/* Whether @label_template has a single conversion, for a double, and
+   otherwise only escaped percent signs */
+static gboolean
+label_template_is_valid (const gchar * label_template)
+{
+    const gchar * p = label_template;
+    guint conversions = 0;
+
+    while ((p = strchr (p, '%')) != NULL) {
+        p++;
+
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        p += strspn (p, "-+ #0'");
+        p += strspn (p, "0123456789");
+
+        if (*p == '.') {
+            p++;
+            p += strspn (p, "0123456789");
+        }
+
+        if (*p == '\0' || strchr ("eEfFgGaA", *p) == NULL) {
+            return FALSE;
+        }
+
+        p++;
+        conversions++;
+    }
+
+    return conversions == 1;
+}
+
+/**
+ * app_indicator_set_label_template:
+ * @self: The #AppIndicator object to use
+ * @label_template: (allow-none): A printf() format with a single
+ *     conversion for a double, like "%.1f MB/s".
+ * @guide: (allow-none): A guide to size the label correctly.
+ *
+ * Makes the label follow the values given to
+ * app_indicator_set_label_value(), for indicators that show a number
+ * which changes often.  Setting the value is cheap, the label is only
+ * made and sent when the label change goes out, with the last value
+ * set by then.  Setting a label with app_indicator_set_label(), or a
+ * %NULL @label_template, stops following the value.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_label_template (AppIndicator *self, const gchar * label_template, const gchar * guide)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (label_template == NULL || label_template_is_valid (label_template));
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (label_template == NULL) {
+        g_clear_pointer (&priv->label_template, g_free);
+        return;
+    }
+
+    text_provider_set (self, &priv->label_provider, NULL, NULL, NULL);
+
+    g_object_set (G_OBJECT (self),
+                  PROP_LABEL_GUIDE_S, guide == NULL ? "" : guide,
+                  NULL);
+
+    g_free (priv->label_template);
+    priv->label_template = g_strdup (label_template);
+
+    g_atomic_int_set (&priv->label_value_pending, TRUE);
+    signal_label_change (self);
+
+    return;
+}
+
+/**
+ * app_indicator_set_label_value:
+ * @self: The #AppIndicator object to use
+ * @value: The value for the label template
+ *
+ * Sets the value that is shown with the template given to
+ * app_indicator_set_label_template().  This can be called from any
+ * thread and doesn't take a lock, values set before the label goes
+ * out replace each other.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_label_value (AppIndicator *self, gdouble value)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    guint64 bits;
+
+    /* Without a template nothing follows the value.  This is only a
+       hint in other threads, the owner context looks again. */
+    if (g_atomic_pointer_get (&priv->label_template) == NULL) {
+        return;
+    }
+
+    memcpy (&bits, &value, sizeof (bits));
+    __atomic_store_n (&priv->label_value, bits, __ATOMIC_RELEASE);
+
+    /* Only the first value since the last label wakes anybody up */
+    if (!g_atomic_int_compare_and_exchange (&priv->label_value_pending, FALSE, TRUE)) {
+        return;
+    }
+
+    if (in_owner_context (self)) {
+        signal_label_change (self);
+    } else {
+        mailbox_wake (self);
+    }
+
+    return;
+}
+
+/* The snap environment doesn't change while we run, so the prefix and
+   the directories the snap can read from are only looked up once.
+   Roots that are inside of another root are dropped. */
+typedef struct {
+    gchar *   prefix;
+    gchar **  roots;
+} SnapPaths;
+
+static gboolean
+snap_root_is_covered (GPtrArray * roots, const gchar * root)
+{
+    guint i;
+
+    for (i = 0; i < roots->len; i++) {
+        if (g_str_has_prefix (root, g_ptr_array_index (roots, i))) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gpointer
+snap_paths_init (gpointer data)
+{
+    SnapPaths * paths = g_new0 (SnapPaths, 1);
+    const gchar * snap = g_getenv ("SNAP");
+    const gchar * candidates[6 + G_USER_N_DIRECTORIES];
+    GPtrArray * roots;
+    guint n_candidates = 0;
+    guint i;
+
+    if (snap == NULL || *snap == '\0') {
+        return paths;
+    }
+
+    paths->prefix = g_strdup (snap);
+
+    candidates[n_candidates++] = snap;
+    candidates[n_candidates++] = g_get_home_dir ();
+    candidates[n_candidates++] = g_get_user_cache_dir ();
+    candidates[n_candidates++] = g_get_user_config_dir ();
+    candidates[n_candidates++] = g_get_user_data_dir ();
+    candidates[n_candidates++] = g_get_user_runtime_dir ();
+
+    for (i = 0; i < G_USER_N_DIRECTORIES; ++ i) {
+        candidates[n_candidates++] = g_get_user_special_dir (i);
+    }
+
+    /* Shortest first, so that covering roots are added before the
+       ones they cover */
+    roots = g_ptr_array_new ();
+
+    while (TRUE) {
+        const gchar * shortest = NULL;
+        guint shortest_i = 0;
+
+        for (i = 0; i < n_candidates; i++) {
+            if (candidates[i] == NULL || candidates[i][0] == '\0') {
+                continue;
+            }
+
+            if (shortest == NULL || strlen (candidates[i]) < strlen (shortest)) {
+                shortest = candidates[i];
+                shortest_i = i;
+            }
+        }
+
+        if (shortest == NULL) {
+            break;
+        }
+
+        candidates[shortest_i] = NULL;
+
+        if (!snap_root_is_covered (roots, shortest)) {
+            g_ptr_array_add (roots, g_strdup (shortest));
+        }
+    }
+
+    g_ptr_array_add (roots, NULL);
+    paths->roots = (gchar **) g_ptr_array_free (roots, FALSE);
+
+    return paths;
+}
+
+static const SnapPaths *
+get_snap_paths (void)
+{
+    static GOnce snap_paths_once = G_ONCE_INIT;
+
+    return g_once (&snap_paths_once, snap_paths_init, NULL);
+}
+
+static const gchar *
+get_snap_prefix ()
+{
+    return get_snap_paths ()->prefix;
+}
+
+static gchar *
+resolve_snap_path (const SnapPaths * paths, const gchar * path)
+{
+    gint i;
+    g_autofree gchar *canon_path = NULL;
+
+    canon_path = realpath(path, NULL);
+
+    if (canon_path == NULL) {
+        return NULL;
+    }
+
+    if (g_str_has_prefix (canon_path, "/tmp/")) {
+        g_warning ("Using '/tmp' paths in SNAP environment will lead to unreadable resources");
+        return NULL;
+    }
+
+    for (i = 0; paths->roots[i] != NULL; ++ i) {
+        if (g_str_has_prefix (canon_path, paths->roots[i])) {
+            return g_steal_pointer (&canon_path);
+        }
+    }
+
+    return g_build_path (G_DIR_SEPARATOR_S, paths->prefix, canon_path, NULL);
+}
+
+/* The paths of recently used icons, as resolving them needs a
+   realpath() call for every icon update.  Both sides are interned,
+   the most recently used entry comes first.  Paths that could not be
+   resolved are not kept, the file might be there next time. */
+typedef struct {
+    const gchar * path;
+    const gchar * snapped;
+} SnapPathEntry;
+
+G_LOCK_DEFINE_STATIC (snap_path_cache);
+static SnapPathEntry              snap_path_cache[SNAP_PATH_CACHE_SIZE];
+
+/* Returns the interned snap version of @path with a reference held,
+   or NULL when there is none */
+static const gchar *
+snap_path_ref (const gchar * path)
+{
+    const SnapPaths * paths = get_snap_paths ();
+    SnapPathEntry entry;
+    const gchar * result;
+    gchar * snapped;
+    gint i;
+
+    if (paths->prefix == NULL || path == NULL) {
+        return NULL;
+    }
+
+    G_LOCK (snap_path_cache);
+
+    for (i = 0; i < SNAP_PATH_CACHE_SIZE && snap_path_cache[i].path != NULL; i++) {
+        if (strcmp (snap_path_cache[i].path, path) == 0) {
+            entry = snap_path_cache[i];
+            memmove (&snap_path_cache[1], &snap_path_cache[0], i * sizeof (SnapPathEntry));
+            snap_path_cache[0] = entry;
+
+            /* Before it can be evicted by another thread */
+            result = intern_string (entry.snapped, FALSE);
+
+            G_UNLOCK (snap_path_cache);
+
+            return result;
+        }
+    }
+
+    G_UNLOCK (snap_path_cache);
+
+    snapped = resolve_snap_path (paths, path);
+    if (snapped == NULL) {
+        return NULL;
+    }
+
+    entry.path = intern_string (path, FALSE);
+    entry.snapped = intern_string (snapped, FALSE);
+    g_free (snapped);
+
+    G_LOCK (snap_path_cache);
+
+    i = SNAP_PATH_CACHE_SIZE - 1;
+    unref_interned_string (snap_path_cache[i].path);
+    unref_interned_string (snap_path_cache[i].snapped);
+    memmove (&snap_path_cache[1], &snap_path_cache[0], i * sizeof (SnapPathEntry));
+    snap_path_cache[0] = entry;
+
+    result = intern_string (entry.snapped, FALSE);
+
+    G_UNLOCK (snap_path_cache);
+
+    return result;
+}
+
+static gchar *
+append_snap_prefix (const gchar *path)
+{
+    const gchar * snapped = snap_path_ref (path);
+    gchar * result = g_strdup (snapped);
+
+    unref_interned_string (snapped);
+
+    return result;
+}
+
+/* Returns an interned string with a reference held on it */
+static const gchar *
+get_real_theme_path (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    const gchar *theme_path = priv->icon_theme_path;
+    const gchar *snapped_path = snap_path_ref (theme_path);
+
+    if (snapped_path != NULL) {
+        return snapped_path;
+    } else if (get_snap_prefix ()) {
+        gchar * user_icons = g_build_path (G_DIR_SEPARATOR_S, g_get_user_data_dir (), "icons", NULL);
+        const gchar * interned = intern_string (user_icons, FALSE);
+
+        g_free (user_icons);
+        return interned;
+    }
+
+    return NULL;
+}
+
+/**
+ * app_indicator_set_icon_theme_path:
+ * @self: The #AppIndicator object to use
+ * @icon_theme_path: The icon theme path to set.
+ *
+ * Sets the path to use when searching for icons.
+ */
+void
+app_indicator_set_icon_theme_path (AppIndicator *self, const gchar *icon_theme_path)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ICON_THEME_PATH, mailbox_update_new (0, icon_theme_path, NULL, FALSE));
+        return;
+    }
+
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_mutex_lock (&priv->item_lock);
+
+    if (!replace_interned_string (&priv->icon_theme_path, icon_theme_path, FALSE)) {
+        g_mutex_unlock (&priv->item_lock);
+        return;
+    }
+
+    unref_interned_string (priv->absolute_icon_theme_path);
+    priv->absolute_icon_theme_path = get_real_theme_path (self);
+
+    unref_interned_string (priv->cached_icon_theme_path);
+    priv->cached_icon_theme_path = NULL;
+
+    g_mutex_unlock (&priv->item_lock);
+
+    g_signal_emit (self, signals[NEW_ICON_THEME_PATH], 0, priv->icon_theme_path);
+    signal_new_icon_theme_path (self);
+
+    icon_cache_update (self);
+
+    return;
+}
+
+/**
+ * app_indicator_set_icon_theme_cache:
+ * @self: The #AppIndicator object to use
+ * @enabled: Whether to build an icon cache for the icon theme path
+ *
+ * Applications that ship many icons in their icon theme path can
+ * have an icon cache built for it, so that looking up an icon
+ * doesn't need a walk over the directories.  The cache is made in
+ * the background in the user cache directory, next to links to the
+ * contents of the icon theme path, and hosts are pointed at it once
+ * it is ready.  It is rebuilt when the icon theme path changes.
+ *
+ * This needs gtk-update-icon-cache, the icon theme path is used as
+ * it is when that isn't available.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_icon_theme_cache (AppIndicator *self, gboolean enabled)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    enabled = enabled ? TRUE : FALSE;
+
+    if (priv->icon_cache_enabled == enabled) {
+        return;
+    }
+
+    priv->icon_cache_enabled = enabled;
+
+    if (!enabled && priv->cached_icon_theme_path != NULL) {
+        g_mutex_lock (&priv->item_lock);
+        unref_interned_string (priv->cached_icon_theme_path);
+        priv->cached_icon_theme_path = NULL;
+        g_mutex_unlock (&priv->item_lock);
+
+        signal_new_icon_theme_path (self);
+    }
+
+    icon_cache_update (self);
+
+    return;
+}
+
+/* The theme path that hosts should look up icons in */
+static const gchar *
+get_host_theme_path (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (priv->cached_icon_theme_path != NULL) {
+        return priv->cached_icon_theme_path;
+    }
+
+    if (priv->absolute_icon_theme_path != NULL) {
+        return priv->absolute_icon_theme_path;
+    }
+
+    return priv->icon_theme_path;
+}
+
+static void
+signal_new_icon_theme_path (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        const gchar *theme_path = get_host_theme_path (self);
+
+        emit_bus_signal (self, "NewIconThemePath", g_variant_new("(s)", theme_path ? theme_path : ""));
+    }
+
+    return;
+}
+
+/* Newest modification time of @path and the directories below it,
+   adding or removing an icon changes the one of its directory */
+static gint64
+icon_cache_source_mtime (const gchar * path, guint depth)
+{
+    GStatBuf buf;
+    gint64 mtime;
+    GDir * dir;
+    const gchar * name;
+
+    if (g_stat (path, &buf) != 0 || !S_ISDIR (buf.st_mode)) {
+        return -1;
+    }
+
+    mtime = buf.st_mtime;
+
+    if (depth == 0 || (dir = g_dir_open (path, 0, NULL)) == NULL) {
+        return mtime;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar * child = g_build_filename (path, name, NULL);
+        mtime = MAX (mtime, icon_cache_source_mtime (child, depth - 1));
+        g_free (child);
+    }
+
+    g_dir_close (dir);
+
+    return mtime;
+}
+
+/* Removes @path and everything below it, links are not followed */
+static void
+icon_cache_remove (const gchar * path)
+{
+    GStatBuf buf;
+    GDir * dir;
+    const gchar * name;
+
+    if (g_lstat (path, &buf) != 0) {
+        return;
+    }
+
+    if (!S_ISDIR (buf.st_mode)) {
+        g_unlink (path);
+        return;
+    }
+
+    if ((dir = g_dir_open (path, 0, NULL)) != NULL) {
+        while ((name = g_dir_read_name (dir)) != NULL) {
+            gchar * child = g_build_filename (path, name, NULL);
+            icon_cache_remove (child);
+            g_free (child);
+        }
+
+        g_dir_close (dir);
+    }
+
+    g_rmdir (path);
+
+    return;
+}
+
+/* Fills @mirror with links to the contents of @source.  The directories
+   of @source, the themes, get a directory of their own as GtkIconTheme
+   only reads the cache in <search path>/<theme>/icon-theme.cache.
+   Those are added to @themes. */
+static gboolean
+icon_cache_link (const gchar * source, const gchar * mirror, gboolean themes_below, GSList ** themes, GError ** error)
+{
+    GDir * dir;
+    const gchar * name;
+
+    if ((dir = g_dir_open (source, 0, error)) == NULL) {
+        return FALSE;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar * target = g_build_filename (source, name, NULL);
+        gchar * link = g_build_filename (mirror, name, NULL);
+
+        if (g_strcmp0 (name, "icon-theme.cache") == 0) {
+            /* Ours is built below */
+        } else if (themes_below && g_file_test (target, G_FILE_TEST_IS_DIR)) {
+            if (g_mkdir (link, 0700) == 0 &&
+                icon_cache_link (target, link, FALSE, themes, NULL)) {
+                *themes = g_slist_prepend (*themes, g_steal_pointer (&link));
+            } else {
+                g_debug ("Unable to mirror '%s' in '%s'", target, link);
+            }
+        } else if (symlink (target, link) != 0) {
+            g_debug ("Unable to link '%s' to '%s'", link, target);
+        }
+
+        g_free (target);
+        g_free (link);
+    }
+
+    g_dir_close (dir);
+
+    return TRUE;
+}
+
+static gboolean
+icon_cache_run_tool (const gchar * theme, GError ** error)
+{
+    gchar * argv[] = { "gtk-update-icon-cache", "--quiet", "--force",
+                       "--ignore-theme-index", (gchar *) theme, NULL };
+    gint status = 0;
+
+    if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                       NULL, NULL, NULL, NULL, &status, error)) {
+        return FALSE;
+    }
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    if (!g_spawn_check_exit_status (status, error)) {
+        return FALSE;
+    }
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+    return TRUE;
+}
+
+/* Makes @mirror a mirror of @source with an icon cache for each of its
+   themes, and @stamp in its .source file.  Other processes may be
+   using the same mirror, so it is built in a directory of its own and
+   @mirror, a link to that, is replaced in one go. */
+static gboolean
+icon_cache_build (const gchar * source, const gchar * mirror, const gchar * stamp, GError ** error)
+{
+    gchar * parent = g_path_get_dirname (mirror);
+    gchar * build = g_strconcat (mirror, ".XXXXXX", NULL);
+    gchar * build_name = NULL;
+    gchar * stamp_file = NULL;
+    gchar * link = NULL;
+    gchar * old = NULL;
+    GSList * themes = NULL;
+    GSList * l;
+    gboolean built = FALSE;
+
+    if (g_mkdir_with_parents (parent, 0700) != 0 || g_mkdtemp (build) == NULL) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Unable to create '%s'", build);
+        goto out;
+    }
+
+    if (!icon_cache_link (source, build, TRUE, &themes, error)) {
+        goto out;
+    }
+
+    for (l = themes; l != NULL; l = l->next) {
+        if (!icon_cache_run_tool (l->data, error)) {
+            goto out;
+        }
+    }
+
+    stamp_file = g_build_filename (build, ".source", NULL);
+    if (!g_file_set_contents (stamp_file, stamp, -1, error)) {
+        goto out;
+    }
+
+    build_name = g_path_get_basename (build);
+    link = g_strconcat (build, ".link", NULL);
+    old = g_file_read_link (mirror, NULL);
+
+    if (symlink (build_name, link) != 0 || rename (link, mirror) != 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Unable to replace '%s'", mirror);
+        g_unlink (link);
+        goto out;
+    }
+
+    /* Whatever the link pointed at before is not used anymore */
+    if (old != NULL && g_strcmp0 (old, build_name) != 0) {
+        gchar * old_path = g_build_filename (parent, old, NULL);
+        icon_cache_remove (old_path);
+        g_free (old_path);
+    }
+
+    built = TRUE;
+
+out:
+    if (!built) {
+        icon_cache_remove (build);
+    }
+
+    g_slist_free_full (themes, g_free);
+    g_free (parent);
+    g_free (build);
+    g_free (build_name);
+    g_free (stamp_file);
+    g_free (link);
+    g_free (old);
+
+    return built;
+}
+
+static void
+icon_cache_thread (GTask * task, gpointer source_object, gpointer task_data, GCancellable * cancellable)
+{
+    const gchar * source = task_data;
+    gchar * key = g_compute_checksum_for_string (G_CHECKSUM_SHA1, source, -1);
+    gchar * mirror = g_build_filename (g_get_user_cache_dir (), "libayatana-appindicator", "icon-themes", key, NULL);
+    gchar * stamp_file = g_build_filename (mirror, ".source", NULL);
+    gchar * stamp = NULL;
+    gchar * old_stamp = NULL;
+    /* <source>/<theme>/<size>/<context> holds the icons */
+    gint64 mtime = icon_cache_source_mtime (source, 3);
+    GError * error = NULL;
+
+    if (mtime < 0) {
+        g_task_return_new_error (task, G_FILE_ERROR, G_FILE_ERROR_NOTDIR,
+                                 "'%s' is not a directory", source);
+        goto out;
+    }
+
+    /* The stamp says which state of the source the cache is for, it
+       is only there once the caches have been built */
+    stamp = g_strdup_printf ("%s\n%" G_GINT64_FORMAT "\n", source, mtime);
+
+    if (g_file_get_contents (stamp_file, &old_stamp, NULL, NULL) &&
+        g_strcmp0 (stamp, old_stamp) == 0) {
+        g_task_return_pointer (task, g_steal_pointer (&mirror), g_free);
+        goto out;
+    }
+
+    if (!icon_cache_build (source, mirror, stamp, &error)) {
+        g_task_return_error (task, error);
+        goto out;
+    }
+
+    g_task_return_pointer (task, g_steal_pointer (&mirror), g_free);
+
+out:
+    g_free (key);
+    g_free (mirror);
+    g_free (stamp_file);
+    g_free (stamp);
+    g_free (old_stamp);
+    return;
+}
+
+static void
+icon_cache_ready (GObject * source_object, GAsyncResult * res, gpointer user_data)
+{
+    AppIndicator * self = APP_INDICATOR (source_object);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GError * error = NULL;
+    gchar * mirror = g_task_propagate_pointer (G_TASK (res), &error);
+
+    if (error != NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_debug ("Unable to build the icon cache: %s", error->message);
+        }
+
+        g_error_free (error);
+        return;
+    }
+
+    g_mutex_lock (&priv->item_lock);
+    unref_interned_string (priv->cached_icon_theme_path);
+    priv->cached_icon_theme_path = intern_string (mirror, FALSE);
+    g_mutex_unlock (&priv->item_lock);
+    g_free (mirror);
+
+    signal_new_icon_theme_path (self);
+
+    return;
+}
+
+/* Starts building the icon cache for the current theme path, if
+   wanted */
+static void
+icon_cache_update (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    const gchar * source;
+    GTask * task;
+
+    if (priv->icon_cache_cancellable != NULL) {
+        g_cancellable_cancel (priv->icon_cache_cancellable);
+        g_clear_object (&priv->icon_cache_cancellable);
+    }
+
+    source = priv->absolute_icon_theme_path ?
+             priv->absolute_icon_theme_path :
+             priv->icon_theme_path;
+
+    if (!priv->icon_cache_enabled || source == NULL) {
+        return;
+    }
+
+    priv->icon_cache_cancellable = g_cancellable_new ();
+
+    task = g_task_new (self, priv->icon_cache_cancellable, icon_cache_ready, NULL);
+    g_task_set_source_tag (task, icon_cache_update);
+    g_task_set_return_on_cancel (task, TRUE);
+    g_task_set_task_data (task, g_strdup (source), g_free);
+    g_task_run_in_thread (task, icon_cache_thread);
+    g_object_unref (task);
+
+    return;
+}
+
+/* Does the dbusmenu related work.  If there isn't a server, it builds
+   one and if there are menus it runs the parse to put those menus into
+   the server. */
+static void
+setup_dbusmenu (AppIndicator *self)
+{
+    DbusmenuMenuitem *root = NULL;
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    APP_INDICATOR_TRACE_BEGIN (setup_dbusmenu, priv->id);
+
+    if (priv->menu) {
+        root = dbusmenu_gtk_parse_menu_structure(priv->menu);
+    }
+
+    if (priv->menuservice == NULL) {
+        gchar * path = g_strdup_printf(DEFAULT_ITEM_PATH "/%s/Menu", priv->clean_id);
+        g_mutex_lock(&priv->item_lock);
+        priv->menuservice = dbusmenu_server_new (path);
+        g_mutex_unlock(&priv->item_lock);
+        g_free(path);
+    }
+
+    dbusmenu_server_set_root (priv->menuservice, root);
+
+    /* Drop our local ref as set_root should get it's own. */
+    if (root != NULL) {
+        g_object_unref(root);
+    }
+
+    APP_INDICATOR_TRACE_END (setup_dbusmenu, priv->id);
+
+    return;
+}
+
+/**
+ * app_indicator_set_menu:
+ * @self: The #AppIndicator
+ * @menu: (allow-none): A #GtkMenu to set
+ *
+ * Sets the menu that should be shown when the Application Indicator
+ * is clicked on in the panel.  An application indicator will not
+ * be rendered unless it has a menu.
+ *
+ * Wrapper function for property #AppIndicator:menu.
+ */
+void
+app_indicator_set_menu (AppIndicator *self, GtkMenu *menu)
+{
+  g_return_if_fail (APP_IS_INDICATOR (self));
+  g_return_if_fail (GTK_IS_MENU (menu));
+  stats_setter_call (self);
+
+  AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+  g_return_if_fail (priv->clean_id != NULL);
+
+  if (priv->menu != NULL)
+    {
+      g_object_unref (priv->menu);
     }
 
-    return FALSE;
-}
+  priv->menu = GTK_WIDGET (menu);
+  g_object_ref_sink (priv->menu);
 
-static void
-sec_activate_target_parent_changed(GtkWidget *menuitem, GtkWidget *old_parent,
-                                   gpointer data)
-{
-    g_return_if_fail(APP_IS_INDICATOR(data));
-    AppIndicator *self = APP_INDICATOR(data);
-    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
-    priv->sec_activate_enabled = widget_is_menu_child(self, menuitem);
-}
+  setup_dbusmenu (self);
 
+  priv->sec_activate_enabled = widget_is_menu_child (self, priv->sec_activate_target);
 
-/* ************************* */
-/*    Public Functions       */
-/* ************************* */
+  check_connect (self);
+
+  return;
+}
 
 /**
- * app_indicator_new:
- * @id: The unique id of the indicator to create.
- * @icon_name: The icon name for this indicator
- * @category: The category of indicator.
+ * app_indicator_set_ordering_index:
+ * @self: The #AppIndicator
+ * @ordering_index: A value for the ordering of this app indicator
  *
- * Creates a new #AppIndicator setting the properties:
- * #AppIndicator:id with @id, #AppIndicator:category with @category
- * and #AppIndicator:icon-name with @icon_name.
+ * Sets the ordering index for the app indicator which effects the
+ * placement of it on the panel.  For almost all app indicator
+ * this is not the function you're looking for.
  *
- * Return value: A pointer to a new #AppIndicator object.
+ * Wrapper function for property #AppIndicator:ordering-index.
  */
-AppIndicator *
-app_indicator_new (const gchar          *id,
-                   const gchar          *icon_name,
-                   AppIndicatorCategory  category)
+void
+app_indicator_set_ordering_index (AppIndicator *self, guint32 ordering_index)
 {
-  g_warning ("libayatana-appindicator is deprecated. Please use libayatana-appindicator-glib in newly written code.");
+    g_return_if_fail (APP_IS_INDICATOR (self));
 
-  AppIndicator *indicator = g_object_new (APP_INDICATOR_TYPE,
-                                          PROP_ID_S, id,
-                                          PROP_CATEGORY_S, category_from_enum (category),
-                                          PROP_ICON_NAME_S, icon_name,
-                                          NULL);
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_ORDERING_INDEX, mailbox_update_new (ordering_index, NULL, NULL, FALSE));
+        return;
+    }
 
-  return indicator;
+    stats_setter_call (self);
+
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_mutex_lock (&priv->item_lock);
+    priv->ordering_index = ordering_index;
+    g_mutex_unlock (&priv->item_lock);
+
+    state_page_update (self, NULL, NULL);
+
+    return;
 }
 
 /**
- * app_indicator_new_with_path:
- * @id: The unique id of the indicator to create.
- * @icon_name: The icon name for this indicator
- * @category: The category of indicator.
- * @icon_theme_path: A custom path for finding icons.
-
- * Creates a new #AppIndicator setting the properties:
- * #AppIndicator:id with @id, #AppIndicator:category with @category,
- * #AppIndicator:icon-name with @icon_name and #AppIndicator:icon-theme-path
- * with @icon_theme_path.
+ * app_indicator_set_secondary_activate_target:
+ * @self: The #AppIndicator
+ * @menuitem: (allow-none): A #GtkWidget to be activated on secondary activation
  *
- * Return value: A pointer to a new #AppIndicator object.
+ * Set the @menuitem to be activated when a secondary activation event (i.e. a
+ * middle-click) is emitted over the #AppIndicator icon/label.
+ *
+ * The @menuitem can be also a complex #GtkWidget, but to get activated when
+ * a secondary activation occurs in the #AppIndicator, it must be a visible and
+ * active child (or inner-child) of the #AppIndicator:menu.
+ *
+ * Setting @menuitem to %NULL causes to disable this feature.
  */
-AppIndicator *
-app_indicator_new_with_path (const gchar          *id,
-                             const gchar          *icon_name,
-                             AppIndicatorCategory  category,
-                             const gchar          *icon_theme_path)
+void
+app_indicator_set_secondary_activate_target (AppIndicator *self, GtkWidget *menuitem)
 {
-    g_warning ("libayatana-appindicator is deprecated. Please use libayatana-appindicator-glib in newly written code.");
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    AppIndicator *indicator = g_object_new (APP_INDICATOR_TYPE,
-                                            PROP_ID_S, id,
-                                            PROP_CATEGORY_S, category_from_enum (category),
-                                            PROP_ICON_NAME_S, icon_name,
-                                            PROP_ICON_THEME_PATH_S, icon_theme_path,
-                                            NULL);
+    if (priv->sec_activate_target) {
+        g_signal_handlers_disconnect_by_func (priv->sec_activate_target,
+                                              sec_activate_target_parent_changed,
+                                              self);
+        g_object_unref(G_OBJECT(priv->sec_activate_target));
+        priv->sec_activate_target = NULL;
+    }
 
-    return indicator;
+    if (menuitem == NULL) {
+        return;
+    }
+
+    g_return_if_fail (GTK_IS_WIDGET (menuitem));
+
+    priv->sec_activate_target = (GtkWidget*)g_object_ref(G_OBJECT(menuitem));
+    priv->sec_activate_enabled = widget_is_menu_child(self, menuitem);
+    g_signal_connect(menuitem, "parent-set", G_CALLBACK(sec_activate_target_parent_changed), self);
 }
 
 /**
- * app_indicator_get_type:
+ * app_indicator_set_item_is_menu:
+ * @self: The #AppIndicator
+ * @item_is_menu: %FALSE to have primary clicks signaled as #AppIndicator::activate
  *
- * Generates or returns the unique #GType for #AppIndicator.
+ * Tells the hosts whether a primary click on the indicator should
+ * show its menu, which is the default, or be handed to the application
+ * as #AppIndicator::activate.  Without a menu to show, the indicator
+ * no longer waits for app_indicator_set_menu() to be put on the bus.
  *
- * Return value: A unique #GType for #AppIndicator objects.
- */
-
-/**
- * app_indicator_set_status:
- * @self: The #AppIndicator object to use
- * @status: The status to set for this indicator
+ * Hosts read this when the indicator shows up on them, so it should
+ * be set before the indicator is connected.
  *
- * Wrapper function for property #AppIndicator:status.
+ * Wrapper function for property #AppIndicator:item-is-menu.
+ *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_status (AppIndicator *self, AppIndicatorStatus status)
+app_indicator_set_item_is_menu (AppIndicator *self, gboolean item_is_menu)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
+    stats_setter_call (self);
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    if (priv->status != status) {
-        GEnumValue *value = g_enum_get_value ((GEnumClass *) g_type_class_ref (APP_INDICATOR_TYPE_INDICATOR_STATUS), status);
+    item_is_menu = item_is_menu ? TRUE : FALSE;
+    if (priv->item_is_menu == item_is_menu) {
+        return;
+    }
 
-        priv->status = status;
-        g_signal_emit (self, signals[NEW_STATUS], 0, value->value_nick);
+    g_mutex_lock (&priv->item_lock);
+    priv->item_is_menu = item_is_menu;
+    g_mutex_unlock (&priv->item_lock);
 
-        if (priv->dbus_registration != 0 && priv->connection != NULL) {
-            GError * error = NULL;
-
-            g_dbus_connection_emit_signal(priv->connection,
-                                          NULL,
-                                          priv->path,
-                                          NOTIFICATION_ITEM_DBUS_IFACE,
-                                          "NewStatus",
-                                          g_variant_new("(s)", value->value_nick),
-                                          &error);
-
-            if (error != NULL) {
-                g_warning("Unable to send signal for NewStatus: %s", error->message);
-                g_error_free(error);
-            }
-        }
+    if (!item_is_menu) {
+        check_connect (self);
     }
 
     return;
 }
 
 /**
- * app_indicator_set_attention_icon:
- * @self: The #AppIndicator object to use
- * @icon_name: The name of the attention icon to set for this indicator
+ * app_indicator_set_unicast_signals:
+ * @self: The #AppIndicator
+ * @enabled: Whether to send the signals only to the known hosts
  *
- * Wrapper for app_indicator_set_attention_icon_full() with a NULL
- * description.
+ * Has the signals of the indicator sent only to the hosts that read
+ * its properties and to the names given to
+ * app_indicator_add_signal_consumer(), instead of to everybody on the
+ * bus that might be listening.  Until one of them is known the
+ * signals are broadcast as usual.
  *
- * Deprecated: Use app_indicator_set_attention_icon_full() instead.
+ * This is cheaper for the bus when there are many clients on it, but
+ * a host that never reads a property of the indicator will then miss
+ * its changes, so it is off by default.  Disabling it closes the
+ * connections opened with app_indicator_set_peer_channels_enabled().
+ *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_attention_icon (AppIndicator *self, const gchar *icon_name)
+app_indicator_set_unicast_signals (AppIndicator *self, gboolean enabled)
 {
-    return app_indicator_set_attention_icon_full(self, icon_name, NULL);
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GHashTableIter iter;
+    gpointer watch;
+
+    g_mutex_lock (&priv->item_lock);
+    priv->unicast_signals = enabled ? TRUE : FALSE;
+
+    /* The learned ones are learned again */
+    if (!priv->unicast_signals && priv->signal_consumers != NULL) {
+        g_hash_table_iter_init (&iter, priv->signal_consumers);
+        while (g_hash_table_iter_next (&iter, NULL, &watch)) {
+            if (watch != NULL) {
+                g_hash_table_iter_remove (&iter);
+            }
+        }
+    }
+    g_mutex_unlock (&priv->item_lock);
+
+    /* Their hosts would get the signals from the bus as well */
+    if (!priv->unicast_signals) {
+        g_clear_pointer (&priv->peers, g_ptr_array_unref);
+    }
+
+    icon_animation_hosts_changed (self);
+
+    return;
 }
 
 /**
- * app_indicator_set_attention_icon_full:
- * @self: The #AppIndicator object to use
- * @icon_name: The name of the attention icon to set for this indicator
- * @icon_desc: (nullable): A textual description of the icon
+ * app_indicator_add_signal_consumer:
+ * @self: The #AppIndicator
+ * @bus_name: A unique or well-known name on the session bus
  *
- * Wrapper function for property #AppIndicator:attention-icon-name.
+ * Adds @bus_name to the names that get the signals of the indicator
+ * when app_indicator_set_unicast_signals() is enabled, for consumers
+ * that don't read its properties.  It is kept until it is removed
+ * with app_indicator_remove_signal_consumer().
+ *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_attention_icon_full (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+app_indicator_add_signal_consumer (AppIndicator *self, const gchar *bus_name)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
-    g_return_if_fail (icon_name != NULL);
-    gboolean changed = FALSE;
-
+    g_return_if_fail (bus_name != NULL && g_dbus_is_name (bus_name));
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    if (g_strcmp0 (priv->attention_icon_name, icon_name) != 0) {
-        g_free (priv->attention_icon_name);
-        priv->attention_icon_name = g_strdup (icon_name);
-
-        g_free(priv->absolute_attention_icon_name);
-        priv->absolute_attention_icon_name = NULL;
-
-        if (icon_name && icon_name[0] == '/') {
-            priv->absolute_attention_icon_name = append_snap_prefix (icon_name);
-        }
-
-        changed = TRUE;
-    }
-
-    if (g_strcmp0(priv->att_accessible_desc, icon_desc) != 0) {
-        g_free (priv->att_accessible_desc);
-        priv->att_accessible_desc = g_strdup (icon_desc);
-        changed = TRUE;
+    /* A learned name becomes one of the application's */
+    g_mutex_lock (&priv->item_lock);
+    if (priv->signal_consumers != NULL) {
+        g_hash_table_remove (priv->signal_consumers, bus_name);
     }
+    g_mutex_unlock (&priv->item_lock);
 
-    if (changed) {
-        g_signal_emit (self, signals[NEW_ATTENTION_ICON], 0);
-
-        if (priv->dbus_registration != 0 && priv->connection != NULL) {
-            GError * error = NULL;
-
-            g_dbus_connection_emit_signal(priv->connection,
-                                          NULL,
-                                          priv->path,
-                                          NOTIFICATION_ITEM_DBUS_IFACE,
-                                          "NewAttentionIcon",
-                                          NULL,
-                                          &error);
-
-            if (error != NULL) {
-                g_warning("Unable to send signal for NewAttentionIcon: %s", error->message);
-                g_error_free(error);
-            }
-        }
-    }
+    consumer_add (self, bus_name, FALSE);
 
     return;
 }
 
 /**
- * app_indicator_set_icon:
- * @self: The #AppIndicator object to use
- * @icon_name: The icon name to set.
+ * app_indicator_remove_signal_consumer:
+ * @self: The #AppIndicator
+ * @bus_name: A name given to app_indicator_add_signal_consumer()
  *
- * Wrapper function for app_indicator_set_icon_full() with a NULL
- * description.
+ * Stops sending the signals of the indicator to @bus_name.  It is
+ * learned again if it reads a property of the indicator while
+ * app_indicator_set_unicast_signals() is enabled.
  *
- * Deprecated: Use app_indicator_set_icon_full()
+ * Since: 0.5.95
  */
 void
-app_indicator_set_icon (AppIndicator *self, const gchar *icon_name)
+app_indicator_remove_signal_consumer (AppIndicator *self, const gchar *bus_name)
 {
-    return app_indicator_set_icon_full(self, icon_name, NULL);
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    g_return_if_fail (bus_name != NULL);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_mutex_lock (&priv->item_lock);
+    if (priv->signal_consumers != NULL) {
+        g_hash_table_remove (priv->signal_consumers, bus_name);
+    }
+    g_mutex_unlock (&priv->item_lock);
+
+    icon_animation_hosts_changed (self);
+
+    return;
 }
 
 /**
- * app_indicator_set_icon_full:
- * @self: The #AppIndicator object to use
- * @icon_name: The icon name to set.
- * @icon_desc: (nullable): A textual description of the icon for accessibility
+ * app_indicator_set_peer_channels_enabled:
+ * @self: The #AppIndicator
+ * @enabled: Whether hosts can ask for a connection of their own
  *
- * Sets the default icon to use when the status is active but
- * not set to attention.  In most cases, this should be the
- * application icon for the program.
+ * Lets hosts ask for a private connection to the indicator with the
+ * XAyatanaOpenPeerChannel method, which answers with the address to
+ * connect to.  The indicator's object is served on that connection
+ * as well and its signals are sent over it directly, without going
+ * through the bus daemon, which is worth it for indicators that
+ * change many times a second.  It stays on the bus for everybody
+ * else.  Hosts only get a connection of their own while
+ * app_indicator_set_unicast_signals() is enabled, so they don't get
+ * the signals from the bus as well.
  *
- * Wrapper function for property #AppIndicator:icon-name and
- * #AppIndicator:icon-desc.
+ * Disabling it closes the open connections.
+ *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_icon_full (AppIndicator *self, const gchar *icon_name, const gchar * icon_desc)
+app_indicator_set_peer_channels_enabled (AppIndicator *self, gboolean enabled)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
-    g_return_if_fail (icon_name != NULL);
-    gboolean changed = FALSE;
-
+    stats_setter_call (self);
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    if (g_strcmp0 (priv->icon_name, icon_name) != 0) {
-        if (priv->icon_name) {
-            g_free (priv->icon_name);
-        }
-
-        priv->icon_name = g_strdup(icon_name);
-
-        g_free(priv->absolute_icon_name);
-        priv->absolute_icon_name = NULL;
+    priv->peer_channels_enabled = enabled ? TRUE : FALSE;
 
-        if (icon_name && icon_name[0] == '/') {
-            priv->absolute_icon_name = append_snap_prefix (icon_name);
-        }
-
-        changed = TRUE;
+    if (!priv->peer_channels_enabled) {
+        g_clear_pointer (&priv->peers, g_ptr_array_unref);
     }
 
-    if (g_strcmp0(priv->accessible_desc, icon_desc) != 0) {
-        if (priv->accessible_desc != NULL) {
-            g_free(priv->accessible_desc);
-        }
+    return;
+}
 
-        priv->accessible_desc = g_strdup(icon_desc);
-        changed = TRUE;
-    }
+/**
+ * app_indicator_set_state_page_enabled:
+ * @self: The #AppIndicator
+ * @enabled: Whether hosts can ask for the state page
+ *
+ * Lets hosts ask for the state page with the XAyatanaGetStatePage
+ * method, which answers with a file descriptor of shared memory the
+ * indicator keeps its status, ordering index and label on, with a
+ * count of the changes of everything else.  A host that polls many
+ * indicators reads it without a round trip on the bus and only
+ * listens to the signals to be woken up.
+ *
+ * Disabling it marks the page as closed for the hosts that have it.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_state_page_enabled (AppIndicator *self, gboolean enabled)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    stats_setter_call (self);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    if (changed) {
-        g_signal_emit (self, signals[NEW_ICON], 0);
+    priv->state_page_enabled = enabled ? TRUE : FALSE;
 
-        if (priv->dbus_registration != 0 && priv->connection != NULL) {
-            GError * error = NULL;
-
-            g_dbus_connection_emit_signal(priv->connection,
-                                          NULL,
-                                          priv->path,
-                                          NOTIFICATION_ITEM_DBUS_IFACE,
-                                          "NewIcon",
-                                          NULL,
-                                          &error);
-
-            if (error != NULL) {
-                g_warning("Unable to send signal for NewIcon: %s", error->message);
-                g_error_free(error);
-            }
-        }
+    if (!priv->state_page_enabled) {
+        state_page_close (self);
     }
 
     return;
 }
 
 /**
- * app_indicator_set_label:
- * @self: The #AppIndicator object to use
- * @label: The label to show next to the icon.
- * @guide: A guide to size the label correctly.
+ * app_indicator_set_title:
+ * @self: The #AppIndicator
+ * @title: (allow-none): Title of the app indicator
+ *
+ * Sets the title of the application indicator, or how it should be referred
+ * in a human readable form.  This string should be UTF-8 and localized as it
+ * expected that users will set it.
+ *
+ * In the Unity desktop the most prominent place that this is show will be
+ * in the HUD.  HUD listings for this application indicator will start with
+ * the title as the first part of the line for the menu items.
  *
- * This is a wrapper function for the #AppIndicator:label and
- * #AppIndicator:label-guide properties.  This function can take #NULL
- * as either @label or @guide and will clear the entries.
-*/
+ * Setting @title to %NULL removes the title.
+ *
+ * Since: 0.5
+ *
+ */
 void
-app_indicator_set_label (AppIndicator *self, const gchar * label, const gchar * guide)
+app_indicator_set_title (AppIndicator *self, const gchar * title)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
-    /* Note: The label can be NULL, it's okay */
-    /* Note: The guide can be NULL, it's okay */
+
+    if (!in_owner_context (self)) {
+        mailbox_post (self, MAILBOX_TITLE, mailbox_update_new (0, title, NULL, FALSE));
+        return;
+    }
+
+    stats_setter_call (self);
 
     g_object_set(G_OBJECT(self),
-                 PROP_LABEL_S,       label == NULL ? "" : label,
-                 PROP_LABEL_GUIDE_S, guide == NULL ? "" : guide,
+                 PROP_TITLE_S, title == NULL ? "": title,
                  NULL);
 
     return;
 }
 
-static const gchar *
-get_snap_prefix ()
-{
-    const gchar *snap = g_getenv ("SNAP");
-    return (snap && *snap != '\0') ? snap : NULL;
-}
-
-static gchar *
-append_snap_prefix (const gchar *path)
+/* Takes over @provider, the old one goes once a running call of it
+   returns */
+static void
+tooltip_provider_replace (AppIndicator * self, Provider * provider)
 {
-    gint i;
-    const gchar *snap = get_snap_prefix ();
-    g_autofree gchar *canon_path = NULL;
-
-    if (snap != NULL && path != NULL) {
-        canon_path = realpath(path, NULL);
-
-        if (g_str_has_prefix (canon_path, "/tmp/")) {
-            g_warning ("Using '/tmp' paths in SNAP environment will lead to unreadable resources");
-            return NULL;
-        }
-
-        if (g_str_has_prefix (canon_path, snap) ||
-            g_str_has_prefix (canon_path, g_get_home_dir ()) ||
-            g_str_has_prefix (canon_path, g_get_user_cache_dir ()) ||
-            g_str_has_prefix (canon_path, g_get_user_config_dir ()) ||
-            g_str_has_prefix (canon_path, g_get_user_data_dir ()) ||
-            g_str_has_prefix (canon_path, g_get_user_runtime_dir ())) {
-            return g_strdup (canon_path);
-        }
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    Provider * old;
 
-        for (i = 0; i < G_USER_N_DIRECTORIES; ++ i) {
-            if (g_str_has_prefix (canon_path, g_get_user_special_dir (i))) {
-                return g_strdup (canon_path);
-            }
-        }
+    g_mutex_lock(&priv->item_lock);
+    old = priv->tooltip_provider;
+    priv->tooltip_provider = provider;
+    g_mutex_unlock(&priv->item_lock);
 
-        return g_build_path (G_DIR_SEPARATOR_S, snap, canon_path, NULL);
+    if (old != NULL) {
+        provider_unref(old);
     }
 
-    return NULL;
+    return;
 }
 
-static gchar *
-get_real_theme_path (AppIndicator * self)
+/* Replaces the tooltip, @dirty has the provider make a new one when
+   it is read.  Hosts are only told when something changed. */
+static void
+tooltip_replace (AppIndicator * self, GVariant * tooltip, gboolean dirty)
 {
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    GVariant * old;
+    gboolean was_dirty;
+
+    g_mutex_lock(&priv->item_lock);
+    old = priv->tooltip;
+    was_dirty = priv->tooltip_dirty;
+    priv->tooltip = tooltip;
+    priv->tooltip_dirty = dirty;
+    priv->tooltip_serial++;
+    g_mutex_unlock(&priv->item_lock);
+
+    if (old == NULL && tooltip == NULL && dirty == was_dirty) {
+        return;
+    }
 
-    const gchar *theme_path = priv->icon_theme_path;
-    gchar *snapped_path = append_snap_prefix (theme_path);
+    if (old != NULL) {
+        g_variant_unref(old);
+    }
 
-    if (snapped_path != NULL) {
-        return snapped_path;
-    } else if (get_snap_prefix ()) {
-        return g_build_path (G_DIR_SEPARATOR_S, g_get_user_data_dir (), "icons", NULL);
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal(self, "NewToolTip", NULL);
     }
 
-    return NULL;
+    return;
 }
 
 /**
- * app_indicator_set_icon_theme_path:
+ * app_indicator_set_tooltip:
  * @self: The #AppIndicator object to use
- * @icon_theme_path: The icon theme path to set.
+ * @icon_name: (allow-none): The icon to show in the tooltip.
+ * @title: (allow-none): The title of the tooltip.
+ * @description: (allow-none): The text of the tooltip, it can use the
+ *     markup that hosts support.
  *
- * Sets the path to use when searching for icons.
+ * Sets the tooltip that hosts show when the pointer is over the
+ * indicator.  This replaces a provider set with
+ * app_indicator_set_tooltip_provider().
+ *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_icon_theme_path (AppIndicator *self, const gchar *icon_theme_path)
+app_indicator_set_tooltip (AppIndicator *self, const gchar * icon_name, const gchar * title, const gchar * description)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
-    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    stats_setter_call (self);
 
-    if (g_strcmp0 (priv->icon_theme_path, icon_theme_path) != 0) {
-        if (priv->icon_theme_path != NULL)
-            g_free(priv->icon_theme_path);
+    tooltip_provider_replace (self, NULL);
+    tooltip_replace (self, tooltip_new (icon_name, title, description), FALSE);
 
-        priv->icon_theme_path = g_strdup(icon_theme_path);
-
-        g_free (priv->absolute_icon_theme_path);
-        priv->absolute_icon_theme_path = get_real_theme_path (self);
+    return;
+}
 
-        g_signal_emit (self, signals[NEW_ICON_THEME_PATH], 0, priv->icon_theme_path);
+/**
+ * app_indicator_set_tooltip_provider:
+ * @self: The #AppIndicator object to use
+ * @func: (allow-none): Makes the tooltip.
+ * @user_data: Data for @func.
+ * @destroy: (allow-none): Frees @user_data.
+ *
+ * Has the tooltip made by @func when a host reads it, which is
+ * usually when the pointer is over the indicator.  The tooltip is kept
+ * until app_indicator_invalidate_tooltip() is called, so a tooltip
+ * that changes often costs nothing while nobody looks at it.  @func is
+ * only called in the context of the indicator, a host reading the
+ * tooltip from the context the D-Bus object is served from, see
+ * #AppIndicator:dbus-context, gets the last one and is told again once
+ * the new one is made.  @destroy is called once @func is replaced and
+ * no longer running.  A %NULL @func clears the tooltip the last
+ * provider made.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_tooltip_provider (AppIndicator *self, AppIndicatorTooltipFunc func, gpointer user_data, GDestroyNotify destroy)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
 
-        if (priv->dbus_registration != 0 && priv->connection != NULL) {
-            const gchar *theme_path = priv->absolute_icon_theme_path ?
-                                        priv->absolute_icon_theme_path :
-                                        priv->icon_theme_path;
-            GError * error = NULL;
-
-            g_dbus_connection_emit_signal(priv->connection,
-                                          NULL,
-                                          priv->path,
-                                          NOTIFICATION_ITEM_DBUS_IFACE,
-                                          "NewIconThemePath",
-                                          g_variant_new("(s)", theme_path ? theme_path : ""),
-                                          &error);
-
-            if (error != NULL) {
-                g_warning("Unable to send signal for NewIconThemePath: %s", error->message);
-                g_error_free(error);
-            }
-        }
-    }
+    tooltip_provider_replace (self, provider_new (G_CALLBACK (func), user_data, destroy));
+    tooltip_replace (self, NULL, func != NULL);
 
     return;
 }
 
-/* Does the dbusmenu related work.  If there isn't a server, it builds
-   one and if there are menus it runs the parse to put those menus into
-   the server. */
-static void
-setup_dbusmenu (AppIndicator *self)
+/**
+ * app_indicator_invalidate_tooltip:
+ * @self: The #AppIndicator object to use
+ *
+ * Tells the indicator that the provider set with
+ * app_indicator_set_tooltip_provider() would make a different tooltip
+ * now.  Hosts are told once, the provider is called when one of them
+ * reads the tooltip.
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_invalidate_tooltip (AppIndicator *self)
 {
-    DbusmenuMenuitem *root = NULL;
-
+    g_return_if_fail (APP_IS_INDICATOR (self));
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    gboolean was_dirty;
 
-    if (priv->menu) {
-        root = dbusmenu_gtk_parse_menu_structure(priv->menu);
-    }
-
-    if (priv->menuservice == NULL) {
-        gchar * path = g_strdup_printf(DEFAULT_ITEM_PATH "/%s/Menu", priv->clean_id);
-        priv->menuservice = dbusmenu_server_new (path);
-        g_free(path);
-    }
-
-    dbusmenu_server_set_root (priv->menuservice, root);
+    /* The last tooltip is kept for the hosts until the new one is made */
+    g_mutex_lock (&priv->item_lock);
+    was_dirty = priv->tooltip_dirty || priv->tooltip_provider == NULL;
+    priv->tooltip_dirty = priv->tooltip_provider != NULL;
+    priv->tooltip_serial++;
+    g_mutex_unlock (&priv->item_lock);
 
-    /* Drop our local ref as set_root should get it's own. */
-    if (root != NULL) {
-        g_object_unref(root);
+    if (!was_dirty && priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal (self, "NewToolTip", NULL);
     }
 
     return;
 }
 
 /**
- * app_indicator_set_menu:
- * @self: The #AppIndicator
- * @menu: (allow-none): A #GtkMenu to set
+ * app_indicator_set_label_provider:
+ * @self: The #AppIndicator object to use
+ * @func: (allow-none): Makes the label.
+ * @user_data: Data for @func.
+ * @destroy: (allow-none): Frees @user_data.
  *
- * Sets the menu that should be shown when the Application Indicator
- * is clicked on in the panel.  An application indicator will not
- * be rendered unless it has a menu.
+ * Has the label made by @func instead of setting it for every change.
+ * After app_indicator_invalidate_label() @func is called once, when
+ * the label change goes out or when a host or app_indicator_get_label()
+ * reads it, whichever comes first.  @func is only called in the
+ * context of the indicator, a host reading the label from the context
+ * the D-Bus object is served from gets the last one until the label
+ * change goes out.  @destroy is called once @func is replaced and no
+ * longer running.  Setting a label or a label template removes the
+ * provider.
  *
- * Wrapper function for property #AppIndicator:menu.
+ * Since: 0.5.95
  */
 void
-app_indicator_set_menu (AppIndicator *self, GtkMenu *menu)
+app_indicator_set_label_provider (AppIndicator *self, AppIndicatorTextFunc func, gpointer user_data, GDestroyNotify destroy)
 {
-  g_return_if_fail (APP_IS_INDICATOR (self));
-  g_return_if_fail (GTK_IS_MENU (menu));
-
-  AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-  g_return_if_fail (priv->clean_id != NULL);
+    g_clear_pointer (&priv->label_template, g_free);
+    text_provider_set (self, &priv->label_provider, func, user_data, destroy);
 
-  if (priv->menu != NULL)
-    {
-      g_object_unref (priv->menu);
+    if (func != NULL) {
+        signal_label_change (self);
     }
 
-  priv->menu = GTK_WIDGET (menu);
-  g_object_ref_sink (priv->menu);
-
-  setup_dbusmenu (self);
-
-  priv->sec_activate_enabled = widget_is_menu_child (self, priv->sec_activate_target);
-
-  check_connect (self);
-
-  return;
+    return;
 }
 
 /**
- * app_indicator_set_ordering_index:
- * @self: The #AppIndicator
- * @ordering_index: A value for the ordering of this app indicator
+ * app_indicator_invalidate_label:
+ * @self: The #AppIndicator object to use
  *
- * Sets the ordering index for the app indicator which effects the
- * placement of it on the panel.  For almost all app indicator
- * this is not the function you're looking for.
+ * Tells the indicator that the provider set with
+ * app_indicator_set_label_provider() would make a different label now.
+ * Any number of calls before the label is made again cost the same
+ * as one.
  *
- * Wrapper function for property #AppIndicator:ordering-index.
+ * Since: 0.5.95
  */
 void
-app_indicator_set_ordering_index (AppIndicator *self, guint32 ordering_index)
+app_indicator_invalidate_label (AppIndicator *self)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
-
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    priv->ordering_index = ordering_index;
+    if (g_atomic_pointer_get (&priv->label_provider.provider) != NULL &&
+        g_atomic_int_compare_and_exchange (&priv->label_provider.dirty, FALSE, TRUE)) {
+        signal_label_change (self);
+    }
 
     return;
 }
 
 /**
- * app_indicator_set_secondary_activate_target:
- * @self: The #AppIndicator
- * @menuitem: (allow-none): A #GtkWidget to be activated on secondary activation
- *
- * Set the @menuitem to be activated when a secondary activation event (i.e. a
- * middle-click) is emitted over the #AppIndicator icon/label.
+ * app_indicator_set_title_provider:
+ * @self: The #AppIndicator object to use
+ * @func: (allow-none): Makes the title.
+ * @user_data: Data for @func.
+ * @destroy: (allow-none): Frees @user_data.
  *
- * The @menuitem can be also a complex #GtkWidget, but to get activated when
- * a secondary activation occurs in the #AppIndicator, it must be a visible and
- * active child (or inner-child) of the #AppIndicator:menu.
+ * Has the title made by @func when it is read by a host or with
+ * app_indicator_get_title(), after app_indicator_invalidate_title().
+ * Hosts are only told that the title changed, so @func runs as often
+ * as they read it.  @func is only called in the context of the
+ * indicator, a host reading the title from the context the D-Bus
+ * object is served from gets the last one and is told again once the
+ * new one is made.  @destroy is called once @func is replaced and no
+ * longer running.  Setting a title removes the provider.
  *
- * Setting @menuitem to %NULL causes to disable this feature.
+ * Since: 0.5.95
  */
 void
-app_indicator_set_secondary_activate_target (AppIndicator *self, GtkWidget *menuitem)
+app_indicator_set_title_provider (AppIndicator *self, AppIndicatorTextFunc func, gpointer user_data, GDestroyNotify destroy)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    if (priv->sec_activate_target) {
-        g_signal_handlers_disconnect_by_func (priv->sec_activate_target,
-                                              sec_activate_target_parent_changed,
-                                              self);
-        g_object_unref(G_OBJECT(priv->sec_activate_target));
-        priv->sec_activate_target = NULL;
-    }
+    text_provider_set (self, &priv->title_provider, func, user_data, destroy);
 
-    if (menuitem == NULL) {
-        return;
+    if (func != NULL && priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal (self, "NewTitle", NULL);
     }
 
-    g_return_if_fail (GTK_IS_WIDGET (menuitem));
-
-    priv->sec_activate_target = (GtkWidget*)g_object_ref(G_OBJECT(menuitem));
-    priv->sec_activate_enabled = widget_is_menu_child(self, menuitem);
-    g_signal_connect(menuitem, "parent-set", G_CALLBACK(sec_activate_target_parent_changed), self);
+    return;
 }
 
 /**
- * app_indicator_set_title:
- * @self: The #AppIndicator
- * @title: (allow-none): Title of the app indicator
- *
- * Sets the title of the application indicator, or how it should be referred
- * in a human readable form.  This string should be UTF-8 and localized as it
- * expected that users will set it.
- *
- * In the Unity desktop the most prominent place that this is show will be
- * in the HUD.  HUD listings for this application indicator will start with
- * the title as the first part of the line for the menu items.
- *
- * Setting @title to %NULL removes the title.
+ * app_indicator_invalidate_title:
+ * @self: The #AppIndicator object to use
  *
- * Since: 0.5
+ * Tells the indicator that the provider set with
+ * app_indicator_set_title_provider() would make a different title now.
+ * Hosts are told once, until one of them reads the title again.
  *
+ * Since: 0.5.95
  */
 void
-app_indicator_set_title (AppIndicator *self, const gchar * title)
+app_indicator_invalidate_title (AppIndicator *self)
 {
     g_return_if_fail (APP_IS_INDICATOR (self));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
-    g_object_set(G_OBJECT(self),
-                 PROP_TITLE_S, title == NULL ? "": title,
-                 NULL);
+    if (g_atomic_pointer_get (&priv->title_provider.provider) == NULL ||
+        !g_atomic_int_compare_and_exchange (&priv->title_provider.dirty, FALSE, TRUE)) {
+        return;
+    }
+
+    if (priv->dbus_registration != 0 && priv->connection != NULL) {
+        emit_bus_signal (self, "NewTitle", NULL);
+    }
 
     return;
 }
@@ -2544,6 +7224,7 @@ app_indicator_get_title (AppIndicator *self)
 {
     g_return_val_if_fail (APP_IS_INDICATOR (self), NULL);
     AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    title_provider_update (self);
     return priv->title;
 }
 
@@ -2581,6 +7262,7 @@ app_indicator_get_label (AppIndicator *self)
   g_return_val_if_fail (APP_IS_INDICATOR (self), NULL);
   AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
 
+  label_provider_update (self);
   return priv->label;
 }
 
@@ -2639,6 +7321,152 @@ app_indicator_get_secondary_activate_target (AppIndicator *self)
     return GTK_WIDGET(priv->sec_activate_target);
 }
 
+/**
+ * app_indicator_get_item_is_menu:
+ * @self: The #AppIndicator object to use
+ *
+ * Wrapper function for property #AppIndicator:item-is-menu.
+ *
+ * Return value: Whether a primary click shows the menu.
+ *
+ * Since: 0.5.95
+ */
+gboolean
+app_indicator_get_item_is_menu (AppIndicator *self)
+{
+    g_return_val_if_fail (APP_IS_INDICATOR (self), TRUE);
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    return priv->item_is_menu;
+}
+
+/* Counts a call to one of the public setters */
+static void
+stats_setter_call (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    STATS_ADD(priv->stats.setter_calls, 1);
+    return;
+}
+
+/* Puts the time since @start into its bucket of @histogram */
+static void
+stats_record_latency (guint64 * histogram, gint64 start)
+{
+    guint64 elapsed = (guint64) (g_get_monotonic_time () - start);
+    guint bucket;
+
+    for (bucket = 0; bucket < STATS_LATENCY_BUCKETS - 1; bucket++) {
+        if (elapsed < stats_latency_bounds[bucket]) {
+            break;
+        }
+    }
+
+    STATS_ADD(histogram[bucket], 1);
+    return;
+}
+
+/* Builds the floating a{sv} that is handed out by both
+   app_indicator_get_statistics() and XAyatanaGetStats */
+static GVariant *
+stats_to_variant (AppIndicator * self)
+{
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+    AppIndicatorStats * stats = &priv->stats;
+    guint64 scroll_latency[STATS_LATENCY_BUCKETS];
+    guint64 secondary_activate_latency[STATS_LATENCY_BUCKETS];
+    GVariantBuilder builder;
+    guint64 interned;
+    guint bucket;
+
+    G_LOCK (interned_strings);
+    interned = interned_strings_made;
+    G_UNLOCK (interned_strings);
+
+    for (bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+        scroll_latency[bucket] = STATS_GET (stats->scroll_latency[bucket]);
+        secondary_activate_latency[bucket] = STATS_GET (stats->secondary_activate_latency[bucket]);
+    }
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", "setter-calls", g_variant_new_uint64 (STATS_GET (stats->setter_calls)));
+    g_variant_builder_add (&builder, "{sv}", "signals-emitted", g_variant_new_uint64 (STATS_GET (stats->signals_emitted)));
+    g_variant_builder_add (&builder, "{sv}", "signals-coalesced", g_variant_new_uint64 (STATS_GET (stats->signals_coalesced)));
+    g_variant_builder_add (&builder, "{sv}", "signals-suppressed", g_variant_new_uint64 (STATS_GET (stats->signals_suppressed)));
+    g_variant_builder_add (&builder, "{sv}", "property-gets", g_variant_new_uint64 (STATS_GET (stats->property_gets)));
+    g_variant_builder_add (&builder, "{sv}", "method-calls", g_variant_new_uint64 (STATS_GET (stats->method_calls)));
+    g_variant_builder_add (&builder, "{sv}", "registrations", g_variant_new_uint64 (STATS_GET (stats->registrations)));
+    g_variant_builder_add (&builder, "{sv}", "fallbacks", g_variant_new_uint64 (STATS_GET (stats->fallbacks)));
+    g_variant_builder_add (&builder, "{sv}", "unfallbacks", g_variant_new_uint64 (STATS_GET (stats->unfallbacks)));
+    g_variant_builder_add (&builder, "{sv}", "bytes-sent", g_variant_new_uint64 (STATS_GET (stats->bytes_sent)));
+    g_variant_builder_add (&builder, "{sv}", "interned-strings", g_variant_new_uint64 (interned));
+    g_variant_builder_add (&builder, "{sv}", "latency-bounds-us",
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, stats_latency_bounds,
+                                                      STATS_LATENCY_BUCKETS - 1, sizeof (guint64)));
+    g_variant_builder_add (&builder, "{sv}", "scroll-latency",
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, scroll_latency,
+                                                      STATS_LATENCY_BUCKETS, sizeof (guint64)));
+    g_variant_builder_add (&builder, "{sv}", "secondary-activate-latency",
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, secondary_activate_latency,
+                                                      STATS_LATENCY_BUCKETS, sizeof (guint64)));
+
+    return g_variant_builder_end (&builder);
+}
+
+/**
+ * app_indicator_get_statistics:
+ * @self: The #AppIndicator object to use
+ *
+ * Gets the counters the indicator keeps about its own activity, as a
+ * dictionary of #guint64 values: "setter-calls", "signals-emitted",
+ * "signals-coalesced", "signals-suppressed", "property-gets",
+ * "method-calls", "registrations", "fallbacks", "unfallbacks" and
+ * "bytes-sent", which is the approximate size of the signals sent to
+ * the bus.  Signals are suppressed while the watcher has no
+ * StatusNotifierHost.  "interned-strings" counts the icon names and
+ * descriptions ever allocated by all the indicators of the process,
+ * the ones in use are shared.
+ *
+ * The time taken to handle the Scroll and SecondaryActivate methods is
+ * kept in the "scroll-latency" and "secondary-activate-latency" arrays,
+ * each entry counting the calls that took less than the matching
+ * entry of "latency-bounds-us" microseconds, and the last one counting
+ * all of the slower ones.
+ *
+ * Return value: (transfer full): A #GVariant of type a{sv}
+ *
+ * Since: 0.5.95
+ */
+GVariant *
+app_indicator_get_statistics (AppIndicator *self)
+{
+    g_return_val_if_fail (APP_IS_INDICATOR (self), NULL);
+
+    return g_variant_ref_sink (stats_to_variant (self));
+}
+
+/**
+ * app_indicator_set_statistics_enabled:
+ * @self: The #AppIndicator object to use
+ * @enabled: Whether the statistics can be read over the bus
+ *
+ * Allows other processes to read the statistics of the indicator
+ * with the XAyatanaGetStats method, which is refused otherwise.
+ * Setting AYATANA_APPINDICATOR_STATS in the environment enables
+ * this for every indicator.  See app_indicator_get_statistics().
+ *
+ * Since: 0.5.95
+ */
+void
+app_indicator_set_statistics_enabled (AppIndicator *self, gboolean enabled)
+{
+    g_return_if_fail (APP_IS_INDICATOR (self));
+    AppIndicatorPrivate * priv = app_indicator_get_instance_private(self);
+
+    g_atomic_int_set (&priv->stats_enabled, enabled);
+    return;
+}
+
 #define APP_INDICATOR_SHORTY_NICK "app-indicator-shorty-nick"
 
 /* Callback when an item from the desktop shortcuts gets
@@ -2705,7 +7533,9 @@ app_indicator_build_menu_from_desktop (AppIndicator * self, const gchar * deskto
     /* Swap it if needed */
     if (priv->menuservice == NULL) {
         gchar * path = g_strdup_printf(DEFAULT_ITEM_PATH "/%s/Menu", priv->clean_id);
+        g_mutex_lock(&priv->item_lock);
         priv->menuservice = dbusmenu_server_new (path);
+        g_mutex_unlock(&priv->item_lock);
         g_free(path);
     }
 
@@ -112,6 +112,16 @@ G_BEGIN_DECLS
  *
  * String identifier for the #AppIndicator::scroll-event signal.
  */
+/**
+ * APP_INDICATOR_SIGNAL_SMOOTH_SCROLL:
+ *
+ * String identifier for the #AppIndicator::smooth-scroll signal.
+ */
+/**
+ * APP_INDICATOR_SIGNAL_ACTIVATE:
+ *
+ * String identifier for the #AppIndicator::activate signal.
+ */
 #define APP_INDICATOR_SIGNAL_NEW_ICON            "new-icon"
 #define APP_INDICATOR_SIGNAL_NEW_ATTENTION_ICON  "new-attention-icon"
 #define APP_INDICATOR_SIGNAL_NEW_STATUS          "new-status"
@@ -119,6 +129,8 @@ G_BEGIN_DECLS
 #define APP_INDICATOR_SIGNAL_CONNECTION_CHANGED  "connection-changed"
 #define APP_INDICATOR_SIGNAL_NEW_ICON_THEME_PATH "new-icon-theme-path"
 #define APP_INDICATOR_SIGNAL_SCROLL_EVENT        "scroll-event"
+#define APP_INDICATOR_SIGNAL_SMOOTH_SCROLL       "smooth-scroll"
+#define APP_INDICATOR_SIGNAL_ACTIVATE            "activate"
 
 /**
  * AppIndicatorCategory:
@@ -159,6 +171,39 @@ typedef enum { /*< prefix=APP_INDICATOR_STATUS >*/
 typedef struct _AppIndicator        AppIndicator;
 typedef struct _AppIndicatorClass   AppIndicatorClass;
 
+/**
+ * AppIndicatorTooltipFunc:
+ * @indicator: The #AppIndicator whose tooltip is read
+ * @icon_name: (out) (transfer full): Return location for the icon name of the tooltip
+ * @title: (out) (transfer full): Return location for the title of the tooltip
+ * @description: (out) (transfer full): Return location for the text of the tooltip
+ * @user_data: The data given to app_indicator_set_tooltip_provider()
+ *
+ * Makes the tooltip when a host reads it, see
+ * app_indicator_set_tooltip_provider().  Any of the return
+ * locations can be left %NULL.
+ */
+typedef void (*AppIndicatorTooltipFunc) (AppIndicator  *indicator,
+                                         gchar        **icon_name,
+                                         gchar        **title,
+                                         gchar        **description,
+                                         gpointer       user_data);
+
+/**
+ * AppIndicatorTextFunc:
+ * @indicator: The #AppIndicator that needs the text
+ * @user_data: The data given with the function
+ *
+ * Makes the label or the title of @indicator when it is needed, see
+ * app_indicator_set_label_provider() and
+ * app_indicator_set_title_provider().
+ *
+ * Return value: (transfer full) (allow-none): The new text, freed by
+ *     the indicator.
+ */
+typedef gchar * (*AppIndicatorTextFunc) (AppIndicator  *indicator,
+                                         gpointer       user_data);
+
 /**
  * AppIndicatorClass:
  * @parent_class: Mia familia
@@ -255,6 +300,22 @@ AppIndicator                   *app_indicator_new_with_path      (const gchar
                                                                   const gchar          *icon_name,
                                                                   AppIndicatorCategory  category,
                                                                   const gchar          *icon_theme_path) G_GNUC_DEPRECATED;
+AppIndicator                   *app_indicator_new_with_context   (const gchar          *id,
+                                                                  const gchar          *icon_name,
+                                                                  AppIndicatorCategory  category,
+                                                                  GMainContext         *context) G_GNUC_DEPRECATED;
+void                            app_indicator_new_async          (const gchar          *id,
+                                                                  const gchar          *icon_name,
+                                                                  AppIndicatorCategory  category,
+                                                                  GtkMenu              *menu,
+                                                                  GCancellable         *cancellable,
+                                                                  GAsyncReadyCallback   callback,
+                                                                  gpointer              user_data) G_GNUC_DEPRECATED;
+AppIndicator                   *app_indicator_new_finish         (GAsyncResult         *result,
+                                                                  gint64               *elapsed_us,
+                                                                  GError              **error) G_GNUC_DEPRECATED;
+void                            app_indicator_dispose_many       (AppIndicator        **indicators,
+                                                                  guint                 n_indicators);
 
 /* Set properties */
 void                            app_indicator_set_status         (AppIndicator       *self,
@@ -264,6 +325,9 @@ void                            app_indicator_set_attention_icon (AppIndicator
 void                            app_indicator_set_attention_icon_full (AppIndicator       *self,
                                                                   const gchar        *icon_name,
                                                                   const gchar        *icon_desc);
+void                            app_indicator_set_attention_icon_full_static (AppIndicator       *self,
+                                                                  const gchar        *icon_name,
+                                                                  const gchar        *icon_desc);
 void                            app_indicator_set_menu           (AppIndicator       *self,
                                                                   GtkMenu            *menu);
 void                            app_indicator_set_icon           (AppIndicator       *self,
@@ -271,17 +335,63 @@ void                            app_indicator_set_icon           (AppIndicator
 void                            app_indicator_set_icon_full      (AppIndicator       *self,
                                                                   const gchar        *icon_name,
                                                                   const gchar        *icon_desc);
+void                            app_indicator_set_icon_full_static (AppIndicator       *self,
+                                                                  const gchar        *icon_name,
+                                                                  const gchar        *icon_desc);
+void                            app_indicator_set_icon_animation (AppIndicator       *self,
+                                                                  const gchar * const *frames,
+                                                                  guint               interval_ms);
 void                            app_indicator_set_label          (AppIndicator       *self,
                                                                   const gchar        *label,
                                                                   const gchar        *guide);
+void                            app_indicator_set_label_template (AppIndicator       *self,
+                                                                  const gchar        *label_template,
+                                                                  const gchar        *guide);
+void                            app_indicator_set_label_value    (AppIndicator       *self,
+                                                                  gdouble             value);
 void                            app_indicator_set_icon_theme_path(AppIndicator       *self,
                                                                   const gchar        *icon_theme_path);
+void                            app_indicator_set_icon_theme_cache (AppIndicator       *self,
+                                                                  gboolean            enabled);
+void                            app_indicator_set_statistics_enabled (AppIndicator     *self,
+                                                                  gboolean            enabled);
 void                            app_indicator_set_ordering_index (AppIndicator       *self,
                                                                   guint32             ordering_index);
 void                            app_indicator_set_secondary_activate_target (AppIndicator *self,
                                                                              GtkWidget    *menuitem);
+void                            app_indicator_set_item_is_menu   (AppIndicator       *self,
+                                                                  gboolean            item_is_menu);
+void                            app_indicator_set_unicast_signals (AppIndicator      *self,
+                                                                  gboolean            enabled);
+void                            app_indicator_add_signal_consumer (AppIndicator      *self,
+                                                                  const gchar        *bus_name);
+void                            app_indicator_remove_signal_consumer (AppIndicator   *self,
+                                                                  const gchar        *bus_name);
+void                            app_indicator_set_peer_channels_enabled (AppIndicator *self,
+                                                                  gboolean            enabled);
+void                            app_indicator_set_state_page_enabled (AppIndicator *self,
+                                                                  gboolean            enabled);
 void                            app_indicator_set_title          (AppIndicator       *self,
                                                                   const gchar        *title);
+void                            app_indicator_set_tooltip        (AppIndicator       *self,
+                                                                  const gchar        *icon_name,
+                                                                  const gchar        *title,
+                                                                  const gchar        *description);
+void                            app_indicator_set_tooltip_provider (AppIndicator           *self,
+                                                                  AppIndicatorTooltipFunc func,
+                                                                  gpointer                user_data,
+                                                                  GDestroyNotify          destroy);
+void                            app_indicator_invalidate_tooltip (AppIndicator       *self);
+void                            app_indicator_set_label_provider (AppIndicator           *self,
+                                                                  AppIndicatorTextFunc    func,
+                                                                  gpointer                user_data,
+                                                                  GDestroyNotify          destroy);
+void                            app_indicator_invalidate_label   (AppIndicator       *self);
+void                            app_indicator_set_title_provider (AppIndicator           *self,
+                                                                  AppIndicatorTextFunc    func,
+                                                                  gpointer                user_data,
+                                                                  GDestroyNotify          destroy);
+void                            app_indicator_invalidate_title   (AppIndicator       *self);
 
 /* Get properties */
 const gchar *                   app_indicator_get_id                   (AppIndicator *self);
@@ -299,6 +409,8 @@ const gchar *                   app_indicator_get_label                (AppIndic
 const gchar *                   app_indicator_get_label_guide          (AppIndicator *self);
 guint32                         app_indicator_get_ordering_index       (AppIndicator *self);
 GtkWidget *                     app_indicator_get_secondary_activate_target (AppIndicator *self);
+gboolean                        app_indicator_get_item_is_menu         (AppIndicator *self);
+GVariant *                      app_indicator_get_statistics           (AppIndicator *self);
 
 /* Helpers */
 void                            app_indicator_build_menu_from_desktop (AppIndicator * self,
@@ -322,6 +434,20 @@ G_END_DECLS
  * user.  It should only be use if persistence is a desired
  * feature for the user (not for your marketing purpose of
  * having your logo in the panel).
+ *
+ * An indicator belongs to the thread default main context of the
+ * thread that created it.  The setters for the status, the icons,
+ * the icon animation, the label, the title, the icon theme path
+ * and the ordering index can also be called from other threads.
+ * The values are then handed over to that context and applied on
+ * its next iteration, and when several values are set for the same
+ * property in the meantime only the last one is applied.  All of
+ * the other functions, and anything to do with the menu, have to
+ * be called from the owning context.
+ *
+ * The D-Bus object of an indicator can be served from another
+ * context with app_indicator_new_with_context(), so that the
+ * panel gets its answers while the owning context is busy.
  */
 
 #endif
@@ -39,3 +39,36 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define NOTIFICATION_ITEM_DEFAULT_OBJ     "/StatusNotifierItem"
 
 #define NOTIFICATION_APPROVER_DBUS_IFACE  "org.ayatana.StatusNotifierApprover"
+
+/* The state page of an item, see XAyatanaGetStatePage.  It is a page
+   of shared memory the item writes its state to and hosts only read.
+   The item makes sequence odd before it writes and even again after,
+   so a reader copies the page and tries again if sequence was odd or
+   isn't the same after the copy.  The generations count the signals
+   they are named after, so a host knows when to read what isn't on
+   the page over the bus.  All of it is in host byte order. */
+#define NOTIFICATION_ITEM_STATE_PAGE_MAGIC       0x50534941 /* "AISP" */
+#define NOTIFICATION_ITEM_STATE_PAGE_VERSION     1
+#define NOTIFICATION_ITEM_STATE_PAGE_SIZE        4096
+#define NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE  256
+
+/* The item doesn't write to the page anymore */
+#define NOTIFICATION_ITEM_STATE_PAGE_CLOSED      (1 << 0)
+
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    guint32 size;
+    guint32 sequence;
+    guint32 flags;
+    guint32 status;                     /* AppIndicatorStatus */
+    guint32 ordering_index;
+    guint32 icon_generation;            /* NewIcon */
+    guint32 attention_icon_generation;  /* NewAttentionIcon */
+    guint32 icon_theme_path_generation; /* NewIconThemePath */
+    guint32 icon_animation_generation;  /* XAyatanaNewIconAnimation */
+    guint32 title_generation;           /* NewTitle */
+    guint32 tooltip_generation;         /* NewToolTip */
+    guint32 label_generation;           /* XAyatanaNewLabel */
+    gchar   label[NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE]; /* UTF-8, may be cut short */
+} NotificationItemStatePage;
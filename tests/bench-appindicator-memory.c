@@ -0,0 +1,180 @@
+/*
+Memory benchmark for the libappindicator library.  Creates a large number
+of indicators the way an application with many of them would and reports
+the heap used per indicator as JSON.  Meant to be run under massif, see
+the bench-appindicator-memory target.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <app-indicator.h>
+#include "test-helpers.h"
+
+static gint count = 10000;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "count", 'n', 0, G_OPTION_ARG_INT, &count, "Number of indicators to create", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* Bytes handed out by malloc right now */
+static gint64
+heap_in_use (void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (gint64) info.uordblks + (gint64) info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+/* Resident set size in kB, from /proc */
+static gint64
+rss_kb (void)
+{
+    gchar * status = NULL;
+    gint64 rss = -1;
+
+    if (g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+        gchar * line = strstr(status, "VmRSS:");
+
+        if (line != NULL) {
+            rss = g_ascii_strtoll(line + strlen("VmRSS:"), NULL, 10);
+        }
+
+        g_free(status);
+    }
+
+    return rss;
+}
+
+/* Lets the bus callbacks of the new indicators run */
+static void
+settle (void)
+{
+    gint64 end = g_get_monotonic_time() + G_USEC_PER_SEC / 2;
+
+    while (g_get_monotonic_time() < end) {
+        if (!g_main_context_iteration(NULL, FALSE)) {
+            g_usleep(1000);
+        }
+    }
+
+    return;
+}
+
+static AppIndicator *
+make_indicator (guint i)
+{
+    gchar * id = g_strdup_printf("bench-memory-%u", i);
+    gchar * label = g_strdup_printf("%u", i);
+    AppIndicator * ci;
+
+    /* Everything but the ID and the label is what an application
+       with many indicators has in common between them */
+    ci = app_indicator_new(id, "bench-icon", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    app_indicator_set_attention_icon_full(ci, "bench-attention-icon", "Needs attention");
+    app_indicator_set_icon_theme_path(ci, "/usr/share/bench-appindicator/icons");
+    app_indicator_set_title(ci, "Memory benchmark");
+    app_indicator_set_label(ci, label, "99999");
+
+    g_free(id);
+    g_free(label);
+
+    return ci;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- memory benchmark for libayatana-appindicator");
+    GError * error = NULL;
+    GTestDBus * bus;
+    AppIndicator * warmup;
+    AppIndicator ** indicators;
+    gint64 heap_before, heap_after, rss_before, rss_after;
+    GString * json;
+    gint i;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    count = MAX(count, 1);
+
+    /* A private bus without a watcher, so the numbers don't depend on
+       the desktop that runs this */
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    gtk_init(&argc, &argv);
+
+    /* Get the one time setup out of the way */
+    warmup = make_indicator(G_MAXUINT);
+    settle();
+
+    heap_before = heap_in_use();
+    rss_before = rss_kb();
+
+    indicators = g_new0(AppIndicator *, count);
+
+    for (i = 0; i < count; i++) {
+        indicators[i] = make_indicator(i);
+    }
+
+    settle();
+
+    heap_after = heap_in_use();
+    rss_after = rss_kb();
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"count\": %d,\n", count);
+
+    if (heap_before >= 0) {
+        g_string_append_printf(json, "  \"heap_bytes\": %" G_GINT64_FORMAT ",\n", heap_after - heap_before);
+        g_string_append_printf(json, "  \"heap_bytes_per_indicator\": %.1f,\n", (heap_after - heap_before) / (gdouble) count);
+    }
+
+    g_string_append_printf(json, "  \"rss_kb\": %" G_GINT64_FORMAT ",\n", rss_after - rss_before);
+    g_string_append_printf(json, "  \"rss_bytes_per_indicator\": %.1f\n", (rss_after - rss_before) * 1024.0 / count);
+    bench_json_close(json, "}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+
+    for (i = 0; i < count; i++) {
+        g_object_unref(indicators[i]);
+    }
+
+    g_free(indicators);
+    g_object_unref(warmup);
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    return 0;
+}
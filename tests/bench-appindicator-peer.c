@@ -0,0 +1,300 @@
+/*
+Peer channel benchmark for the libappindicator library.  A mock host
+follows an indicator through the bus daemon and then through a peer
+channel of its own (XAyatanaOpenPeerChannel), and the throughput and
+latency of both paths are written as JSON.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <app-indicator.h>
+#include "../src/dbus-shared.h"
+#include "test-helpers.h"
+
+static gint iterations = 10000;
+static gint latency_iterations = 1000;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of updates per path", "N" },
+    { "latency-iterations", 'l', 0, G_OPTION_ARG_INT, &latency_iterations, "Number of updates timed at the host", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* The mock host */
+static GDBusConnection * host = NULL;
+static MockWatcher watcher = { 0 };
+static gchar * item_path = NULL;
+
+/* Only touched on the main context */
+static guint host_signals = 0;
+static gint64 host_last_signal = 0;
+
+static void
+item_registered (MockWatcher * mock, const gchar * sender, const gchar * service)
+{
+    g_free(item_path);
+    item_path = g_strdup(service);
+    return;
+}
+
+static void
+host_signal (GDBusConnection * connection, const gchar * sender, const gchar * path,
+             const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+{
+    if (g_strcmp0(signal, "NewStatus") == 0) {
+        host_signals++;
+        host_last_signal = g_get_monotonic_time();
+    }
+
+    return;
+}
+
+static void
+host_start (const gchar * address)
+{
+    host = mock_connection_new(address);
+
+    watcher.host_registered = TRUE;
+    watcher.item_registered = item_registered;
+    mock_watcher_start(&watcher, host);
+    return;
+}
+
+/* Does what a host does before showing the indicator, so that it is
+   one of its consumers */
+static void
+host_read_item (const gchar * item)
+{
+    GAsyncResult * res = NULL;
+    GError * error = NULL;
+    GVariant * reply;
+
+    g_dbus_connection_call(host, item, item_path, "org.freedesktop.DBus.Properties", "Get",
+                           g_variant_new("(ss)", NOTIFICATION_ITEM_DBUS_IFACE, "Id"),
+                           G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, async_result_cb, &res);
+
+    reply = g_dbus_connection_call_finish(host, async_result_wait(&res), &error);
+    g_assert_no_error(error);
+
+    g_variant_unref(reply);
+    g_object_unref(res);
+    return;
+}
+
+static GDBusConnection *
+host_open_peer_channel (const gchar * item)
+{
+    GAsyncResult * res = NULL;
+    GError * error = NULL;
+    GDBusConnection * peer;
+    const gchar * address;
+    GVariant * reply;
+
+    g_dbus_connection_call(host, item, item_path, NOTIFICATION_ITEM_DBUS_IFACE, "XAyatanaOpenPeerChannel",
+                           NULL, G_VARIANT_TYPE("(s)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, async_result_cb, &res);
+
+    reply = g_dbus_connection_call_finish(host, async_result_wait(&res), &error);
+    g_assert_no_error(error);
+    g_clear_object(&res);
+
+    g_variant_get(reply, "(&s)", &address);
+
+    g_dbus_connection_new_for_address(address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                      NULL, NULL, async_result_cb, &res);
+
+    peer = g_dbus_connection_new_for_address_finish(async_result_wait(&res), &error);
+    g_assert_no_error(error);
+
+    g_variant_unref(reply);
+    g_object_unref(res);
+    return peer;
+}
+
+static void
+connected_cb (AppIndicator * ci, gboolean connected, gpointer user_data)
+{
+    *(gboolean *) user_data = connected;
+    return;
+}
+
+/* Flips the status, every call is a NewStatus signal */
+static void
+set_status (AppIndicator * ci)
+{
+    static guint flips = 0;
+
+    app_indicator_set_status(ci, flips++ % 2 ? APP_INDICATOR_STATUS_ACTIVE : APP_INDICATOR_STATUS_ATTENTION);
+    return;
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *) a;
+    gint64 lb = *(const gint64 *) b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+/* Times @n updates until all of them are at the host, and then the
+   time each single one takes to get there */
+static void
+bench_path (GString * json, const gchar * name, AppIndicator * ci, guint n, guint latency_n)
+{
+    gint64 * latencies = g_new(gint64, latency_n);
+    gint64 start, elapsed, total = 0;
+    guint signals = host_signals;
+    guint i;
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < n; i++) {
+        set_status(ci);
+    }
+
+    while (host_signals - signals < n) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    for (i = 0; i < latency_n; i++) {
+        signals = host_signals;
+        start = g_get_monotonic_time();
+
+        set_status(ci);
+
+        while (host_signals == signals) {
+            g_main_context_iteration(NULL, TRUE);
+        }
+
+        latencies[i] = host_last_signal - start;
+        total += latencies[i];
+    }
+
+    qsort(latencies, latency_n, sizeof(gint64), compare_latency);
+
+    g_string_append_printf(json,
+                           "    \"%s\": { \"updates\": %u, \"usec\": %" G_GINT64_FORMAT ", "
+                           "\"updates_per_sec\": %.1f, \"latency_min_usec\": %" G_GINT64_FORMAT ", "
+                           "\"latency_mean_usec\": %.1f, \"latency_median_usec\": %" G_GINT64_FORMAT ", "
+                           "\"latency_p95_usec\": %" G_GINT64_FORMAT ", \"latency_max_usec\": %" G_GINT64_FORMAT " },\n",
+                           name, n, elapsed, n * (gdouble) G_USEC_PER_SEC / elapsed,
+                           latencies[0], (gdouble) total / latency_n, latencies[latency_n / 2],
+                           latencies[latency_n * 95 / 100], latencies[latency_n - 1]);
+
+    g_free(latencies);
+    return;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- peer channel benchmark for libayatana-appindicator");
+    GError * error = NULL;
+    GTestDBus * bus;
+    GDBusConnection * item;
+    GDBusConnection * peer;
+    AppIndicator * ci;
+    gboolean connected = FALSE;
+    const gchar * item_name;
+    guint subscription;
+    GString * json;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    iterations = MAX(iterations, 1);
+    latency_iterations = MAX(latency_iterations, 1);
+
+    /* A private bus, so that nothing else adds to the numbers */
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    gtk_init(&argc, &argv);
+
+    item = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    g_assert_no_error(error);
+    item_name = g_dbus_connection_get_unique_name(item);
+
+    host_start(g_test_dbus_get_bus_address(bus));
+
+    ci = app_indicator_new("bench-appindicator-peer", "bench-icon",
+                           APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    g_signal_connect(ci, APP_INDICATOR_SIGNAL_CONNECTION_CHANGED, G_CALLBACK(connected_cb), &connected);
+
+    app_indicator_set_item_is_menu(ci, FALSE);
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+
+    while (!connected || item_path == NULL) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"iterations\": %d,\n", iterations);
+    g_string_append(json, "  \"results\": {\n");
+
+    /* Through the bus daemon */
+    subscription = g_dbus_connection_signal_subscribe(host, item_name, NOTIFICATION_ITEM_DBUS_IFACE,
+                                                      "NewStatus", item_path, NULL,
+                                                      G_DBUS_SIGNAL_FLAGS_NONE, host_signal, NULL, NULL);
+
+    bench_path(json, "bus", ci, iterations, latency_iterations);
+
+    g_dbus_connection_signal_unsubscribe(host, subscription);
+
+    /* Through a connection of the host's own, the bus only carries
+       the signals to everybody else */
+    app_indicator_set_unicast_signals(ci, TRUE);
+    app_indicator_set_peer_channels_enabled(ci, TRUE);
+    host_read_item(item_name);
+
+    peer = host_open_peer_channel(item_name);
+    subscription = g_dbus_connection_signal_subscribe(peer, NULL, NOTIFICATION_ITEM_DBUS_IFACE,
+                                                      "NewStatus", item_path, NULL,
+                                                      G_DBUS_SIGNAL_FLAGS_NONE, host_signal, NULL, NULL);
+
+    bench_path(json, "peer", ci, iterations, latency_iterations);
+
+    g_dbus_connection_signal_unsubscribe(peer, subscription);
+    g_dbus_connection_close_sync(peer, NULL, NULL);
+    g_object_unref(peer);
+
+    bench_json_close(json, "  }\n}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+
+    g_object_unref(ci);
+    mock_watcher_stop(&watcher);
+    g_object_unref(host);
+    g_object_unref(item);
+    g_free(item_path);
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+Cold start benchmark for the libappindicator library.  Times the first
+app_indicator_new() of a process, which is where the type and its D-Bus
+interfaces get set up.  Every run is a new process, started by running
+this program again with --child, and the results are written as JSON.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <app-indicator.h>
+#include "test-helpers.h"
+
+static gint runs = 50;
+static gboolean child = FALSE;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "runs", 'n', 0, G_OPTION_ARG_INT, &runs, "Number of processes to start", "N" },
+    { "child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &child, NULL, NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* Bytes handed out by malloc right now */
+static gint64
+heap_in_use (void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (gint64) info.uordblks + (gint64) info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+/* Creates the first indicator of the process and prints how long
+   that took and how much it allocated */
+static gint
+run_child (gint argc, gchar * argv[])
+{
+    AppIndicator * ci;
+    gint64 heap, start, elapsed;
+
+    gtk_init(&argc, &argv);
+
+    heap = heap_in_use();
+    start = g_get_monotonic_time();
+
+    ci = app_indicator_new("bench-startup", "bench-icon", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+
+    elapsed = g_get_monotonic_time() - start;
+    heap = heap >= 0 ? heap_in_use() - heap : -1;
+
+    g_print("%" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n", elapsed, heap);
+
+    g_object_unref(ci);
+    return 0;
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a;
+    gint64 y = *(const gint64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- cold start benchmark for libayatana-appindicator");
+    GError * error = NULL;
+    GTestDBus * bus;
+    gchar * self;
+    gint64 * usecs;
+    gint64 heap = -1;
+    GString * json;
+    gint i;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    if (child) {
+        return run_child(argc, argv);
+    }
+
+    runs = MAX(runs, 1);
+    self = g_file_read_link("/proc/self/exe", NULL);
+    if (self == NULL) {
+        self = g_strdup(argv[0]);
+    }
+
+    /* A private bus, the children find it in the environment */
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    usecs = g_new0(gint64, runs);
+
+    for (i = 0; i < runs; i++) {
+        gchar * child_argv[] = { self, "--child", NULL };
+        gchar * out = NULL;
+        gint status = 0;
+        gboolean ok;
+
+        ok = g_spawn_sync(NULL, child_argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, &out, NULL, &status, &error);
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        ok = ok && g_spawn_check_exit_status(status, &error);
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+        if (!ok) {
+            g_printerr("Unable to run '%s': %s\n", self, error->message);
+            g_error_free(error);
+            g_free(out);
+            return 1;
+        }
+
+        if (sscanf(out, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT, &usecs[i], &heap) != 2) {
+            g_printerr("Unexpected output from '%s': %s\n", self, out);
+            g_free(out);
+            return 1;
+        }
+
+        g_free(out);
+    }
+
+    qsort(usecs, runs, sizeof(gint64), compare_gint64);
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"runs\": %d,\n", runs);
+    g_string_append_printf(json, "  \"first_new_usec_min\": %" G_GINT64_FORMAT ",\n", usecs[0]);
+    g_string_append_printf(json, "  \"first_new_usec_median\": %" G_GINT64_FORMAT ",\n", usecs[runs / 2]);
+    g_string_append_printf(json, "  \"first_new_usec_max\": %" G_GINT64_FORMAT ",\n", usecs[runs - 1]);
+    g_string_append_printf(json, "  \"first_new_heap_bytes\": %" G_GINT64_FORMAT "\n", heap);
+    bench_json_close(json, "}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+    g_free(usecs);
+    g_free(self);
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    return 0;
+}
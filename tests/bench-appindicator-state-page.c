@@ -0,0 +1,289 @@
+/*
+State page benchmark for the libappindicator library.  A host polls the
+status of many indicators, once with a property read on the bus for
+each of them and once from their state pages (XAyatanaGetStatePage),
+and the cost of a poll of all of them is written as JSON.  The pages
+are also read from another thread while the indicators keep changing,
+to count how often a reader has to try again.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <app-indicator.h>
+#include "../src/dbus-shared.h"
+#include "state-page-reader.h"
+#include "test-helpers.h"
+
+static gint count = 200;
+static gint rounds = 100;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "count", 'n', 0, G_OPTION_ARG_INT, &count, "Number of indicators to poll", "N" },
+    { "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds, "Number of polls of all of them", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* The host, with a connection of its own */
+static GDBusConnection * host = NULL;
+static const gchar * item_name = NULL;
+
+typedef struct {
+    AppIndicator * indicator;
+    gchar * path;
+    const NotificationItemStatePage * page;
+} Item;
+
+static Item * items = NULL;
+
+/* The reader thread */
+static gint reader_done = FALSE;
+static guint reader_retries = 0;
+static guint reader_failures = 0;
+static gint64 reader_usec = 0;
+
+static gboolean
+host_get_status (Item * item)
+{
+    GAsyncResult * res = NULL;
+    GVariant * reply;
+
+    g_dbus_connection_call(host, item_name, item->path, "org.freedesktop.DBus.Properties", "Get",
+                           g_variant_new("(ss)", NOTIFICATION_ITEM_DBUS_IFACE, "Status"),
+                           G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, async_result_cb, &res);
+
+    reply = g_dbus_connection_call_finish(host, async_result_wait(&res), NULL);
+    g_object_unref(res);
+
+    if (reply == NULL) {
+        return FALSE;
+    }
+
+    g_variant_unref(reply);
+    return TRUE;
+}
+
+static const NotificationItemStatePage *
+host_get_state_page (Item * item)
+{
+    const NotificationItemStatePage * page;
+    GError * error = NULL;
+    gint fd = state_page_fd_get(host, item_name, item->path, &error);
+
+    g_assert_no_error(error);
+
+    page = state_page_map(fd);
+    g_assert(page != NULL);
+    close(fd);
+
+    return page;
+}
+
+/* Reads all of the pages until the main thread is done changing them */
+static gpointer
+reader_thread (gpointer user_data)
+{
+    NotificationItemStatePage state;
+    gint64 start = g_get_monotonic_time();
+    guint reads = 0;
+    gint i;
+
+    while (!g_atomic_int_get(&reader_done)) {
+        for (i = 0; i < count; i++) {
+            if (!state_page_read(items[i].page, &state, &reader_retries)) {
+                reader_failures++;
+            }
+        }
+        reads += count;
+    }
+
+    reader_usec = g_get_monotonic_time() - start;
+
+    return GUINT_TO_POINTER(reads);
+}
+
+static gint64
+poll_bus (void)
+{
+    gint64 start = g_get_monotonic_time();
+    gint i;
+
+    for (i = 0; i < count; i++) {
+        host_get_status(&items[i]);
+    }
+
+    return g_get_monotonic_time() - start;
+}
+
+static gint64
+poll_pages (void)
+{
+    NotificationItemStatePage state;
+    gint64 start = g_get_monotonic_time();
+    gint i;
+
+    for (i = 0; i < count; i++) {
+        state_page_read(items[i].page, &state, NULL);
+    }
+
+    return g_get_monotonic_time() - start;
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a;
+    gint64 y = *(const gint64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+append_polls (GString * json, const gchar * name, gint64 (*poll) (void))
+{
+    gint64 * usecs = g_new(gint64, rounds);
+    gint i;
+
+    for (i = 0; i < rounds; i++) {
+        usecs[i] = poll();
+    }
+
+    qsort(usecs, rounds, sizeof(gint64), compare_gint64);
+
+    g_string_append_printf(json,
+                           "    \"%s\": { \"poll_usec_min\": %" G_GINT64_FORMAT ", "
+                           "\"poll_usec_median\": %" G_GINT64_FORMAT ", \"poll_usec_max\": %" G_GINT64_FORMAT ", "
+                           "\"usec_per_indicator\": %.3f },\n",
+                           name, usecs[0], usecs[rounds / 2], usecs[rounds - 1],
+                           usecs[rounds / 2] / (gdouble) count);
+
+    g_free(usecs);
+    return;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- state page benchmark for libayatana-appindicator");
+    GError * error = NULL;
+    GTestDBus * bus;
+    GDBusConnection * item_bus;
+    GThread * reader;
+    guint writes = 0;
+    guint reads;
+    GString * json;
+    gint i;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    count = MAX(count, 1);
+    rounds = MAX(rounds, 1);
+
+    /* A private bus, so that nothing else adds to the numbers */
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    gtk_init(&argc, &argv);
+
+    item_bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    g_assert_no_error(error);
+    item_name = g_dbus_connection_get_unique_name(item_bus);
+
+    host = mock_connection_new(g_test_dbus_get_bus_address(bus));
+
+    items = g_new0(Item, count);
+
+    for (i = 0; i < count; i++) {
+        gchar * id = g_strdup_printf("bench_state_page_%d", i);
+
+        items[i].indicator = app_indicator_new(id, "bench-icon", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+        items[i].path = g_strdup_printf("/org/ayatana/NotificationItem/%s", id);
+
+        app_indicator_set_item_is_menu(items[i].indicator, FALSE);
+        app_indicator_set_status(items[i].indicator, APP_INDICATOR_STATUS_ACTIVE);
+        app_indicator_set_state_page_enabled(items[i].indicator, TRUE);
+
+        g_free(id);
+    }
+
+    /* Wait for all of them to be on the bus */
+    for (i = 0; i < count; i++) {
+        while (!host_get_status(&items[i])) {
+            g_main_context_iteration(NULL, FALSE);
+        }
+
+        items[i].page = host_get_state_page(&items[i]);
+    }
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"count\": %d,\n", count);
+    g_string_append_printf(json, "  \"rounds\": %d,\n", rounds);
+    g_string_append(json, "  \"results\": {\n");
+
+    append_polls(json, "bus", poll_bus);
+    append_polls(json, "state_page", poll_pages);
+
+    /* The pages change while another thread reads them */
+    reader = g_thread_new("bench-reader", reader_thread, NULL);
+
+    for (i = 0; i < rounds; i++) {
+        gint j;
+
+        for (j = 0; j < count; j++) {
+            app_indicator_set_status(items[j].indicator,
+                                     (i + j) % 2 ? APP_INDICATOR_STATUS_ACTIVE : APP_INDICATOR_STATUS_ATTENTION);
+            writes++;
+        }
+    }
+
+    g_atomic_int_set(&reader_done, TRUE);
+    reads = GPOINTER_TO_UINT(g_thread_join(reader));
+
+    g_string_append_printf(json,
+                           "    \"state_page_contended\": { \"writes\": %u, \"reads\": %u, "
+                           "\"usec_per_read\": %.3f, \"retries\": %u, \"failures\": %u }\n",
+                           writes, reads, reader_usec / (gdouble) MAX(reads, 1),
+                           reader_retries, reader_failures);
+
+    bench_json_close(json, "  }\n}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+
+    for (i = 0; i < count; i++) {
+        state_page_unmap(items[i].page);
+        g_object_unref(items[i].indicator);
+        g_free(items[i].path);
+    }
+
+    g_free(items);
+    g_object_unref(host);
+    g_object_unref(item_bus);
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    return 0;
+}
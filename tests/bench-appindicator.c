@@ -0,0 +1,388 @@
+/*
+Benchmarks for the libappindicator library.  Runs the indicators against
+a private bus with a mock StatusNotifierWatcher that also acts as the
+host, and writes the results as JSON.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <app-indicator.h>
+#include "../src/dbus-shared.h"
+#include "test-helpers.h"
+
+/* How long the host waits for a single update, in milliseconds */
+#define LATENCY_TIMEOUT  5000
+
+static gint iterations = 10000;
+static gint latency_iterations = 1000;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of updates per setter", "N" },
+    { "latency-iterations", 'l', 0, G_OPTION_ARG_INT, &latency_iterations, "Number of updates timed at the host", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* The mock host */
+static GDBusConnection * host = NULL;
+static MockWatcher watcher = { 0 };
+static gchar * item_sender = NULL;
+
+/* Written from the GDBus worker thread */
+static gint host_messages = 0;
+static gint host_bytes = 0;
+
+/* Only touched on the main context */
+static guint host_signals = 0;
+static gint64 host_last_signal = 0;
+
+/* Counts what the indicators send, the size is the one on the wire */
+static GDBusMessage *
+host_filter (GDBusConnection * connection, GDBusMessage * message, gboolean incoming, gpointer user_data)
+{
+    if (incoming &&
+        g_dbus_message_get_message_type(message) == G_DBUS_MESSAGE_TYPE_SIGNAL &&
+        g_strcmp0(g_dbus_message_get_sender(message), item_sender) == 0) {
+        gsize size = 0;
+        guchar * blob = g_dbus_message_to_blob(message, &size, G_DBUS_CAPABILITY_FLAGS_NONE, NULL);
+
+        g_free(blob);
+        g_atomic_int_inc(&host_messages);
+        g_atomic_int_add(&host_bytes, (gint) size);
+    }
+
+    return message;
+}
+
+static void
+host_signal (GDBusConnection * connection, const gchar * sender, const gchar * path,
+             const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+{
+    host_signals++;
+    host_last_signal = g_get_monotonic_time();
+    return;
+}
+
+static void
+host_start (const gchar * address, const gchar * sender)
+{
+    host = mock_connection_new(address);
+    item_sender = g_strdup(sender);
+
+    g_dbus_connection_add_filter(host, host_filter, NULL, NULL);
+    g_dbus_connection_signal_subscribe(host, sender, NULL, NULL, NULL, NULL,
+                                       G_DBUS_SIGNAL_FLAGS_NONE, host_signal, NULL, NULL);
+
+    watcher.host_registered = TRUE;
+    mock_watcher_start(&watcher, host);
+    return;
+}
+
+/* Waits until everything sent so far has arrived at the host */
+static void
+drain (GDBusConnection * item)
+{
+    guint signals;
+
+    g_dbus_connection_flush_sync(item, NULL, NULL);
+
+    do {
+        signals = host_signals;
+        spin(100);
+    } while (signals != host_signals);
+
+    return;
+}
+
+static void
+connected_cb (AppIndicator * ci, gboolean connected, gpointer user_data)
+{
+    *(gboolean *) user_data = connected;
+    return;
+}
+
+typedef void (*BenchFunc) (AppIndicator * ci, guint i, gpointer data);
+
+static void
+bench_set_status (AppIndicator * ci, guint i, gpointer data)
+{
+    app_indicator_set_status(ci, i % 2 ? APP_INDICATOR_STATUS_ACTIVE : APP_INDICATOR_STATUS_ATTENTION);
+}
+
+static void
+bench_set_icon_full (AppIndicator * ci, guint i, gpointer data)
+{
+    static const gchar * icons[] = { "bench-icon-1", "bench-icon-2", "bench-icon-3" };
+    app_indicator_set_icon_full(ci, icons[i % 3], "Bench icon");
+}
+
+static void
+bench_set_label (AppIndicator * ci, guint i, gpointer data)
+{
+    gchar label[16];
+    g_snprintf(label, sizeof(label), "%u%%", i % 100);
+    app_indicator_set_label(ci, label, "100%");
+}
+
+static void
+bench_set_menu (AppIndicator * ci, guint i, gpointer data)
+{
+    GtkMenu ** menus = data;
+    app_indicator_set_menu(ci, menus[i % 2]);
+}
+
+static GtkMenu *
+make_menu (guint items)
+{
+    GtkWidget * menu = gtk_menu_new();
+    guint i;
+
+    for (i = 0; i < items; i++) {
+        gchar * label = g_strdup_printf("Item %u", i);
+        GtkWidget * item = gtk_menu_item_new_with_label(label);
+
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+        gtk_widget_show(item);
+        g_free(label);
+    }
+
+    return GTK_MENU(g_object_ref_sink(menu));
+}
+
+/* Times @func over @n updates and how much of it reaches the host */
+static void
+bench_setter (GString * json, const gchar * name, AppIndicator * ci, GDBusConnection * item,
+              BenchFunc func, gpointer data, guint n)
+{
+    gint64 start, elapsed;
+    gint messages, bytes;
+    guint i;
+
+    drain(item);
+    g_atomic_int_set(&host_messages, 0);
+    g_atomic_int_set(&host_bytes, 0);
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < n; i++) {
+        func(ci, i, data);
+    }
+
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    drain(item);
+    messages = g_atomic_int_get(&host_messages);
+    bytes = g_atomic_int_get(&host_bytes);
+
+    g_string_append_printf(json,
+                           "    \"%s\": { \"updates\": %u, \"usec\": %" G_GINT64_FORMAT ", "
+                           "\"updates_per_sec\": %.1f, \"messages_per_update\": %.3f, "
+                           "\"bytes_per_update\": %.1f },\n",
+                           name, n, elapsed, n * (gdouble) G_USEC_PER_SEC / elapsed,
+                           (gdouble) messages / n, (gdouble) bytes / n);
+    return;
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *) a;
+    gint64 lb = *(const gint64 *) b;
+
+    return la < lb ? -1 : la > lb;
+}
+
+/* Time from the setter being called to the host getting the signal.
+   Every update uses an icon of its own, the same icon twice isn't
+   sent, and one that never arrives is counted instead of waited for. */
+static void
+bench_latency (GString * json, AppIndicator * ci, GDBusConnection * item, guint n)
+{
+    gint64 * latencies = g_new(gint64, n);
+    gint64 total = 0;
+    guint received = 0;
+    guint timeouts = 0;
+    guint i;
+
+    drain(item);
+
+    for (i = 0; i < n; i++) {
+        guint signals = host_signals;
+        gboolean timed_out = FALSE;
+        gchar * icon = g_strdup_printf("bench-latency-%u", i);
+        guint timer = g_timeout_add(LATENCY_TIMEOUT, timeout_flag, &timed_out);
+        gint64 start = g_get_monotonic_time();
+
+        app_indicator_set_icon_full(ci, icon, "Bench icon");
+
+        while (host_signals == signals && !timed_out) {
+            g_main_context_iteration(NULL, TRUE);
+        }
+
+        g_free(icon);
+
+        if (timed_out) {
+            timeouts++;
+            continue;
+        }
+
+        g_source_remove(timer);
+
+        latencies[received] = host_last_signal - start;
+        total += latencies[received];
+        received++;
+    }
+
+    if (received == 0) {
+        g_string_append_printf(json, "    \"latency\": { \"updates\": %u, \"timeouts\": %u },\n", n, timeouts);
+        g_free(latencies);
+        return;
+    }
+
+    qsort(latencies, received, sizeof(gint64), compare_latency);
+
+    g_string_append_printf(json,
+                           "    \"latency\": { \"updates\": %u, \"timeouts\": %u, \"min_usec\": %" G_GINT64_FORMAT ", "
+                           "\"mean_usec\": %.1f, \"median_usec\": %" G_GINT64_FORMAT ", "
+                           "\"p95_usec\": %" G_GINT64_FORMAT ", \"max_usec\": %" G_GINT64_FORMAT " },\n",
+                           n, timeouts, latencies[0], (gdouble) total / received, latencies[received / 2],
+                           latencies[received * 95 / 100], latencies[received - 1]);
+
+    g_free(latencies);
+    return;
+}
+
+/* The same updates, without a host and with a GtkStatusIcon instead */
+static void
+bench_fallback (GString * json, guint n)
+{
+    AppIndicator * ci = app_indicator_new("bench-appindicator-fallback", "bench-icon-1",
+                                          APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    GtkMenu * menu = make_menu(10);
+    gint64 start, elapsed;
+    guint i;
+
+    app_indicator_set_menu(ci, menu);
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+
+    /* Give the fallback timer a chance */
+    spin(500);
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < n; i++) {
+        bench_set_icon_full(ci, i, NULL);
+    }
+
+    elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    g_string_append_printf(json,
+                           "    \"fallback_set_icon_full\": { \"updates\": %u, \"usec\": %" G_GINT64_FORMAT ", "
+                           "\"updates_per_sec\": %.1f },\n",
+                           n, elapsed, n * (gdouble) G_USEC_PER_SEC / elapsed);
+
+    g_object_unref(ci);
+    g_object_unref(menu);
+    return;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- benchmark libayatana-appindicator");
+    GError * error = NULL;
+    GTestDBus * bus;
+    GDBusConnection * item;
+    AppIndicator * ci;
+    GtkMenu * menus[2];
+    gboolean connected = FALSE;
+    gboolean have_display;
+    GString * json;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    iterations = MAX(iterations, 2);
+    latency_iterations = MAX(latency_iterations, 1);
+
+    /* A private bus, so that nothing else adds to the numbers */
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    have_display = gtk_init_check(&argc, &argv);
+
+    item = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    g_assert_no_error(error);
+
+    host_start(g_test_dbus_get_bus_address(bus), g_dbus_connection_get_unique_name(item));
+
+    ci = app_indicator_new("bench-appindicator", "bench-icon-1",
+                           APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    g_signal_connect(ci, APP_INDICATOR_SIGNAL_CONNECTION_CHANGED, G_CALLBACK(connected_cb), &connected);
+
+    menus[0] = make_menu(10);
+    menus[1] = make_menu(10);
+    app_indicator_set_menu(ci, menus[0]);
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+
+    while (!connected) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"iterations\": %d,\n", iterations);
+    g_string_append(json, "  \"results\": {\n");
+
+    bench_setter(json, "set_status", ci, item, bench_set_status, NULL, iterations);
+    bench_setter(json, "set_icon_full", ci, item, bench_set_icon_full, NULL, iterations);
+    bench_setter(json, "set_label", ci, item, bench_set_label, NULL, iterations);
+    /* Menus get exported again each time, so fewer of them */
+    bench_setter(json, "set_menu", ci, item, bench_set_menu, menus, MAX(iterations / 100, 2));
+
+    bench_latency(json, ci, item, latency_iterations);
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_PASSIVE);
+    drain(item);
+    g_object_unref(ci);
+
+    mock_watcher_stop(&watcher);
+
+    if (have_display) {
+        bench_fallback(json, iterations);
+    }
+
+    bench_json_close(json, "  }\n}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+    g_object_unref(menus[0]);
+    g_object_unref(menus[1]);
+    g_object_unref(host);
+    g_object_unref(item);
+
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+Reference reader of the state page of an item, see XAyatanaGetStatePage
+and NotificationItemStatePage in dbus-shared.h.  This is what a host
+does with the file descriptor it gets.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+/* Goes after dbus-shared.h */
+
+/* An item that died in the middle of a write leaves the sequence odd */
+#define STATE_PAGE_READ_ATTEMPTS  1000
+
+/* Maps the page read-only, the file descriptor can be closed after */
+static const NotificationItemStatePage *
+state_page_map (gint fd)
+{
+    const NotificationItemStatePage * page;
+    struct stat info;
+
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t) sizeof(NotificationItemStatePage)) {
+        return NULL;
+    }
+
+    page = mmap(NULL, NOTIFICATION_ITEM_STATE_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* Set before the item hands it out, no need for the sequence */
+    if (page->magic != NOTIFICATION_ITEM_STATE_PAGE_MAGIC ||
+        page->version != NOTIFICATION_ITEM_STATE_PAGE_VERSION) {
+        munmap((gpointer) page, NOTIFICATION_ITEM_STATE_PAGE_SIZE);
+        return NULL;
+    }
+
+    return page;
+}
+
+static void
+state_page_unmap (const NotificationItemStatePage * page)
+{
+    munmap((gpointer) page, NOTIFICATION_ITEM_STATE_PAGE_SIZE);
+    return;
+}
+
+/* Copies a consistent state of @page to @state, without any locking.
+   @retries counts the copies that were thrown away, if not NULL. */
+static gboolean
+state_page_read (const NotificationItemStatePage * page, NotificationItemStatePage * state, guint * retries)
+{
+    guint attempt;
+
+    for (attempt = 0; attempt < STATE_PAGE_READ_ATTEMPTS; attempt++) {
+        guint32 sequence = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+
+        if ((sequence & 1) == 0) {
+            memcpy(state, page, sizeof(NotificationItemStatePage));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == sequence) {
+                state->sequence = sequence;
+                state->label[NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE - 1] = '\0';
+                return TRUE;
+            }
+        }
+
+        if (retries != NULL) {
+            (*retries)++;
+        }
+
+        /* Let the writer finish */
+        if (attempt % 16 == 15) {
+            g_thread_yield();
+        }
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,276 @@
+/*
+Code shared by the tests and the benchmarks, see test-helpers.h.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include "../src/dbus-shared.h"
+#include "test-helpers.h"
+
+static const gchar * watcher_xml =
+    "<node>"
+    "  <interface name='" NOTIFICATION_WATCHER_DBUS_IFACE "'>"
+    "    <property name='ProtocolVersion' type='i' access='read'/>"
+    "    <property name='IsStatusNotifierHostRegistered' type='b' access='read'/>"
+    "    <property name='RegisteredStatusNotifierItems' type='as' access='read'/>"
+    "    <method name='RegisterStatusNotifierItem'>"
+    "      <arg type='s' name='service' direction='in'/>"
+    "    </method>"
+    "    <method name='RegisterStatusNotifierHost'>"
+    "      <arg type='s' name='service' direction='in'/>"
+    "    </method>"
+    "    <signal name='StatusNotifierHostRegistered'/>"
+    "  </interface>"
+    "</node>";
+
+/* A connection to the bus at @address of its own, like another
+   process would have */
+GDBusConnection *
+mock_connection_new (const gchar * address)
+{
+    GError * error = NULL;
+    GDBusConnection * connection;
+
+    connection = g_dbus_connection_new_for_address_sync(address,
+                                                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                        G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                        NULL, NULL, &error);
+    g_assert_no_error(error);
+
+    return connection;
+}
+
+static void
+watcher_method_call (GDBusConnection * connection, const gchar * sender, const gchar * path,
+                     const gchar * interface, const gchar * method, GVariant * params,
+                     GDBusMethodInvocation * invocation, gpointer user_data)
+{
+    MockWatcher * watcher = (MockWatcher *) user_data;
+
+    if (g_strcmp0(method, "RegisterStatusNotifierItem") == 0) {
+        const gchar * service = NULL;
+
+        g_variant_get(params, "(&s)", &service);
+        watcher->items_registered++;
+
+        if (watcher->item_registered != NULL) {
+            watcher->item_registered(watcher, sender, service);
+        }
+    }
+
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    return;
+}
+
+static GVariant *
+watcher_get_property (GDBusConnection * connection, const gchar * sender, const gchar * path,
+                      const gchar * interface, const gchar * property, GError ** error,
+                      gpointer user_data)
+{
+    MockWatcher * watcher = (MockWatcher *) user_data;
+
+    if (g_strcmp0(property, "ProtocolVersion") == 0) {
+        return g_variant_new_int32(0);
+    } else if (g_strcmp0(property, "IsStatusNotifierHostRegistered") == 0) {
+        watcher->host_queries++;
+        return g_variant_new_boolean(watcher->host_registered);
+    } else if (g_strcmp0(property, "RegisteredStatusNotifierItems") == 0) {
+        return g_variant_new_strv(NULL, 0);
+    }
+
+    return NULL;
+}
+
+static const GDBusInterfaceVTable watcher_vtable = {
+    watcher_method_call,
+    watcher_get_property,
+    NULL
+};
+
+static void
+watcher_name_acquired (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+    MockWatcher * watcher = (MockWatcher *) user_data;
+
+    watcher->owned = TRUE;
+    return;
+}
+
+/* Puts @watcher on @connection and waits for it to own the watcher
+   name.  The counters and callback of @watcher are left as they are. */
+void
+mock_watcher_start (MockWatcher * watcher, GDBusConnection * connection)
+{
+    GError * error = NULL;
+    GDBusNodeInfo * info = g_dbus_node_info_new_for_xml(watcher_xml, &error);
+
+    g_assert_no_error(error);
+
+    watcher->connection = g_object_ref(connection);
+    watcher->owned = FALSE;
+
+    watcher->object = g_dbus_connection_register_object(connection, NOTIFICATION_WATCHER_DBUS_OBJ,
+                                                        info->interfaces[0], &watcher_vtable,
+                                                        watcher, NULL, &error);
+    g_assert_no_error(error);
+
+    watcher->name = g_bus_own_name_on_connection(connection, NOTIFICATION_WATCHER_DBUS_ADDR,
+                                                 G_BUS_NAME_OWNER_FLAGS_NONE,
+                                                 watcher_name_acquired, NULL, watcher, NULL);
+
+    while (!watcher->owned) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_dbus_node_info_unref(info);
+    return;
+}
+
+/* Gives up the name and the object, the connection stays open */
+void
+mock_watcher_stop (MockWatcher * watcher)
+{
+    g_bus_unown_name(watcher->name);
+    g_dbus_connection_unregister_object(watcher->connection, watcher->object);
+    g_dbus_connection_flush_sync(watcher->connection, NULL, NULL);
+    g_clear_object(&watcher->connection);
+
+    watcher->name = 0;
+    watcher->object = 0;
+    return;
+}
+
+/* A host shows up after the items did */
+void
+mock_watcher_register_host (MockWatcher * watcher)
+{
+    GError * error = NULL;
+
+    watcher->host_registered = TRUE;
+    g_dbus_connection_emit_signal(watcher->connection, NULL,
+                                  NOTIFICATION_WATCHER_DBUS_OBJ,
+                                  NOTIFICATION_WATCHER_DBUS_IFACE,
+                                  "StatusNotifierHostRegistered",
+                                  NULL, &error);
+    g_assert_no_error(error);
+
+    return;
+}
+
+/* Keeps a reference to @res in the GAsyncResult pointer at @user_data */
+void
+async_result_cb (GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    *(GAsyncResult **) user_data = g_object_ref(res);
+    return;
+}
+
+/* Runs the main loop until async_result_cb() has filled in @res.  The
+   indicators are in the same process, so they have to keep running. */
+GAsyncResult *
+async_result_wait (GAsyncResult ** res)
+{
+    while (*res == NULL) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    return *res;
+}
+
+/* Sets the gboolean at @user_data, for a timeout on a wait */
+gboolean
+timeout_flag (gpointer user_data)
+{
+    *(gboolean *) user_data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+/* Runs the main loop for @ms milliseconds */
+void
+spin (guint ms)
+{
+    gboolean done = FALSE;
+
+    g_timeout_add(ms, timeout_flag, &done);
+
+    while (!done) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    return;
+}
+
+/* Asks the item at @path of @name for its state page, like a host
+   would.  Returns the file descriptor to map, or -1 with @error set. */
+gint
+state_page_fd_get (GDBusConnection * bus, const gchar * name, const gchar * path, GError ** error)
+{
+    GAsyncResult * res = NULL;
+    GUnixFDList * fds = NULL;
+    GVariant * reply;
+    gint index;
+    gint fd;
+
+    g_dbus_connection_call_with_unix_fd_list(bus, name, path, NOTIFICATION_ITEM_DBUS_IFACE,
+                                             "XAyatanaGetStatePage", NULL, G_VARIANT_TYPE("(h)"),
+                                             G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, async_result_cb, &res);
+
+    reply = g_dbus_connection_call_with_unix_fd_list_finish(bus, &fds, async_result_wait(&res), error);
+    g_object_unref(res);
+
+    if (reply == NULL) {
+        return -1;
+    }
+
+    g_variant_get(reply, "(h)", &index);
+    fd = g_unix_fd_list_get(fds, index, error);
+
+    g_variant_unref(reply);
+    g_object_unref(fds);
+
+    return fd;
+}
+
+/* Drops the comma after the last result and appends @closing */
+void
+bench_json_close (GString * json, const gchar * closing)
+{
+    if (json->len >= 2 && json->str[json->len - 2] == ',') {
+        g_string_erase(json, json->len - 2, 1);
+    }
+
+    g_string_append(json, closing);
+    return;
+}
+
+/* Writes @json to @output, or to stdout when that is NULL */
+void
+bench_json_write (GString * json, const gchar * output)
+{
+    GError * error = NULL;
+
+    if (output == NULL) {
+        g_print("%s", json->str);
+        return;
+    }
+
+    if (!g_file_set_contents(output, json->str, json->len, &error)) {
+        g_printerr("Unable to write '%s': %s\n", output, error->message);
+        g_error_free(error);
+    }
+
+    return;
+}
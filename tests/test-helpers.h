@@ -0,0 +1,65 @@
+/*
+Code shared by the tests and the benchmarks: a mock StatusNotifierWatcher
+that also acts as the host, waiting for asynchronous results while the
+main loop runs, getting the state page of an item and writing the JSON
+results of a benchmark.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TEST_HELPERS_H__
+#define __TEST_HELPERS_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MockWatcher MockWatcher;
+
+/* Called for every RegisterStatusNotifierItem, @service is what the
+   item sent: its bus name or its object path */
+typedef void (* MockWatcherItemFunc) (MockWatcher * watcher, const gchar * sender, const gchar * service);
+
+struct _MockWatcher {
+    GDBusConnection * connection;
+    guint object;
+    guint name;
+    gboolean owned;
+    /* What IsStatusNotifierHostRegistered says */
+    gboolean host_registered;
+    gint items_registered;
+    gint host_queries;
+    MockWatcherItemFunc item_registered;
+    gpointer user_data;
+};
+
+GDBusConnection * mock_connection_new (const gchar * address);
+
+void mock_watcher_start (MockWatcher * watcher, GDBusConnection * connection);
+void mock_watcher_stop (MockWatcher * watcher);
+void mock_watcher_register_host (MockWatcher * watcher);
+
+void async_result_cb (GObject * source, GAsyncResult * res, gpointer user_data);
+GAsyncResult * async_result_wait (GAsyncResult ** res);
+gboolean timeout_flag (gpointer user_data);
+void spin (guint ms);
+
+gint state_page_fd_get (GDBusConnection * bus, const gchar * name, const gchar * path, GError ** error);
+
+void bench_json_close (GString * json, const gchar * closing);
+void bench_json_write (GString * json, const gchar * output);
+
+G_END_DECLS
+
+#endif /* __TEST_HELPERS_H__ */
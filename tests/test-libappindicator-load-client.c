@@ -0,0 +1,321 @@
+/*
+Load tests for the libappindicator library.  This is the host side, it
+acts as the StatusNotifierWatcher, spawns processes full of indicators
+and measures how long it takes to sync all of them again after the
+watcher has been restarted.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "../src/dbus-shared.h"
+#include "test-helpers.h"
+
+#define SYNC_TIMEOUT  120 /* in seconds */
+
+static gint processes = 4;
+static gchar * sizes = NULL;
+static gchar * output = NULL;
+
+static GOptionEntry options[] = {
+    { "processes", 'p', 0, G_OPTION_ARG_INT, &processes, "Number of indicator processes to spread the indicators over", "N" },
+    { "sizes", 's', 0, G_OPTION_ARG_STRING, &sizes, "Comma separated numbers of indicators to run with (default: 1,100,1000)", "LIST" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to FILE instead of stdout", "FILE" },
+    { NULL }
+};
+
+/* The current watcher */
+static MockWatcher watcher = { 0 };
+static GHashTable * registered = NULL;
+static guint synced = 0;
+
+/* Written from the GDBus worker thread */
+static gint messages = 0;
+
+static GDBusMessage *
+watcher_filter (GDBusConnection * connection, GDBusMessage * message, gboolean incoming, gpointer user_data)
+{
+    g_atomic_int_inc(&messages);
+    return message;
+}
+
+/* Like a real host, every item gets all of its properties read */
+static void
+get_all_cb (GObject * object, GAsyncResult * res, gpointer user_data)
+{
+    GError * error = NULL;
+    GVariant * props = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
+
+    if (error != NULL) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED)) {
+            g_warning("Unable to get the properties of an item: %s", error->message);
+        }
+
+        g_error_free(error);
+        return;
+    }
+
+    g_variant_unref(props);
+
+    /* Replies to the watcher before the restart don't count */
+    if (G_DBUS_CONNECTION(object) == watcher.connection) {
+        synced++;
+    }
+    return;
+}
+
+static void
+item_registered (MockWatcher * mock, const gchar * sender, const gchar * service)
+{
+    gchar * key = g_strdup_printf("%s%s", sender, service);
+
+    if (g_hash_table_contains(registered, key)) {
+        g_free(key);
+        return;
+    }
+
+    g_hash_table_add(registered, key);
+
+    g_dbus_connection_call(mock->connection, sender,
+                           service[0] == '/' ? service : NOTIFICATION_ITEM_DEFAULT_OBJ,
+                           DBUS_INTERFACE_PROPERTIES, "GetAll",
+                           g_variant_new("(s)", NOTIFICATION_ITEM_DBUS_IFACE),
+                           G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE,
+                           -1, NULL, get_all_cb, NULL);
+    return;
+}
+
+/* A new watcher on its own connection, as if it had just been
+   started */
+static void
+watcher_start (void)
+{
+    GError * error = NULL;
+    gchar * address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    GDBusConnection * connection;
+
+    g_assert_no_error(error);
+
+    connection = mock_connection_new(address);
+    g_free(address);
+
+    g_atomic_int_set(&messages, 0);
+    g_dbus_connection_add_filter(connection, watcher_filter, NULL, NULL);
+
+    registered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    synced = 0;
+
+    watcher.host_registered = TRUE;
+    watcher.item_registered = item_registered;
+    mock_watcher_start(&watcher, connection);
+
+    g_object_unref(connection);
+    return;
+}
+
+/* Goes away the hard way, like a crashing host */
+static void
+watcher_stop (void)
+{
+    GDBusConnection * connection = g_object_ref(watcher.connection);
+
+    mock_watcher_stop(&watcher);
+    g_dbus_connection_close_sync(connection, NULL, NULL);
+    g_object_unref(connection);
+    g_clear_pointer(&registered, g_hash_table_destroy);
+    return;
+}
+
+static gboolean
+wait_for_sync (guint count)
+{
+    gboolean timed_out = FALSE;
+    guint timeout = g_timeout_add_seconds(SYNC_TIMEOUT, timeout_flag, &timed_out);
+
+    while (synced < count && !timed_out) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    if (!timed_out) {
+        g_source_remove(timeout);
+    }
+
+    return !timed_out;
+}
+
+/* User and system time of @pid, in microseconds */
+static gint64
+process_cpu_time (GPid pid)
+{
+    gchar * path = g_strdup_printf("/proc/%d/stat", (gint) pid);
+    gchar * contents = NULL;
+    gint64 usec = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        /* The fields after the command name, which may contain spaces */
+        gchar * fields = strrchr(contents, ')');
+        gchar ** tokens = fields != NULL ? g_strsplit(fields + 2, " ", 0) : NULL;
+
+        if (tokens != NULL && g_strv_length(tokens) > 12) {
+            gint64 ticks = g_ascii_strtoll(tokens[11], NULL, 10) + g_ascii_strtoll(tokens[12], NULL, 10);
+            usec = ticks * G_USEC_PER_SEC / sysconf(_SC_CLK_TCK);
+        }
+
+        g_strfreev(tokens);
+    }
+
+    g_free(contents);
+    g_free(path);
+
+    return usec;
+}
+
+static gint64
+processes_cpu_time (GPid * pids, guint n_pids)
+{
+    gint64 usec = 0;
+    guint i;
+
+    for (i = 0; i < n_pids; i++) {
+        usec += process_cpu_time(pids[i]);
+    }
+
+    return usec;
+}
+
+static gboolean
+run (GString * json, const gchar * server, guint count)
+{
+    guint n_pids = MAX(MIN((guint) processes, count), 1);
+    GPid * pids = g_new0(GPid, n_pids);
+    gint64 start, initial, resync, cpu;
+    gint resync_messages;
+    gboolean ok;
+    guint i;
+
+    watcher_start();
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < n_pids; i++) {
+        GError * error = NULL;
+        gchar * prefix = g_strdup_printf("load-%u-%u", count, i);
+        gchar * share = g_strdup_printf("%u", count / n_pids + (i < count % n_pids ? 1 : 0));
+        gchar * argv[] = { (gchar *) server, prefix, share, NULL };
+
+        if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pids[i], &error)) {
+            g_error("Unable to start '%s': %s", server, error->message);
+        }
+
+        g_free(prefix);
+        g_free(share);
+    }
+
+    ok = wait_for_sync(count);
+    initial = g_get_monotonic_time() - start;
+
+    if (ok) {
+        watcher_stop();
+
+        cpu = processes_cpu_time(pids, n_pids);
+        start = g_get_monotonic_time();
+
+        watcher_start();
+        ok = wait_for_sync(count);
+
+        resync = g_get_monotonic_time() - start;
+        cpu = processes_cpu_time(pids, n_pids) - cpu;
+        resync_messages = g_atomic_int_get(&messages);
+
+        g_string_append_printf(json,
+                               "    { \"indicators\": %u, \"processes\": %u, \"synced\": %s, "
+                               "\"initial_sync_usec\": %" G_GINT64_FORMAT ", "
+                               "\"resync_usec\": %" G_GINT64_FORMAT ", "
+                               "\"resync_messages\": %d, \"messages_per_indicator\": %.2f, "
+                               "\"cpu_usec_per_indicator\": %.1f },\n",
+                               count, n_pids, ok ? "true" : "false", initial, resync,
+                               resync_messages, (gdouble) resync_messages / count,
+                               (gdouble) cpu / count);
+    } else {
+        g_string_append_printf(json,
+                               "    { \"indicators\": %u, \"processes\": %u, \"synced\": false },\n",
+                               count, n_pids);
+    }
+
+    for (i = 0; i < n_pids; i++) {
+        kill(pids[i], SIGTERM);
+        waitpid(pids[i], NULL, 0);
+        g_spawn_close_pid(pids[i]);
+    }
+
+    watcher_stop();
+    g_free(pids);
+
+    return ok;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    GOptionContext * context = g_option_context_new("- load test libayatana-appindicator hosts");
+    GError * error = NULL;
+    gchar * dir;
+    gchar * server;
+    gchar ** counts;
+    GString * json;
+    gboolean ok = TRUE;
+    guint i;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    g_option_context_free(context);
+
+    dir = g_path_get_dirname(argv[0]);
+    server = g_build_filename(dir, "test-libappindicator-load-server", NULL);
+    counts = g_strsplit(sizes != NULL ? sizes : "1,100,1000", ",", 0);
+
+    json = g_string_new("{\n");
+    g_string_append_printf(json, "  \"processes\": %d,\n", processes);
+    g_string_append(json, "  \"results\": [\n");
+
+    for (i = 0; counts[i] != NULL; i++) {
+        guint count = (guint) g_ascii_strtoull(counts[i], NULL, 10);
+
+        if (count > 0) {
+            ok = run(json, server, count) && ok;
+        }
+    }
+
+    bench_json_close(json, "  ]\n}\n");
+    bench_json_write(json, output);
+
+    g_string_free(json, TRUE);
+    g_strfreev(counts);
+    g_free(server);
+    g_free(dir);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+/*
+Load tests for the libappindicator library.  This is the indicator side,
+it puts a number of indicators on the bus and keeps them there until it
+is told to stop.
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <signal.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include <app-indicator.h>
+
+static GMainLoop * mainloop = NULL;
+
+static gboolean
+quit (gpointer unused G_GNUC_UNUSED)
+{
+    g_main_loop_quit (mainloop);
+    return G_SOURCE_REMOVE;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+    gtk_init(&argc, &argv);
+
+    if (argc != 3) {
+        g_printerr("Usage: %s <prefix> <count>\n", argv[0]);
+        return 1;
+    }
+
+    const gchar * prefix = argv[1];
+    guint count = (guint) g_ascii_strtoull(argv[2], NULL, 10);
+    AppIndicator ** indicators = g_new0(AppIndicator *, count);
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        gchar * id = g_strdup_printf("%s-%u", prefix, i);
+        gchar * label = g_strdup_printf("%u", i);
+
+        indicators[i] = app_indicator_new (id, "my-icon-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+        app_indicator_set_attention_icon_full (indicators[i], "my-attention-icon", NULL);
+        app_indicator_set_label (indicators[i], label, "9999");
+
+        GtkMenu * menu = GTK_MENU(gtk_menu_new());
+        GtkMenuItem * item = GTK_MENU_ITEM(gtk_menu_item_new_with_label("Label"));
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), GTK_WIDGET(item));
+
+        app_indicator_set_menu(indicators[i], menu);
+        app_indicator_set_status(indicators[i], APP_INDICATOR_STATUS_ACTIVE);
+
+        g_free(id);
+        g_free(label);
+    }
+
+    g_unix_signal_add(SIGTERM, quit, NULL);
+    g_unix_signal_add(SIGINT, quit, NULL);
+
+    mainloop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(mainloop);
+
+    for (i = 0; i < count; i++) {
+        g_object_unref(G_OBJECT(indicators[i]));
+    }
+
+    g_free(indicators);
+    g_main_loop_unref(mainloop);
+
+    g_debug("Quiting");
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Checks that the library has the USDT probes given after its path.
+#
+# Usage: test-libappindicator-probes.sh LIBRARY PROBE...
+
+LIBRARY="$1"
+shift
+
+NOTES=`readelf -n "$LIBRARY"` || exit 1
+RET=0
+
+for PROBE in "$@"; do
+    if echo "$NOTES" | grep -A 1 "Provider: libayatana_appindicator" | grep -q "Name: $PROBE\$"; then
+        echo "Found probe $PROBE"
+    else
+        echo "Missing probe $PROBE"
+        RET=1
+    fi
+done
+
+exit $RET
@@ -24,12 +24,17 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 
 #include <app-indicator.h>
 
 #include <libdbusmenu-glib/menuitem.h>
 #include <libdbusmenu-glib/server.h>
 
+#include "dbus-shared.h"
+#include "state-page-reader.h"
+#include "test-helpers.h"
+
 static gboolean
 allow_warnings (const gchar *log_domain, GLogLevelFlags log_level,
                 const gchar *message, gpointer user_data)
@@ -372,6 +377,69 @@ test_libappindicator_label_signals (void)
     return;
 }
 
+static gpointer
+label_template_thread (gpointer user_data)
+{
+    AppIndicator * ci = APP_INDICATOR(user_data);
+    gint i;
+
+    for (i = 0; i <= 1000; i++) {
+        app_indicator_set_label_value(ci, i);
+    }
+
+    return NULL;
+}
+
+void
+test_libappindicator_label_template (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    gint label_signals_count = 0;
+    AppIndicator * ci = app_indicator_new ("my-id-label-template",
+                                           "my-name",
+                                           APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+
+    g_assert(ci != NULL);
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_NEW_LABEL, G_CALLBACK(label_signals_cb), &label_signals_count);
+
+    app_indicator_set_label_template(ci, "%.0f MB/s", "9999 MB/s");
+    label_signals_check();
+    g_assert_cmpint(label_signals_count, ==, 1);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "0 MB/s");
+    g_assert_cmpstr(app_indicator_get_label_guide(ci), ==, "9999 MB/s");
+
+    /* Only the last value is made into a label */
+    label_signals_count = 0;
+    app_indicator_set_label_value(ci, 1);
+    app_indicator_set_label_value(ci, 2);
+    app_indicator_set_label_value(ci, 42);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "0 MB/s");
+
+    label_signals_check();
+    g_assert_cmpint(label_signals_count, ==, 1);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "42 MB/s");
+
+    /* Values from another thread end up in the owner context */
+    label_signals_count = 0;
+    g_thread_join(g_thread_new("label-template", label_template_thread, ci));
+    label_signals_check();
+    g_assert_cmpint(label_signals_count, ==, 1);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "1000 MB/s");
+
+    /* A label of its own stops the template */
+    app_indicator_set_label(ci, "label", "guide");
+    label_signals_check();
+    label_signals_count = 0;
+    app_indicator_set_label_value(ci, 7);
+    label_signals_check();
+    g_assert_cmpint(label_signals_count, ==, 0);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "label");
+
+    g_object_unref(G_OBJECT(ci));
+    return;
+}
+
 void
 test_libappindicator_desktop_menu (void)
 {
@@ -445,6 +513,1759 @@ test_libappindicator_desktop_menu_bad (void)
     return;
 }
 
+static GVariant * bus_property_get (GDBusConnection * bus, const gchar * path, const gchar * property);
+static guint64 statistics_lookup (AppIndicator * ci, const gchar * key);
+
+void
+icon_animation_count_cb (AppIndicator * ci, gpointer user_data)
+{
+    gint * count = (gint *)user_data;
+    (*count)++;
+    return;
+}
+
+gboolean
+icon_animation_quit (gpointer user_data)
+{
+    g_main_loop_quit((GMainLoop *)user_data);
+    return G_SOURCE_REMOVE;
+}
+
+void
+test_libappindicator_icon_animation (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    const gchar * frames[] = { "frame-1", "frame-2", "frame-3", NULL };
+    gint count = 0;
+    AppIndicator * ci = app_indicator_new ("my-id-icon-animation",
+                                           "my-name",
+                                           APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    GMainLoop * loop = g_main_loop_new(NULL, FALSE);
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    GVariant * value;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_NEW_ICON, G_CALLBACK(icon_animation_count_cb), &count);
+
+    /* Passive indicators are not animated */
+    app_indicator_set_icon_animation(ci, frames, 20);
+    g_assert(count == 1);
+    count = 0;
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count == 0);
+
+    /* Active ones step through the frames */
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count >= 3);
+    g_assert(!g_strcmp0("my-name", app_indicator_get_icon(ci)));
+
+    /* A new icon stops the animation */
+    app_indicator_set_icon_full(ci, "my-other-name", NULL);
+    count = 0;
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count == 0);
+
+    /* So does the icon it started from */
+    app_indicator_set_icon_animation(ci, frames, 20);
+    app_indicator_set_icon_full(ci, "my-other-name", NULL);
+    count = 0;
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count == 0);
+
+    /* A host animating on its own stops the frames, with the signals
+       going to everybody too */
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    value = bus_property_get(bus, "/org/ayatana/NotificationItem/my_id_icon_animation", "Id");
+    g_assert(value != NULL);
+    g_variant_unref(value);
+
+    app_indicator_set_icon_animation(ci, frames, 20);
+    g_dbus_connection_call(bus, g_dbus_connection_get_unique_name(bus),
+                           "/org/ayatana/NotificationItem/my_id_icon_animation",
+                           "org.kde.StatusNotifierItem", "XAyatanaAnimateIcon",
+                           g_variant_new("(b)", TRUE), NULL, G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, NULL, NULL);
+    g_timeout_add(100, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    count = 0;
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count == 0);
+
+    /* And they start again once it doesn't */
+    g_dbus_connection_call(bus, g_dbus_connection_get_unique_name(bus),
+                           "/org/ayatana/NotificationItem/my_id_icon_animation",
+                           "org.kde.StatusNotifierItem", "XAyatanaAnimateIcon",
+                           g_variant_new("(b)", FALSE), NULL, G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, NULL, NULL);
+    g_timeout_add(100, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    count = 0;
+    g_timeout_add(200, icon_animation_quit, loop);
+    g_main_loop_run(loop);
+    g_assert(count >= 3);
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_PASSIVE);
+    g_main_loop_unref(loop);
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+    return;
+}
+
+void
+test_libappindicator_icon_allocations (void)
+{
+    const gchar * icons[] = { "my-icon-1", "my-icon-2", "my-icon-3" };
+    guint64 interned;
+    guint i;
+    AppIndicator * ci = app_indicator_new ("my-id-icon-allocations",
+                                           "my-name",
+                                           APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+
+    g_assert(ci != NULL);
+
+    /* The first round may allocate */
+    for (i = 0; i < 3; i++) {
+        app_indicator_set_icon_full(ci, icons[i], "my-desc");
+        app_indicator_set_attention_icon_full(ci, icons[i], "my-attention-desc");
+    }
+
+    interned = statistics_lookup(ci, "interned-strings");
+
+    for (i = 0; i < 3000000; i++) {
+        app_indicator_set_icon_full(ci, icons[i % 3], "my-desc");
+    }
+
+    for (i = 0; i < 3000000; i++) {
+        app_indicator_set_attention_icon_full_static(ci, icons[i % 3], "my-attention-desc");
+    }
+
+    /* Nothing new was interned, switching icons only swaps pointers */
+    g_assert_cmpuint(statistics_lookup(ci, "interned-strings"), ==, interned);
+    g_assert(!g_strcmp0("my-icon-3", app_indicator_get_icon(ci)));
+    g_assert(!g_strcmp0("my-icon-3", app_indicator_get_attention_icon(ci)));
+    g_assert(!g_strcmp0("my-attention-desc", app_indicator_get_attention_icon_desc(ci)));
+
+    g_object_unref(G_OBJECT(ci));
+    return;
+}
+
+static void
+theme_changed_new_icon_cb (GDBusConnection * bus, const gchar * sender, const gchar * path,
+                           const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+{
+    guint * count = (guint *)user_data;
+    (*count)++;
+    return;
+}
+
+static gboolean
+theme_changed_emit (gpointer user_data)
+{
+    g_signal_emit_by_name(gtk_icon_theme_get_default(), "changed");
+    return G_SOURCE_CONTINUE;
+}
+
+/* Runs the main loop until @count reaches @wanted or @msec pass */
+static void
+theme_changed_wait (guint * count, guint wanted, guint msec)
+{
+    gint64 end = g_get_monotonic_time() + msec * 1000;
+
+    while (*count < wanted && g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+        g_usleep(1000);
+    }
+
+    return;
+}
+
+void
+test_libappindicator_theme_changed (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    AppIndicator * cis[100];
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    guint count = 0;
+    guint stream;
+    guint sub;
+    guint i;
+
+    g_assert(bus != NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(cis); i++) {
+        gchar * id = g_strdup_printf("my-id-theme-changed-%u", i);
+        gchar * path = g_strdup_printf("/org/ayatana/NotificationItem/my_id_theme_changed_%u", i);
+        GVariant * value;
+
+        cis[i] = app_indicator_new (id, "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+        g_assert(cis[i] != NULL);
+        app_indicator_set_menu(cis[i], GTK_MENU(gtk_menu_new()));
+
+        value = bus_property_get(bus, path, "Id");
+        g_assert(value != NULL);
+        g_variant_unref(value);
+
+        g_free(path);
+        g_free(id);
+    }
+
+    sub = g_dbus_connection_signal_subscribe(bus, g_dbus_connection_get_unique_name(bus),
+                                             "org.kde.StatusNotifierItem", "NewIcon", NULL, NULL,
+                                             G_DBUS_SIGNAL_FLAGS_NONE, theme_changed_new_icon_cb, &count, NULL);
+
+    /* A theme switch comes with a burst of changes, the hosts hear
+       about it once */
+    for (i = 0; i < 5; i++) {
+        g_signal_emit_by_name(gtk_icon_theme_get_default(), "changed");
+    }
+
+    g_assert_cmpuint(count, ==, 0);
+
+    theme_changed_wait(&count, G_N_ELEMENTS(cis), 2000);
+    theme_changed_wait(&count, G_N_ELEMENTS(cis) + 1, 300);
+    g_assert_cmpuint(count, ==, G_N_ELEMENTS(cis));
+
+    /* Changes that never stop still get the icons refreshed */
+    count = 0;
+    stream = g_timeout_add(50, theme_changed_emit, NULL);
+
+    theme_changed_wait(&count, G_N_ELEMENTS(cis), 3000);
+    g_assert_cmpuint(count, ==, G_N_ELEMENTS(cis));
+
+    g_source_remove(stream);
+    g_dbus_connection_signal_unsubscribe(bus, sub);
+
+    for (i = 0; i < G_N_ELEMENTS(cis); i++) {
+        g_object_unref(G_OBJECT(cis[i]));
+    }
+
+    g_object_unref(bus);
+    return;
+}
+
+/* Whether GTK finds @icon in @theme under @path */
+static gboolean
+icon_theme_cache_has_icon (const gchar * path, const gchar * theme, const gchar * icon)
+{
+    GtkIconTheme * icon_theme = gtk_icon_theme_new();
+    const gchar * search_path[] = { path };
+    gboolean found;
+
+    gtk_icon_theme_set_search_path(icon_theme, search_path, 1);
+    gtk_icon_theme_set_custom_theme(icon_theme, theme);
+    found = gtk_icon_theme_has_icon(icon_theme, icon);
+
+    g_object_unref(icon_theme);
+    return found;
+}
+
+void
+test_libappindicator_icon_theme_cache (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    const gchar * index = "[Icon Theme]\nName=My Theme\nDirectories=48x48/apps\n\n"
+                          "[48x48/apps]\nSize=48\nContext=Applications\nType=Fixed\n";
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    gchar * source;
+    gchar * icons;
+    gchar * file;
+    gchar * cached = NULL;
+    gchar * program;
+    gint64 end;
+    AppIndicator * ci;
+
+    program = g_find_program_in_path("gtk-update-icon-cache");
+    if (program == NULL) {
+        g_test_skip("gtk-update-icon-cache is not available");
+        return;
+    }
+
+    g_free(program);
+    g_assert(bus != NULL);
+
+    source = g_dir_make_tmp("test-icon-theme-cache-XXXXXX", NULL);
+    g_assert(source != NULL);
+
+    icons = g_build_filename(source, "my-theme", "48x48", "apps", NULL);
+    g_assert_cmpint(g_mkdir_with_parents(icons, 0700), ==, 0);
+
+    file = g_build_filename(source, "my-theme", "index.theme", NULL);
+    g_assert(g_file_set_contents(file, index, -1, NULL));
+    g_free(file);
+
+    /* The cache only has the names, nothing reads the image */
+    file = g_build_filename(icons, "my-cached-icon.png", NULL);
+    g_assert(g_file_set_contents(file, "", 0, NULL));
+
+    ci = app_indicator_new_with_path ("my-id-icon-theme-cache", "my-cached-icon",
+                                      APP_INDICATOR_CATEGORY_APPLICATION_STATUS, source);
+    g_assert(ci != NULL);
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_icon_theme_cache(ci, TRUE);
+
+    /* Hosts are pointed at the mirror once its caches are built */
+    end = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+    while (cached == NULL && g_get_monotonic_time() < end) {
+        GVariant * value = bus_property_get(bus, "/org/ayatana/NotificationItem/my_id_icon_theme_cache",
+                                            "IconThemePath");
+        g_assert(value != NULL);
+
+        if (g_strcmp0(g_variant_get_string(value, NULL), source) != 0) {
+            cached = g_variant_dup_string(value, NULL);
+        }
+
+        g_variant_unref(value);
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    g_assert(cached != NULL);
+
+    /* The cache is where GTK looks for it, per theme */
+    gchar * cache_file = g_build_filename(cached, "my-theme", "icon-theme.cache", NULL);
+    g_assert(g_file_test(cache_file, G_FILE_TEST_IS_REGULAR));
+    g_free(cache_file);
+
+    g_assert(icon_theme_cache_has_icon(cached, "my-theme", "my-cached-icon"));
+
+    /* Without the file only the cache still knows about the icon, so
+       that is what GTK read */
+    g_assert_cmpint(g_unlink(file), ==, 0);
+    g_free(file);
+    g_assert(!icon_theme_cache_has_icon(source, "my-theme", "my-cached-icon"));
+    g_assert(icon_theme_cache_has_icon(cached, "my-theme", "my-cached-icon"));
+
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+
+    file = g_build_filename(source, "my-theme", "index.theme", NULL);
+    g_unlink(file);
+    g_free(file);
+    g_rmdir(icons);
+    g_free(icons);
+    icons = g_build_filename(source, "my-theme", "48x48", NULL);
+    g_rmdir(icons);
+    g_free(icons);
+    icons = g_build_filename(source, "my-theme", NULL);
+    g_rmdir(icons);
+    g_free(icons);
+    g_rmdir(source);
+    g_free(source);
+    g_free(cached);
+    return;
+}
+
+static guint64
+statistics_lookup (AppIndicator * ci, const gchar * key)
+{
+    GVariant * stats = app_indicator_get_statistics(ci);
+    guint64 value = 0;
+
+    g_assert(stats != NULL);
+    g_assert(g_variant_is_of_type(stats, G_VARIANT_TYPE_VARDICT));
+    g_assert(g_variant_lookup(stats, key, "t", &value));
+
+    g_variant_unref(stats);
+    return value;
+}
+
+void
+test_libappindicator_statistics (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    AppIndicator * ci = app_indicator_new ("my-id-statistics", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    g_assert(ci != NULL);
+
+    guint64 setters = statistics_lookup(ci, "setter-calls");
+    guint64 coalesced = statistics_lookup(ci, "signals-coalesced");
+
+    /* Nothing is on the bus, so nothing can be sent */
+    app_indicator_set_label(ci, "label", "guide");
+    app_indicator_set_label(ci, "label2", "guide2");
+    app_indicator_set_title(ci, "title");
+
+    g_assert_cmpuint(statistics_lookup(ci, "setter-calls"), ==, setters + 3);
+    g_assert_cmpuint(statistics_lookup(ci, "signals-coalesced"), >, coalesced);
+    g_assert_cmpuint(statistics_lookup(ci, "signals-emitted"), ==, 0);
+    g_assert_cmpuint(statistics_lookup(ci, "bytes-sent"), ==, 0);
+
+    GVariant * stats = app_indicator_get_statistics(ci);
+    GVariant * scroll = g_variant_lookup_value(stats, "scroll-latency", G_VARIANT_TYPE("at"));
+    GVariant * bounds = g_variant_lookup_value(stats, "latency-bounds-us", G_VARIANT_TYPE("at"));
+
+    g_assert(scroll != NULL);
+    g_assert(bounds != NULL);
+    g_assert_cmpuint(g_variant_n_children(scroll), ==, g_variant_n_children(bounds) + 1);
+
+    g_variant_unref(scroll);
+    g_variant_unref(bounds);
+    g_variant_unref(stats);
+
+    g_object_unref(G_OBJECT(ci));
+    return;
+}
+
+#define THREADED_SETTERS_THREADS  4
+#define THREADED_SETTERS_UPDATES  10000
+
+static gint threaded_setters_done = 0;
+
+static gpointer
+threaded_setters_thread (gpointer user_data)
+{
+    AppIndicator * ci = APP_INDICATOR(user_data);
+    guint i;
+
+    for (i = 0; i < THREADED_SETTERS_UPDATES; i++) {
+        gchar * label = g_strdup_printf("%u", i);
+
+        app_indicator_set_label(ci, label, NULL);
+        app_indicator_set_icon_full_static(ci, (i % 2) ? "icon-odd" : "icon-even", NULL);
+        app_indicator_set_status(ci, (i % 2) ? APP_INDICATOR_STATUS_ATTENTION : APP_INDICATOR_STATUS_ACTIVE);
+
+        g_free(label);
+    }
+
+    g_atomic_int_inc(&threaded_setters_done);
+    return NULL;
+}
+
+static gpointer
+threaded_setters_burst (gpointer user_data)
+{
+    AppIndicator * ci = APP_INDICATOR(user_data);
+    guint i;
+
+    for (i = 0; i < 100; i++) {
+        gchar * icon = g_strdup_printf("icon-burst-%u", i);
+        app_indicator_set_icon_full(ci, icon, NULL);
+        g_free(icon);
+    }
+
+    return NULL;
+}
+
+/* Drops the last reference while setting the icon from this thread */
+static gpointer
+threaded_setters_last_unref (gpointer user_data)
+{
+    AppIndicator * ci = APP_INDICATOR(user_data);
+
+    app_indicator_set_icon_full(ci, "icon-last", NULL);
+    g_object_unref(G_OBJECT(ci));
+
+    return NULL;
+}
+
+void
+test_libappindicator_threaded_setters (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    AppIndicator * ci = app_indicator_new ("my-id-threaded-setters", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    GThread * threads[THREADED_SETTERS_THREADS];
+    gint count = 0;
+    guint i;
+
+    g_assert(ci != NULL);
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_NEW_ICON, G_CALLBACK(icon_animation_count_cb), &count);
+
+    /* The owner context keeps picking up values while they come in */
+    for (i = 0; i < THREADED_SETTERS_THREADS; i++) {
+        threads[i] = g_thread_new("threaded-setters", threaded_setters_thread, ci);
+    }
+
+    while (g_atomic_int_get(&threaded_setters_done) < THREADED_SETTERS_THREADS) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    for (i = 0; i < THREADED_SETTERS_THREADS; i++) {
+        g_thread_join(threads[i]);
+    }
+
+    while (g_main_context_iteration(NULL, FALSE));
+
+    /* All of the threads ended on the same values */
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "9999");
+    g_assert_cmpstr(app_indicator_get_icon(ci), ==, "icon-odd");
+    g_assert_cmpint(app_indicator_get_status(ci), ==, APP_INDICATOR_STATUS_ATTENTION);
+
+    /* Nothing picks them up while this runs, so only the last one is
+       applied */
+    count = 0;
+    g_thread_join(g_thread_new("threaded-setters-burst", threaded_setters_burst, ci));
+
+    g_assert_cmpstr(app_indicator_get_icon(ci), ==, "icon-odd");
+
+    while (g_main_context_iteration(NULL, FALSE));
+
+    g_assert_cmpstr(app_indicator_get_icon(ci), ==, "icon-burst-99");
+    g_assert_cmpint(count, ==, 1);
+
+    /* The last reference going away in another thread leaves the
+       teardown to the owner context */
+    AppIndicator * weak = ci;
+    g_object_add_weak_pointer(G_OBJECT(ci), (gpointer *) &weak);
+    g_thread_join(g_thread_new("threaded-setters-unref", threaded_setters_last_unref, ci));
+
+    g_assert(weak != NULL);
+
+    while (g_main_context_iteration(NULL, FALSE));
+
+    g_assert(weak == NULL);
+    return;
+}
+
+void
+test_libappindicator_last_unref_in_thread (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    const gchar * frames[] = { "frame-1", "frame-2", NULL };
+    AppIndicator * ci = app_indicator_new ("my-id-last-unref", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    AppIndicator * other = app_indicator_new ("my-id-last-unref-other", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    AppIndicator * weak = ci;
+    gint count = 0;
+
+    g_assert(ci != NULL);
+    g_assert(other != NULL);
+
+    /* On the lists shared by all indicators */
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+    app_indicator_set_icon_animation(ci, frames, 20);
+
+    g_object_add_weak_pointer(G_OBJECT(ci), (gpointer *) &weak);
+
+    /* Nothing runs the default context while the thread could take it */
+    g_thread_join(g_thread_new("last-unref", threaded_setters_last_unref, ci));
+    g_assert(weak != NULL);
+
+    while (g_main_context_iteration(NULL, FALSE));
+    g_assert(weak == NULL);
+
+    /* The shared timer only steps what is left */
+    g_signal_connect(G_OBJECT(other), APP_INDICATOR_SIGNAL_NEW_ICON, G_CALLBACK(icon_animation_count_cb), &count);
+    app_indicator_set_status(other, APP_INDICATOR_STATUS_ACTIVE);
+    app_indicator_set_icon_animation(other, frames, 20);
+    spin(200);
+    g_assert_cmpint(count, >=, 3);
+
+    app_indicator_set_status(other, APP_INDICATOR_STATUS_PASSIVE);
+    g_object_unref(G_OBJECT(other));
+
+    return;
+}
+
+static gpointer
+dbus_context_thread (gpointer user_data)
+{
+    GMainLoop * loop = (GMainLoop *) user_data;
+
+    g_main_context_push_thread_default(g_main_loop_get_context(loop));
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(g_main_loop_get_context(loop));
+
+    return NULL;
+}
+
+void
+test_libappindicator_dbus_context (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GMainContext * context = g_main_context_new();
+    GMainLoop * loop = g_main_loop_new(context, FALSE);
+    GThread * thread = g_thread_new("dbus-context", dbus_context_thread, loop);
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new_with_context ("my-id-dbus-context", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS, context);
+    GMainContext * dbus_context = NULL;
+    GVariant * reply = NULL;
+    gint64 end;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    g_object_get(G_OBJECT(ci), "dbus-context", &dbus_context, NULL);
+    g_assert(dbus_context == context);
+    g_main_context_unref(dbus_context);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+
+    /* The calls block this thread, so only the other one can answer
+       them once the object is registered */
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (reply == NULL && g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+
+        reply = g_dbus_connection_call_sync(bus,
+                                            g_dbus_connection_get_unique_name(bus),
+                                            "/org/ayatana/NotificationItem/my_id_dbus_context",
+                                            "org.freedesktop.DBus.Properties",
+                                            "Get",
+                                            g_variant_new("(ss)", "org.kde.StatusNotifierItem", "Id"),
+                                            G_VARIANT_TYPE("(v)"),
+                                            G_DBUS_CALL_FLAGS_NONE,
+                                            1000, NULL, NULL);
+    }
+
+    g_assert(reply != NULL);
+
+    GVariant * value = NULL;
+    g_variant_get(reply, "(v)", &value);
+    g_assert_cmpstr(g_variant_get_string(value, NULL), ==, "my-id-dbus-context");
+    g_variant_unref(value);
+    g_variant_unref(reply);
+
+    g_object_unref(G_OBJECT(ci));
+
+    g_main_loop_quit(loop);
+    g_thread_join(thread);
+    g_main_loop_unref(loop);
+    g_main_context_unref(context);
+    g_object_unref(bus);
+
+    return;
+}
+
+void
+test_libappindicator_new_async (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GAsyncResult * res = NULL;
+    GCancellable * cancellable;
+    GError * error = NULL;
+    AppIndicator * ci;
+    gint64 elapsed = -1;
+
+    /* Registered or fallen back, there is an indicator either way */
+    app_indicator_new_async("my-id-new-async", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS,
+                            GTK_MENU(gtk_menu_new()), NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    ci = app_indicator_new_finish(res, &elapsed, &error);
+    g_assert_no_error(error);
+    g_assert(APP_IS_INDICATOR(ci));
+    g_assert_cmpint(elapsed, >=, 0);
+    g_assert(app_indicator_get_menu(ci) != NULL);
+
+    g_object_unref(res);
+    g_object_unref(G_OBJECT(ci));
+
+    /* Cancelling fails the creation */
+    res = NULL;
+    cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+
+    app_indicator_new_async("my-id-new-async-cancel", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS,
+                            GTK_MENU(gtk_menu_new()), cancellable, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    ci = app_indicator_new_finish(res, NULL, &error);
+    g_assert(ci == NULL);
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+    g_error_free(error);
+    g_object_unref(res);
+    g_object_unref(cancellable);
+
+    return;
+}
+
+void
+test_libappindicator_no_session_bus (void)
+{
+    GAsyncResult * res = NULL;
+    GError * error = NULL;
+    AppIndicator * ci;
+
+    if (!g_test_subprocess()) {
+        g_test_trap_subprocess(NULL, 10 * G_USEC_PER_SEC, G_TEST_SUBPROCESS_INHERIT_STDERR);
+        g_test_trap_assert_passed();
+        return;
+    }
+
+    /* The session bus has not been used in this process yet */
+    g_setenv("DBUS_SESSION_BUS_ADDRESS", "unix:path=/nonexistent/bus", TRUE);
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    /* The creation still finishes, with the fallback */
+    app_indicator_new_async("my-id-no-session-bus", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS,
+                            GTK_MENU(gtk_menu_new()), NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    ci = app_indicator_new_finish(res, NULL, &error);
+    g_assert_no_error(error);
+    g_assert(APP_IS_INDICATOR(ci));
+
+    g_object_unref(res);
+    g_object_unref(G_OBJECT(ci));
+
+    return;
+}
+
+static void
+bus_property_cb (GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    GVariant ** reply = (GVariant **) user_data;
+
+    *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, NULL);
+
+    /* Try again, the object might not be registered yet */
+    if (*reply == NULL) {
+        *reply = g_variant_ref_sink(g_variant_new("()"));
+    }
+
+    return;
+}
+
+/* Reads a property of the item from the bus while the main loop runs */
+static GVariant *
+bus_property_get (GDBusConnection * bus, const gchar * path, const gchar * property)
+{
+    gint64 end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+    while (g_get_monotonic_time() < end) {
+        GVariant * reply = NULL;
+
+        g_dbus_connection_call(bus,
+                               g_dbus_connection_get_unique_name(bus),
+                               path,
+                               "org.freedesktop.DBus.Properties",
+                               "Get",
+                               g_variant_new("(ss)", "org.kde.StatusNotifierItem", property),
+                               G_VARIANT_TYPE("(v)"),
+                               G_DBUS_CALL_FLAGS_NONE,
+                               1000, NULL, bus_property_cb, &reply);
+
+        while (reply == NULL) {
+            g_main_context_iteration(NULL, TRUE);
+        }
+
+        if (g_variant_is_of_type(reply, G_VARIANT_TYPE("(v)"))) {
+            GVariant * value = NULL;
+
+            g_variant_get(reply, "(v)", &value);
+            g_variant_unref(reply);
+            return value;
+        }
+
+        g_variant_unref(reply);
+    }
+
+    return NULL;
+}
+
+static void
+tooltip_provider (AppIndicator * ci, gchar ** icon_name, gchar ** title, gchar ** description, gpointer user_data)
+{
+    gint * calls = (gint *) user_data;
+
+    (*calls)++;
+    *title = g_strdup_printf("call %d", *calls);
+
+    return;
+}
+
+void
+test_libappindicator_tooltip (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-tooltip", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_tooltip";
+    const gchar * title = NULL;
+    GVariant * tooltip;
+    gint calls = 0;
+    gint i;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_tooltip_provider(ci, tooltip_provider, &calls, NULL);
+
+    /* Nobody reads it, nothing gets made */
+    for (i = 0; i < 100; i++) {
+        app_indicator_invalidate_tooltip(ci);
+    }
+
+    g_assert_cmpint(calls, ==, 0);
+
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_assert(tooltip != NULL);
+    g_assert_cmpint(calls, ==, 1);
+    g_variant_get(tooltip, "(&sa(iiay)&s&s)", NULL, NULL, &title, NULL);
+    g_assert_cmpstr(title, ==, "call 1");
+    g_variant_unref(tooltip);
+
+    /* It is kept until it is invalidated */
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_assert_cmpint(calls, ==, 1);
+    g_variant_unref(tooltip);
+
+    app_indicator_invalidate_tooltip(ci);
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_assert_cmpint(calls, ==, 2);
+    g_variant_unref(tooltip);
+
+    /* A fixed tooltip replaces the provider */
+    app_indicator_set_tooltip(ci, NULL, "fixed", "description");
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_variant_get(tooltip, "(&sa(iiay)&s&s)", NULL, NULL, &title, NULL);
+    g_assert_cmpstr(title, ==, "fixed");
+    g_assert_cmpint(calls, ==, 2);
+    g_variant_unref(tooltip);
+
+    /* Removing the provider drops what it made */
+    app_indicator_set_tooltip_provider(ci, tooltip_provider, &calls, NULL);
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_assert_cmpint(calls, ==, 3);
+    g_variant_unref(tooltip);
+
+    app_indicator_set_tooltip_provider(ci, NULL, NULL, NULL);
+    tooltip = bus_property_get(bus, path, "ToolTip");
+    g_variant_get(tooltip, "(&sa(iiay)&s&s)", NULL, NULL, &title, NULL);
+    g_assert_cmpstr(title, ==, "");
+    g_assert_cmpint(calls, ==, 3);
+    g_variant_unref(tooltip);
+
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+
+    return;
+}
+
+static gchar *
+text_provider (AppIndicator * ci, gpointer user_data)
+{
+    gint * calls = (gint *) user_data;
+
+    (*calls)++;
+    return g_strdup_printf("call %d", *calls);
+}
+
+void
+test_libappindicator_text_providers (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-text-providers", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_text_providers";
+    gint label_signals_count = 0;
+    gint title_calls = 0;
+    gint label_calls = 0;
+    GVariant * title;
+    gchar * text = NULL;
+    gint i;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_NEW_LABEL, G_CALLBACK(label_signals_cb), &label_signals_count);
+
+    /* The title is only made when it is read */
+    app_indicator_set_title_provider(ci, text_provider, &title_calls, NULL);
+
+    for (i = 0; i < 100; i++) {
+        app_indicator_invalidate_title(ci);
+    }
+
+    g_assert_cmpint(title_calls, ==, 0);
+
+    title = bus_property_get(bus, path, "Title");
+    g_assert(title != NULL);
+    g_assert_cmpstr(g_variant_get_string(title, NULL), ==, "call 1");
+    g_variant_unref(title);
+
+    title = bus_property_get(bus, path, "Title");
+    g_assert_cmpint(title_calls, ==, 1);
+    g_variant_unref(title);
+
+    app_indicator_invalidate_title(ci);
+    g_assert_cmpint(title_calls, ==, 1);
+    g_assert_cmpstr(app_indicator_get_title(ci), ==, "call 2");
+
+    /* The property asks the provider too */
+    app_indicator_invalidate_title(ci);
+    g_object_get(G_OBJECT(ci), "title", &text, NULL);
+    g_assert_cmpstr(text, ==, "call 3");
+    g_free(text);
+
+    /* A title of its own replaces the provider */
+    app_indicator_set_title(ci, "title");
+    app_indicator_invalidate_title(ci);
+    g_assert_cmpstr(app_indicator_get_title(ci), ==, "title");
+    g_assert_cmpint(title_calls, ==, 3);
+
+    /* The label is made once for each label change that goes out */
+    label_signals_check();
+    label_signals_count = 0;
+    app_indicator_set_label_provider(ci, text_provider, &label_calls, NULL);
+
+    for (i = 0; i < 100; i++) {
+        app_indicator_invalidate_label(ci);
+    }
+
+    label_signals_check();
+    g_assert_cmpint(label_calls, ==, 1);
+    g_assert_cmpint(label_signals_count, ==, 1);
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "call 1");
+    g_assert_cmpint(label_calls, ==, 1);
+
+    app_indicator_invalidate_label(ci);
+    g_object_get(G_OBJECT(ci), "label", &text, NULL);
+    g_assert_cmpstr(text, ==, "call 2");
+    g_free(text);
+    label_signals_check();
+    g_assert_cmpint(label_calls, ==, 2);
+
+    app_indicator_set_label(ci, "label", NULL);
+    app_indicator_invalidate_label(ci);
+    label_signals_check();
+    g_assert_cmpstr(app_indicator_get_label(ci), ==, "label");
+    g_assert_cmpint(label_calls, ==, 2);
+
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+
+    return;
+}
+
+typedef struct {
+    gint scroll_events;
+    gint smooth_scrolls;
+    gint delta[2];
+} ScrollCount;
+
+static void
+scroll_event_cb (AppIndicator * ci, gint delta, GdkScrollDirection direction, gpointer user_data)
+{
+    ScrollCount * count = (ScrollCount *) user_data;
+
+    g_assert_cmpint(delta, >, 0);
+    count->scroll_events++;
+
+    return;
+}
+
+static void
+smooth_scroll_cb (AppIndicator * ci, gint delta, GtkOrientation orientation, gpointer user_data)
+{
+    ScrollCount * count = (ScrollCount *) user_data;
+
+    g_assert_cmpint(delta, !=, 0);
+    count->smooth_scrolls++;
+    count->delta[orientation] += delta;
+
+    return;
+}
+
+static void
+scroll_call (GDBusConnection * bus, const gchar * path, gint delta, const gchar * orientation)
+{
+    g_dbus_connection_call(bus,
+                           g_dbus_connection_get_unique_name(bus),
+                           path,
+                           "org.kde.StatusNotifierItem",
+                           "Scroll",
+                           g_variant_new("(is)", delta, orientation),
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, NULL, NULL);
+
+    return;
+}
+
+void
+test_libappindicator_scroll (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-scroll", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_scroll";
+    ScrollCount count = { 0 };
+    GVariant * id;
+    gint64 end;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_SCROLL_EVENT, G_CALLBACK(scroll_event_cb), &count);
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_SMOOTH_SCROLL, G_CALLBACK(smooth_scroll_cb), &count);
+
+    /* Wait for the item to be on the bus */
+    id = bus_property_get(bus, path, "Id");
+    g_assert(id != NULL);
+    g_variant_unref(id);
+
+    scroll_call(bus, path, 1, "vertical");
+    scroll_call(bus, path, 2, "vertical");
+    scroll_call(bus, path, -3, "horizontal");
+    scroll_call(bus, path, 5, "diagonal");
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end &&
+           (count.delta[GTK_ORIENTATION_VERTICAL] != 3 || count.delta[GTK_ORIENTATION_HORIZONTAL] != -3)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpint(count.delta[GTK_ORIENTATION_VERTICAL], ==, 3);
+    g_assert_cmpint(count.delta[GTK_ORIENTATION_HORIZONTAL], ==, -3);
+
+    /* One signal for each orientation and frame, never one per call */
+    g_assert_cmpint(count.smooth_scrolls, >=, 2);
+    g_assert_cmpint(count.smooth_scrolls, <=, 3);
+    g_assert_cmpint(count.scroll_events, ==, count.smooth_scrolls);
+
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+
+    return;
+}
+
+static void
+activate_cb (AppIndicator * ci, gint x, gint y, gpointer user_data)
+{
+    gint * position = (gint *) user_data;
+
+    position[0] = x;
+    position[1] = y;
+
+    return;
+}
+
+void
+test_libappindicator_activate (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-activate", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_activate";
+    gint position[2] = { -1, -1 };
+    GVariant * item_is_menu;
+    gint64 end;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+    g_assert(app_indicator_get_item_is_menu(ci));
+
+    g_signal_connect(G_OBJECT(ci), APP_INDICATOR_SIGNAL_ACTIVATE, G_CALLBACK(activate_cb), position);
+
+    /* No menu is needed to be put on the bus */
+    app_indicator_set_item_is_menu(ci, FALSE);
+    g_assert(!app_indicator_get_item_is_menu(ci));
+
+    item_is_menu = bus_property_get(bus, path, "ItemIsMenu");
+    g_assert(item_is_menu != NULL);
+    g_assert(!g_variant_get_boolean(item_is_menu));
+    g_variant_unref(item_is_menu);
+
+    g_dbus_connection_call(bus,
+                           g_dbus_connection_get_unique_name(bus),
+                           path,
+                           "org.kde.StatusNotifierItem",
+                           "Activate",
+                           g_variant_new("(ii)", 10, 20),
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, NULL, NULL);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && position[0] == -1) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpint(position[0], ==, 10);
+    g_assert_cmpint(position[1], ==, 20);
+
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+
+    return;
+}
+
+void
+test_libappindicator_no_host (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GError * error = NULL;
+    gchar * address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    MockWatcher watcher = { 0 };
+    GDBusConnection * watcher_bus;
+    AppIndicator * ci;
+    guint64 emitted;
+    gint64 end;
+
+    g_assert_no_error(error);
+
+    /* The watcher has a connection of its own, like it would have
+       in another process */
+    watcher_bus = mock_connection_new(address);
+    mock_watcher_start(&watcher, watcher_bus);
+
+    ci = app_indicator_new ("my-id-no-host", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    g_assert(ci != NULL);
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && (watcher.items_registered == 0 || watcher.host_queries == 0)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpint(watcher.items_registered, ==, 1);
+    g_assert_cmpint(watcher.host_queries, >=, 1);
+
+    /* Let the answer come back */
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    /* Nobody listens, so nothing is sent */
+    emitted = statistics_lookup(ci, "signals-emitted");
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ATTENTION);
+    app_indicator_set_icon_full(ci, "my-other-name", NULL);
+
+    g_assert_cmpuint(statistics_lookup(ci, "signals-emitted"), ==, emitted);
+    g_assert_cmpuint(statistics_lookup(ci, "signals-suppressed"), >=, 1);
+
+    /* The host gets everything once */
+    mock_watcher_register_host(&watcher);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && statistics_lookup(ci, "signals-emitted") == emitted) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpuint(statistics_lookup(ci, "signals-emitted"), >=, emitted + 7);
+
+    /* And nothing more after that */
+    emitted = statistics_lookup(ci, "signals-emitted");
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+    g_assert_cmpuint(statistics_lookup(ci, "signals-emitted"), ==, emitted + 1);
+
+    g_object_unref(G_OBJECT(ci));
+
+    mock_watcher_stop(&watcher);
+    g_dbus_connection_close_sync(watcher_bus, NULL, NULL);
+    g_object_unref(watcher_bus);
+    g_free(address);
+
+    return;
+}
+
+static void
+status_signal_cb (GDBusConnection * connection, const gchar * sender, const gchar * path,
+                  const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+{
+    gint * count = (gint *) user_data;
+
+    (*count)++;
+    return;
+}
+
+void
+test_libappindicator_unicast_signals (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GError * error = NULL;
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    gchar * address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    AppIndicator * ci = app_indicator_new ("my-id-unicast", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_unicast";
+    GDBusConnection * other;
+    gint host_count = 0;
+    gint other_count = 0;
+    guint host_sub, other_sub;
+    GVariant * id;
+    gint64 end;
+
+    g_assert_no_error(error);
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    /* Somebody else on the bus listening for everything */
+    other = g_dbus_connection_new_for_address_sync(address,
+                                                   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                   G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                   NULL, NULL, &error);
+    g_assert_no_error(error);
+
+    host_sub = g_dbus_connection_signal_subscribe(bus, g_dbus_connection_get_unique_name(bus),
+                                                  "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                                  G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &host_count, NULL);
+    other_sub = g_dbus_connection_signal_subscribe(other, g_dbus_connection_get_unique_name(bus),
+                                                   "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                                   G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &other_count, NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_unicast_signals(ci, TRUE);
+
+    /* Reading a property makes us a consumer */
+    id = bus_property_get(bus, path, "Id");
+    g_assert(id != NULL);
+    g_variant_unref(id);
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ATTENTION);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && host_count == 0) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    g_assert_cmpint(host_count, ==, 1);
+    g_assert_cmpint(other_count, ==, 0);
+
+    /* Everybody gets it again */
+    app_indicator_set_unicast_signals(ci, FALSE);
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && (host_count < 2 || other_count == 0)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpint(host_count, ==, 2);
+    g_assert_cmpint(other_count, ==, 1);
+
+    g_object_unref(G_OBJECT(ci));
+
+    g_dbus_connection_signal_unsubscribe(bus, host_sub);
+    g_dbus_connection_signal_unsubscribe(other, other_sub);
+    g_dbus_connection_close_sync(other, NULL, NULL);
+    g_object_unref(other);
+    g_object_unref(bus);
+    g_free(address);
+
+    return;
+}
+
+/* Asks the item for a peer channel while the main loop runs */
+static gchar *
+peer_channel_open_call (GDBusConnection * bus, const gchar * path, GError ** error)
+{
+    GAsyncResult * res = NULL;
+    gchar * address = NULL;
+    GVariant * reply;
+
+    g_dbus_connection_call(bus,
+                           g_dbus_connection_get_unique_name(bus),
+                           path,
+                           "org.kde.StatusNotifierItem",
+                           "XAyatanaOpenPeerChannel",
+                           NULL,
+                           G_VARIANT_TYPE("(s)"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    reply = g_dbus_connection_call_finish(bus, res, error);
+    g_object_unref(res);
+
+    if (reply != NULL) {
+        g_variant_get(reply, "(s)", &address);
+        g_variant_unref(reply);
+    }
+
+    return address;
+}
+
+void
+test_libappindicator_peer_channel (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GError * error = NULL;
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-peer", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_peer";
+    GAsyncResult * res = NULL;
+    GDBusConnection * peer;
+    gint peer_count = 0;
+    gchar * address;
+    gchar * again;
+    GVariant * reply;
+    GVariant * id;
+    guint sub;
+    gint64 end;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+
+    id = bus_property_get(bus, path, "Id");
+    g_assert(id != NULL);
+    g_variant_unref(id);
+
+    /* Nothing until the application asks for it */
+    address = peer_channel_open_call(bus, path, &error);
+    g_assert(address == NULL);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED);
+    g_clear_error(&error);
+
+    app_indicator_set_peer_channels_enabled(ci, TRUE);
+
+    /* Nor without unicast signals */
+    address = peer_channel_open_call(bus, path, &error);
+    g_assert(address == NULL);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED);
+    g_clear_error(&error);
+
+    app_indicator_set_unicast_signals(ci, TRUE);
+
+    address = peer_channel_open_call(bus, path, &error);
+    g_assert_no_error(error);
+    g_assert(address != NULL);
+
+    /* Asking again before connecting gets the same server */
+    again = peer_channel_open_call(bus, path, &error);
+    g_assert_no_error(error);
+    g_assert_cmpstr(again, ==, address);
+    g_free(again);
+
+    /* The item is in this process, so no blocking here */
+    g_dbus_connection_new_for_address(address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                      NULL, NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    peer = g_dbus_connection_new_for_address_finish(res, &error);
+    g_assert_no_error(error);
+    g_clear_object(&res);
+
+    /* The item is on the peer connection too */
+    g_dbus_connection_call(peer, NULL, path,
+                           "org.freedesktop.DBus.Properties", "Get",
+                           g_variant_new("(ss)", "org.kde.StatusNotifierItem", "Id"),
+                           G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE,
+                           1000, NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    reply = g_dbus_connection_call_finish(peer, res, &error);
+    g_assert_no_error(error);
+    g_variant_get(reply, "(v)", &id);
+    g_assert_cmpstr(g_variant_get_string(id, NULL), ==, "my-id-peer");
+    g_variant_unref(id);
+    g_variant_unref(reply);
+    g_clear_object(&res);
+
+    /* And so are its signals */
+    sub = g_dbus_connection_signal_subscribe(peer, NULL, "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                             G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &peer_count, NULL);
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ATTENTION);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && peer_count == 0) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert_cmpint(peer_count, ==, 1);
+
+    g_dbus_connection_signal_unsubscribe(peer, sub);
+    g_object_unref(G_OBJECT(ci));
+
+    /* Going away closes the peer connection */
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && !g_dbus_connection_is_closed(peer)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert(g_dbus_connection_is_closed(peer));
+
+    g_object_unref(peer);
+    g_object_unref(bus);
+    g_free(address);
+
+    return;
+}
+
+/* Opens a peer channel to the item and connects to it */
+static GDBusConnection *
+peer_channel_connect (GDBusConnection * bus, const gchar * path)
+{
+    GAsyncResult * res = NULL;
+    GError * error = NULL;
+    GDBusConnection * peer;
+    gchar * address = peer_channel_open_call(bus, path, &error);
+
+    g_assert_no_error(error);
+    g_assert(address != NULL);
+
+    g_dbus_connection_new_for_address(address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                      NULL, NULL, async_result_cb, &res);
+
+    async_result_wait(&res);
+
+    peer = g_dbus_connection_new_for_address_finish(res, &error);
+    g_assert_no_error(error);
+    g_object_unref(res);
+    g_free(address);
+
+    return peer;
+}
+
+void
+test_libappindicator_peer_channel_signals (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GError * error = NULL;
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    gchar * address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    AppIndicator * ci = app_indicator_new ("my-id-peer-signals", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_peer_signals";
+    const gchar * name;
+    GDBusConnection * other;
+    GDBusConnection * peer;
+    gint bus_count = 0;
+    gint other_count = 0;
+    gint peer_count = 0;
+    guint bus_sub, other_sub, peer_sub;
+    GVariant * id;
+    gint64 end;
+
+    g_assert_no_error(error);
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    name = g_dbus_connection_get_unique_name(bus);
+
+    /* A host on the bus only */
+    other = g_dbus_connection_new_for_address_sync(address,
+                                                   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                   G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                   NULL, NULL, &error);
+    g_assert_no_error(error);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_unicast_signals(ci, TRUE);
+    app_indicator_set_peer_channels_enabled(ci, TRUE);
+    app_indicator_add_signal_consumer(ci, g_dbus_connection_get_unique_name(other));
+
+    /* And one with a peer channel, that is a consumer on the bus too */
+    id = bus_property_get(bus, path, "Id");
+    g_assert(id != NULL);
+    g_variant_unref(id);
+
+    peer = peer_channel_connect(bus, path);
+
+    bus_sub = g_dbus_connection_signal_subscribe(bus, name, "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                                 G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &bus_count, NULL);
+    other_sub = g_dbus_connection_signal_subscribe(other, name, "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                                   G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &other_count, NULL);
+    peer_sub = g_dbus_connection_signal_subscribe(peer, NULL, "org.kde.StatusNotifierItem", "NewStatus", path, NULL,
+                                                  G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &peer_count, NULL);
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ATTENTION);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && (peer_count == 0 || other_count == 0)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    /* Every host once, the peer one only over its channel */
+    g_assert_cmpint(peer_count, ==, 1);
+    g_assert_cmpint(bus_count, ==, 0);
+    g_assert_cmpint(other_count, ==, 1);
+
+    /* Broadcasting closes the channel first */
+    app_indicator_set_unicast_signals(ci, FALSE);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && !g_dbus_connection_is_closed(peer)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_assert(g_dbus_connection_is_closed(peer));
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+
+    end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+    while (g_get_monotonic_time() < end && (bus_count == 0 || other_count < 2)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    g_assert_cmpint(peer_count, ==, 1);
+    g_assert_cmpint(bus_count, ==, 1);
+    g_assert_cmpint(other_count, ==, 2);
+
+    g_object_unref(G_OBJECT(ci));
+
+    g_dbus_connection_signal_unsubscribe(bus, bus_sub);
+    g_dbus_connection_signal_unsubscribe(other, other_sub);
+    g_dbus_connection_signal_unsubscribe(peer, peer_sub);
+    g_dbus_connection_close_sync(other, NULL, NULL);
+    g_object_unref(other);
+    g_object_unref(peer);
+    g_object_unref(bus);
+    g_free(address);
+
+    return;
+}
+
+/* Asks the item for its state page and maps it, like a host would */
+static const NotificationItemStatePage *
+state_page_call (GDBusConnection * bus, const gchar * path, GError ** error)
+{
+    const NotificationItemStatePage * page;
+    gint fd = state_page_fd_get(bus, g_dbus_connection_get_unique_name(bus), path, error);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    page = state_page_map(fd);
+    close(fd);
+
+    return page;
+}
+
+/* Waits for @field of the page to change from @old */
+static NotificationItemStatePage
+state_page_wait (const NotificationItemStatePage * page, gsize field, guint32 old)
+{
+    NotificationItemStatePage state;
+    gint64 end = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+    g_assert(state_page_read(page, &state, NULL));
+
+    while (g_get_monotonic_time() < end && G_STRUCT_MEMBER(guint32, &state, field) == old) {
+        g_main_context_iteration(NULL, TRUE);
+        g_assert(state_page_read(page, &state, NULL));
+    }
+
+    return state;
+}
+
+void
+test_libappindicator_state_page (void)
+{
+    g_test_log_set_fatal_handler (allow_warnings, NULL);
+
+    GError * error = NULL;
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * ci = app_indicator_new ("my-id-state-page", "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+    const gchar * path = "/org/ayatana/NotificationItem/my_id_state_page";
+    const NotificationItemStatePage * page;
+    NotificationItemStatePage state;
+    gchar * filler;
+    gchar * long_label;
+    GVariant * id;
+    gint fd;
+
+    g_assert(ci != NULL);
+    g_assert(bus != NULL);
+
+    app_indicator_set_menu(ci, GTK_MENU(gtk_menu_new()));
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ACTIVE);
+    app_indicator_set_label(ci, "Before", NULL);
+
+    id = bus_property_get(bus, path, "Id");
+    g_assert(id != NULL);
+    g_variant_unref(id);
+
+    /* Nothing until the application asks for it */
+    page = state_page_call(bus, path, &error);
+    g_assert(page == NULL);
+    g_assert_error(error, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED);
+    g_clear_error(&error);
+
+    app_indicator_set_state_page_enabled(ci, TRUE);
+
+    page = state_page_call(bus, path, &error);
+    g_assert_no_error(error);
+    g_assert(page != NULL);
+
+    /* Hosts can only read it */
+    fd = state_page_fd_get(bus, g_dbus_connection_get_unique_name(bus), path, &error);
+    g_assert_no_error(error);
+    g_assert(mmap(NULL, NOTIFICATION_ITEM_STATE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED);
+    close(fd);
+
+    g_assert(state_page_read(page, &state, NULL));
+    g_assert_cmpuint(state.size, ==, sizeof(NotificationItemStatePage));
+    g_assert_cmpuint(state.status, ==, APP_INDICATOR_STATUS_ACTIVE);
+    g_assert_cmpuint(state.flags, ==, 0);
+    g_assert_cmpuint(state.sequence % 2, ==, 0);
+    g_assert_cmpstr(state.label, ==, "Before");
+
+    app_indicator_set_status(ci, APP_INDICATOR_STATUS_ATTENTION);
+    g_assert(state_page_read(page, &state, NULL));
+    g_assert_cmpuint(state.status, ==, APP_INDICATOR_STATUS_ATTENTION);
+
+    app_indicator_set_ordering_index(ci, 42);
+    g_assert(state_page_read(page, &state, NULL));
+    g_assert_cmpuint(state.ordering_index, ==, 42);
+
+    app_indicator_set_icon_full(ci, "my-other-name", NULL);
+    state = state_page_wait(page, G_STRUCT_OFFSET(NotificationItemStatePage, icon_generation), state.icon_generation);
+    g_assert_cmpuint(state.icon_generation, >, 0);
+
+    /* Cut short without breaking a character */
+    filler = g_strnfill(NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE - 2, 'x');
+    long_label = g_strconcat(filler, "\xc3\xa9", NULL);
+
+    app_indicator_set_label(ci, long_label, NULL);
+    state = state_page_wait(page, G_STRUCT_OFFSET(NotificationItemStatePage, label_generation), state.label_generation);
+    g_assert_cmpuint(strlen(state.label), ==, NOTIFICATION_ITEM_STATE_PAGE_LABEL_SIZE - 2);
+    g_assert(g_utf8_validate(state.label, -1, NULL));
+
+    /* The hosts that have it find out that it's not written anymore */
+    app_indicator_set_state_page_enabled(ci, FALSE);
+    g_assert(state_page_read(page, &state, NULL));
+    g_assert_cmpuint(state.flags & NOTIFICATION_ITEM_STATE_PAGE_CLOSED, !=, 0);
+
+    state_page_unmap(page);
+    g_object_unref(G_OBJECT(ci));
+    g_object_unref(bus);
+    g_free(long_label);
+    g_free(filler);
+
+    return;
+}
+
+static void
+dispose_many_connection_cb (AppIndicator * ci, gboolean connected, gpointer user_data)
+{
+    gint * count = (gint *) user_data;
+
+    (*count)++;
+    return;
+}
+
+void
+test_libappindicator_dispose_many (void)
+{
+    GDBusConnection * bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    AppIndicator * indicators[3];
+    gint status_count = 0;
+    gint connection_count = 0;
+    guint sub;
+    gint64 end;
+    guint i;
+
+    g_assert(bus != NULL);
+
+    sub = g_dbus_connection_signal_subscribe(bus, g_dbus_connection_get_unique_name(bus),
+                                             "org.kde.StatusNotifierItem", "NewStatus", NULL, NULL,
+                                             G_DBUS_SIGNAL_FLAGS_NONE, status_signal_cb, &status_count, NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(indicators); i++) {
+        gchar * id = g_strdup_printf("my-id-dispose-many-%u", i);
+        gchar * path = g_strdup_printf("/org/ayatana/NotificationItem/my_id_dispose_many_%u", i);
+        GVariant * value;
+
+        indicators[i] = app_indicator_new (id, "my-name", APP_INDICATOR_CATEGORY_APPLICATION_STATUS);
+        g_signal_connect(indicators[i], APP_INDICATOR_SIGNAL_CONNECTION_CHANGED,
+                         G_CALLBACK(dispose_many_connection_cb), &connection_count);
+        app_indicator_set_menu(indicators[i], GTK_MENU(gtk_menu_new()));
+        app_indicator_set_status(indicators[i], APP_INDICATOR_STATUS_ACTIVE);
+
+        value = bus_property_get(bus, path, "Id");
+        g_assert(value != NULL);
+        g_variant_unref(value);
+
+        g_free(path);
+        g_free(id);
+    }
+
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    status_count = 0;
+    connection_count = 0;
+
+    app_indicator_dispose_many(indicators, G_N_ELEMENTS(indicators));
+
+    /* Gone from the bus, hidden with a single status change each */
+    for (i = 0; i < G_N_ELEMENTS(indicators); i++) {
+        gchar * path = g_strdup_printf("/org/ayatana/NotificationItem/my_id_dispose_many_%u", i);
+        GAsyncResult * res = NULL;
+        GError * error = NULL;
+        GVariant * reply;
+
+        g_dbus_connection_call(bus, g_dbus_connection_get_unique_name(bus), path,
+                               "org.freedesktop.DBus.Properties", "Get",
+                               g_variant_new("(ss)", "org.kde.StatusNotifierItem", "Id"),
+                               G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE,
+                               1000, NULL, async_result_cb, &res);
+
+        async_result_wait(&res);
+
+        reply = g_dbus_connection_call_finish(bus, res, &error);
+        g_assert(reply == NULL);
+        g_assert(error != NULL);
+
+        g_clear_error(&error);
+        g_object_unref(res);
+        g_free(path);
+    }
+
+    end = g_get_monotonic_time() + G_USEC_PER_SEC / 10;
+    while (g_get_monotonic_time() < end) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    g_assert_cmpint(status_count, ==, G_N_ELEMENTS(indicators));
+    g_assert_cmpint(connection_count, ==, 0);
+
+    for (i = 0; i < G_N_ELEMENTS(indicators); i++) {
+        g_object_unref(G_OBJECT(indicators[i]));
+    }
+
+    g_assert_cmpint(status_count, ==, G_N_ELEMENTS(indicators));
+
+    g_dbus_connection_signal_unsubscribe(bus, sub);
+    g_object_unref(bus);
+
+    return;
+}
+
 void
 test_libappindicator_props_suite (void)
 {
@@ -455,8 +2276,29 @@ test_libappindicator_props_suite (void)
     g_test_add_func ("/indicator-application/libappindicator/set_label",       test_libappindicator_set_label);
     g_test_add_func ("/indicator-application/libappindicator/set_menu",        test_libappindicator_set_menu);
     g_test_add_func ("/indicator-application/libappindicator/label_signals",   test_libappindicator_label_signals);
+    g_test_add_func ("/indicator-application/libappindicator/label_template",  test_libappindicator_label_template);
     g_test_add_func ("/indicator-application/libappindicator/desktop_menu",    test_libappindicator_desktop_menu);
     g_test_add_func ("/indicator-application/libappindicator/desktop_menu_bad",test_libappindicator_desktop_menu_bad);
+    g_test_add_func ("/indicator-application/libappindicator/icon_animation",  test_libappindicator_icon_animation);
+    g_test_add_func ("/indicator-application/libappindicator/icon_allocations",test_libappindicator_icon_allocations);
+    g_test_add_func ("/indicator-application/libappindicator/theme_changed",   test_libappindicator_theme_changed);
+    g_test_add_func ("/indicator-application/libappindicator/icon_theme_cache", test_libappindicator_icon_theme_cache);
+    g_test_add_func ("/indicator-application/libappindicator/statistics",      test_libappindicator_statistics);
+    g_test_add_func ("/indicator-application/libappindicator/threaded_setters", test_libappindicator_threaded_setters);
+    g_test_add_func ("/indicator-application/libappindicator/last_unref_in_thread", test_libappindicator_last_unref_in_thread);
+    g_test_add_func ("/indicator-application/libappindicator/dbus_context",    test_libappindicator_dbus_context);
+    g_test_add_func ("/indicator-application/libappindicator/new_async",       test_libappindicator_new_async);
+    g_test_add_func ("/indicator-application/libappindicator/no_session_bus",  test_libappindicator_no_session_bus);
+    g_test_add_func ("/indicator-application/libappindicator/tooltip",         test_libappindicator_tooltip);
+    g_test_add_func ("/indicator-application/libappindicator/text_providers",  test_libappindicator_text_providers);
+    g_test_add_func ("/indicator-application/libappindicator/scroll",          test_libappindicator_scroll);
+    g_test_add_func ("/indicator-application/libappindicator/activate",        test_libappindicator_activate);
+    g_test_add_func ("/indicator-application/libappindicator/unicast_signals", test_libappindicator_unicast_signals);
+    g_test_add_func ("/indicator-application/libappindicator/no_host",         test_libappindicator_no_host);
+    g_test_add_func ("/indicator-application/libappindicator/peer_channel",    test_libappindicator_peer_channel);
+    g_test_add_func ("/indicator-application/libappindicator/peer_channel_signals", test_libappindicator_peer_channel_signals);
+    g_test_add_func ("/indicator-application/libappindicator/state_page",      test_libappindicator_state_page);
+    g_test_add_func ("/indicator-application/libappindicator/dispose_many",    test_libappindicator_dispose_many);
 
     return;
 }